@@ -0,0 +1,391 @@
+#pragma once
+
+#include "slab.h"
+
+#include <shared-from-this/weak.h>
+
+#include <algorithm>  // std::min
+#include <cstddef>    // size_t
+#include <cstdint>    // uint64_t
+#include <istream>
+#include <ostream>
+#include <stdexcept>  // std::runtime_error
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+// Streaming binary archives for object graphs connected with `SharedPtr` and `WeakPtr`.
+//
+// A class is made serializable with a member used both for writing and for reading:
+//     template <typename Archive>
+//     void Serialize(Archive& ar) {
+//         ar(field1, field2, ...);
+//     }
+// Arithmetic types, enums, `std::string`, `std::vector` and the pointers are handled by the
+// archives themselves.
+//
+// Objects are identified by their control blocks: an object reachable through several pointers
+// is written once, right where the first of them is met, and the others refer to it by number.
+// On reading every object is created once and all the pointers share it. `WeakPtr`s stay weak:
+// an object that the graph references only weakly expires when the `InputArchive` is destroyed,
+// just as it did when its outside owners were gone.
+//
+// The contents of objects are not nested: a pointer to a new object only gets its number, and
+// the objects are written after the values passed to the same call, in order of numbers. So the
+// depth of the graph doesn't matter, neither for writing nor for reading.
+//
+// Not supported: polymorphic pointees (objects are written as the static type of the pointer),
+// aliasing pointers (a pointer must point to the object of its block), `std::vector<bool>`.
+// A pointer to an already written block but to another address throws `std::runtime_error`.
+
+class ArchiveFormat {
+protected:
+    static constexpr char kMagic[4] = {'S', 'P', 'A', 'R'};
+    static constexpr uint64_t kVersion = 1;
+};
+
+class OutputArchive : ArchiveFormat {
+public:
+    explicit OutputArchive(std::ostream& out) : out_(*out.rdbuf()) {
+        WriteBytes(kMagic, sizeof(kMagic));
+        WriteVarint(kVersion);
+        Flush();
+    }
+    OutputArchive(const OutputArchive&) = delete;
+    OutputArchive& operator=(const OutputArchive&) = delete;
+
+    ~OutputArchive() {
+        for (auto& [block, object] : ids_) {
+            block->DecreaseWeak();
+        }
+    }
+
+    template <typename... Ts>
+    OutputArchive& operator()(const Ts&... values) {
+        // Nested calls come from `Serialize`
+        if (nested_) {
+            (Save(values), ...);
+            return *this;
+        }
+        TopLevelCall call{*this};
+        (Save(values), ...);
+        // Objects met on the way may refer to more objects
+        for (; written_ < pending_.size(); ++written_) {
+            auto [block, ptr, save] = pending_[written_];
+            save(*this, ptr);
+            block->DecreaseStrong();
+        }
+        Flush();
+        return *this;
+    }
+
+    // Distinct objects written so far
+    size_t NumObjects() const {
+        return ids_.size();
+    }
+
+private:
+    // Object to be written, with a strong reference: it may be reachable only through `WeakPtr`s
+    struct Pending {
+        ControlBlockBasic* block;
+        const void* ptr;
+        void (*save)(OutputArchive&, const void*);
+    };
+
+    // Written object: its number and the pointer it was written through
+    struct Object {
+        uint64_t id;
+        const void* ptr;
+    };
+
+    // Resets the state of a top-level call, also when it is left by an exception.
+    struct TopLevelCall {
+        explicit TopLevelCall(OutputArchive& ar) : ar(ar) {
+            ar.nested_ = true;
+        }
+        ~TopLevelCall() {
+            for (; ar.written_ < ar.pending_.size(); ++ar.written_) {
+                ar.pending_[ar.written_].block->DecreaseStrong();
+            }
+            ar.pending_.clear();
+            ar.written_ = 0;
+            ar.nested_ = false;
+        }
+
+        OutputArchive& ar;
+    };
+
+    template <typename T>
+    void Save(const T& value) {
+        if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+            WriteBytes(&value, sizeof(T));
+        } else {
+            // `Serialize` is shared with reading, hence not const
+            const_cast<T&>(value).Serialize(*this);
+        }
+    }
+
+    void Save(const std::string& value) {
+        WriteVarint(value.size());
+        WriteBytes(value.data(), value.size());
+    }
+
+    template <typename T>
+    void Save(const std::vector<T>& values) {
+        WriteVarint(values.size());
+        if constexpr (std::is_arithmetic_v<T>) {
+            WriteBytes(values.data(), values.size() * sizeof(T));
+        } else {
+            for (const auto& value : values) {
+                Save(value);
+            }
+        }
+    }
+
+    template <typename T>
+    void Save(const SharedPtr<T>& ptr) {
+        if (ptr.Get() == nullptr) {
+            WriteVarint(0);
+            return;
+        }
+        auto [it, inserted] = ids_.try_emplace(ptr.buffer, Object{ids_.size(), ptr.Get()});
+        if (!inserted && it->second.ptr != ptr.Get()) {
+            throw std::runtime_error("Can't write aliasing pointers");
+        }
+        WriteVarint(it->second.id + 1);
+        if (inserted) {
+            // The block must outlive the archive: an object allocated at its address later
+            // would otherwise be written as a reference to this one
+            ptr.buffer->IncreaseWeak();
+            ptr.buffer->IncreaseStrong();
+            pending_.push_back({ptr.buffer, ptr.Get(), [](OutputArchive& ar, const void* object) {
+                                    ar.Save(*static_cast<const T*>(object));
+                                }});
+        }
+    }
+
+    // Same encoding as a strong pointer: the reader tells them apart by the type it loads into.
+    template <typename T>
+    void Save(const WeakPtr<T>& ptr) {
+        Save(ptr.Expired() ? SharedPtr<T>() : ptr.Lock());
+    }
+
+    void WriteBytes(const void* data, size_t size) {
+        auto bytes = static_cast<const char*>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + size);
+        if (buffer_.size() >= kFlushSize) {
+            Flush();
+        }
+    }
+
+    void Flush() {
+        if (static_cast<size_t>(out_.sputn(buffer_.data(), buffer_.size())) != buffer_.size()) {
+            throw std::runtime_error("Can't write archive");
+        }
+        buffer_.clear();
+    }
+
+    void WriteVarint(uint64_t value) {
+        char bytes[10];
+        size_t size = 0;
+        while (value >= 0x80) {
+            bytes[size++] = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        bytes[size++] = static_cast<char>(value);
+        WriteBytes(bytes, size);
+    }
+
+    static constexpr size_t kFlushSize = 64 << 10;
+
+    std::streambuf& out_;
+    // Everything is in the stream after each top-level call
+    std::vector<char> buffer_;
+    // Every block here is held with a weak reference
+    std::unordered_map<ControlBlockBasic*, Object> ids_;
+    std::vector<Pending> pending_;
+    size_t written_ = 0;
+    bool nested_ = false;
+};
+
+class InputArchive : ArchiveFormat {
+public:
+    enum class Allocation {
+        // One `MakeShared` per object
+        kMakeShared,
+        // Objects are packed into slabs of a `SlabAllocator`
+        kSlab,
+    };
+
+    // Objects are default-constructed and then filled by `Serialize`.
+    explicit InputArchive(std::istream& in, Allocation allocation = Allocation::kMakeShared)
+        : in_(*in.rdbuf()), allocation_(allocation) {
+        char magic[sizeof(kMagic)];
+        ReadBytes(magic, sizeof(magic));
+        if (std::char_traits<char>::compare(magic, kMagic, sizeof(kMagic)) != 0) {
+            throw std::runtime_error("Not an archive");
+        }
+        if (ReadVarint() != kVersion) {
+            throw std::runtime_error("Unsupported archive version");
+        }
+    }
+    InputArchive(const InputArchive&) = delete;
+    InputArchive& operator=(const InputArchive&) = delete;
+
+    // Until then every object read is kept alive, so that later reads may refer to it.
+    ~InputArchive() {
+        for (auto& object : objects_) {
+            object.block->DecreaseStrong();
+        }
+    }
+
+    template <typename... Ts>
+    InputArchive& operator()(Ts&... values) {
+        if (nested_) {
+            (Load(values), ...);
+            return *this;
+        }
+        nested_ = true;
+        try {
+            (Load(values), ...);
+            for (; loaded_ < objects_.size(); ++loaded_) {
+                objects_[loaded_].load(*this, objects_[loaded_].ptr);
+            }
+        } catch (...) {
+            nested_ = false;
+            throw;
+        }
+        nested_ = false;
+        return *this;
+    }
+
+    size_t NumObjects() const {
+        return objects_.size();
+    }
+
+private:
+    struct Object {
+        ControlBlockBasic* block;
+        void* ptr;
+        const std::type_info* type;
+        void (*load)(InputArchive&, void*);
+    };
+
+    template <typename T>
+    void Load(T& value) {
+        if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+            ReadBytes(&value, sizeof(T));
+        } else {
+            value.Serialize(*this);
+        }
+    }
+
+    // Lengths come from the input, so containers grow only as their contents are actually read:
+    // a corrupted length ends with "unexpected end" instead of a huge allocation.
+    void Load(std::string& value) {
+        size_t size = ReadLength(value.max_size());
+        value.clear();
+        while (value.size() < size) {
+            size_t done = value.size();
+            value.resize(done + std::min(size - done, kReadChunk));
+            ReadBytes(value.data() + done, value.size() - done);
+        }
+    }
+
+    template <typename T>
+    void Load(std::vector<T>& values) {
+        size_t size = ReadLength(values.max_size());
+        values.clear();
+        if constexpr (std::is_arithmetic_v<T>) {
+            while (values.size() < size) {
+                size_t done = values.size();
+                values.resize(done + std::min(size - done, kReadChunk / sizeof(T)));
+                ReadBytes(values.data() + done, (values.size() - done) * sizeof(T));
+            }
+        } else {
+            while (values.size() < size) {
+                Load(values.emplace_back());
+            }
+        }
+    }
+
+    template <typename T>
+    void Load(SharedPtr<T>& ptr) {
+        uint64_t tag = ReadVarint();
+        if (tag == 0) {
+            ptr = SharedPtr<T>();
+            return;
+        }
+        uint64_t id = tag - 1;
+        if (id < objects_.size()) {
+            const Object& object = objects_[id];
+            if (*object.type != typeid(T)) {
+                throw std::runtime_error("Corrupted archive: object type mismatch");
+            }
+            object.block->IncreaseStrong();
+            ptr = SharedPtr<T>(object.block, static_cast<T*>(object.ptr));
+            return;
+        }
+        if (id != objects_.size()) {
+            throw std::runtime_error("Corrupted archive: bad object id");
+        }
+
+        SharedPtr<T> created =
+            allocation_ == Allocation::kSlab ? slab_.MakeShared<T>() : MakeShared<T>();
+        // The contents come later
+        created.buffer->IncreaseStrong();
+        objects_.push_back({created.buffer, created.Get(), &typeid(T),
+                            [](InputArchive& ar, void* object) {
+                                ar.Load(*static_cast<T*>(object));
+                            }});
+        ptr = std::move(created);
+    }
+
+    template <typename T>
+    void Load(WeakPtr<T>& ptr) {
+        SharedPtr<T> strong;
+        Load(strong);
+        ptr = WeakPtr<T>(strong);
+    }
+
+    void ReadBytes(void* data, size_t size) {
+        if (static_cast<size_t>(in_.sgetn(static_cast<char*>(data), size)) != size) {
+            throw std::runtime_error("Corrupted archive: unexpected end");
+        }
+    }
+
+    size_t ReadLength(size_t max_size) {
+        uint64_t size = ReadVarint();
+        if (size > max_size) {
+            throw std::runtime_error("Corrupted archive: bad length");
+        }
+        return size;
+    }
+
+    uint64_t ReadVarint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            auto byte = in_.sbumpc();
+            if (byte == std::char_traits<char>::eof()) {
+                throw std::runtime_error("Corrupted archive: unexpected end");
+            }
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Corrupted archive: bad varint");
+    }
+
+    static constexpr size_t kReadChunk = 64 << 10;
+
+    std::streambuf& in_;
+    Allocation allocation_;
+    SlabAllocator slab_;
+    std::vector<Object> objects_;
+    // Objects before this one are filled
+    size_t loaded_ = 0;
+    bool nested_ = false;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+
+#include <atomic>
+#include <cstddef>  // size_t, std::max_align_t
+#include <new>      // placement new
+#include <utility>  // std::forward
+
+// Chunk of memory shared by the control blocks carved out of it.
+// Freed when the last of them (and its `SlabAllocator`) lets it go.
+struct Slab {
+    static Slab* Create(size_t capacity) {
+        void* memory = ::operator new(sizeof(Slab) + capacity);
+        return ::new (memory) Slab(capacity);
+    }
+
+    void Release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            size_t total = sizeof(Slab) + capacity;
+            this->~Slab();
+            ::operator delete(this, total);
+        }
+    }
+
+    char* Data() {
+        return reinterpret_cast<char*>(this + 1);
+    }
+
+    // One for the allocator while it's filling the slab, one per block
+    std::atomic<size_t> refs = 1;
+    size_t capacity;
+
+private:
+    explicit Slab(size_t capacity) : capacity(capacity) {
+    }
+};
+
+// Control block of `SlabAllocator::MakeShared`: like the one of `MakeShared`, but placed in a
+// slab, which it releases instead of deleting itself.
+template <typename T>
+class ControlBlockSlab : public ControlBlockBasic {
+public:
+    template <typename... Args>
+    ControlBlockSlab(Slab* slab, Args&&... args) : slab_(slab) {
+        new (&x) T(std::forward<Args>(args)...);
+        ++strong_cnt;
+    }
+    void DestroyObject() override {
+        Get()->~T();
+    }
+    void DestroyBlock() override {
+        Slab* slab = slab_;
+        this->~ControlBlockSlab();
+        slab->Release();
+    }
+    T* Get() {
+        return reinterpret_cast<T*>(&x);
+    }
+
+    alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
+
+private:
+    Slab* slab_;
+};
+
+// Bump allocator for many small `SharedPtr` objects created together (e.g. a deserialized graph):
+// one allocation per slab instead of one per object. The price is that a slab stays allocated
+// while any object from it (or a `WeakPtr` to one) is alive. Not thread-safe, but the objects
+// may be released from any thread.
+class SlabAllocator {
+public:
+    explicit SlabAllocator(size_t slab_size = kDefaultSlabSize) : slab_size_(slab_size) {
+    }
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    ~SlabAllocator() {
+        if (slab_ != nullptr) {
+            slab_->Release();
+        }
+    }
+
+    template <typename T, typename... Args>
+    SharedPtr<T> MakeShared(Args&&... args) {
+        using Block = ControlBlockSlab<T>;
+        static_assert(alignof(Block) <= alignof(std::max_align_t));
+
+        Slab* slab = SlabFor(sizeof(Block), alignof(Block));
+        size_t offset = slab == slab_ ? Align(used_, alignof(Block)) : 0;
+        Block* block;
+        try {
+            block = ::new (slab->Data() + offset) Block(slab, std::forward<Args>(args)...);
+        } catch (...) {
+            if (slab != slab_) {
+                slab->Release();
+            }
+            throw;
+        }
+        slab->refs.fetch_add(1, std::memory_order_relaxed);
+        if (slab == slab_) {
+            used_ = offset + sizeof(Block);
+        } else {
+            // Dedicated slab of a large object: only the block holds it
+            slab->Release();
+        }
+        return SharedPtr<T>(block, block->Get());
+    }
+
+private:
+    static constexpr size_t kDefaultSlabSize = 64 << 10;
+
+    static size_t Align(size_t offset, size_t align) {
+        return (offset + align - 1) / align * align;
+    }
+
+    Slab* SlabFor(size_t size, size_t align) {
+        if (size > slab_size_ / 4) {
+            return Slab::Create(size);
+        }
+        if (slab_ == nullptr || Align(used_, align) + size > slab_->capacity) {
+            if (slab_ != nullptr) {
+                slab_->Release();
+            }
+            slab_ = Slab::Create(slab_size_);
+            used_ = 0;
+        }
+        return slab_;
+    }
+
+    size_t slab_size_;
+    Slab* slab_ = nullptr;
+    size_t used_ = 0;
+};
@@ -0,0 +1,290 @@
+#include "archive.h"
+
+#include <catch.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Node {
+    template <typename Archive>
+    void Serialize(Archive& ar) {
+        ar(id, name, weights, children, parent);
+    }
+
+    int id = 0;
+    std::string name;
+    std::vector<double> weights;
+    std::vector<SharedPtr<Node>> children;
+    WeakPtr<Node> parent;
+};
+
+enum class Color : uint8_t { kRed, kGreen };
+
+struct Pixel {
+    template <typename Archive>
+    void Serialize(Archive& ar) {
+        ar(color, x, y);
+    }
+
+    Color color = Color::kRed;
+    int64_t x = 0;
+    uint16_t y = 0;
+};
+
+struct Faulty {
+    template <typename Archive>
+    void Serialize(Archive& ar) {
+        if (fail) {
+            throw std::runtime_error("Faulty");
+        }
+        ar(fail);
+    }
+
+    bool fail = false;
+};
+
+SharedPtr<Node> MakeNode(int id, std::string name) {
+    auto node = MakeShared<Node>();
+    node->id = id;
+    node->name = std::move(name);
+    return node;
+}
+
+template <typename T>
+std::string Save(const T& value) {
+    std::ostringstream out;
+    OutputArchive ar(out);
+    ar(value);
+    return out.str();
+}
+
+TEST_CASE("Values round trip") {
+    Pixel pixel{Color::kGreen, -5, 7};
+    std::vector<std::string> strings{"", "a", std::string(1000, 'x')};
+    std::ostringstream out;
+    {
+        OutputArchive ar(out);
+        ar(pixel, strings, 3.5f);
+    }
+
+    std::istringstream in(out.str());
+    InputArchive ar(in);
+    Pixel pixel2;
+    std::vector<std::string> strings2;
+    float f = 0;
+    ar(pixel2, strings2, f);
+    REQUIRE(pixel2.color == Color::kGreen);
+    REQUIRE(pixel2.x == -5);
+    REQUIRE(pixel2.y == 7);
+    REQUIRE(strings2 == strings);
+    REQUIRE(f == 3.5f);
+}
+
+TEST_CASE("Shared objects are written once") {
+    auto shared = MakeNode(1, std::string(1000, 's'));
+    auto root = MakeNode(0, "root");
+    for (int i = 0; i < 10; ++i) {
+        root->children.push_back(shared);
+    }
+    root->children.push_back(nullptr);
+
+    std::ostringstream out;
+    OutputArchive writer(out);
+    writer(root);
+    REQUIRE(writer.NumObjects() == 2);
+    REQUIRE(out.str().size() < 1200);
+
+    for (auto allocation : {InputArchive::Allocation::kMakeShared,
+                            InputArchive::Allocation::kSlab}) {
+        std::istringstream in(out.str());
+        SharedPtr<Node> loaded;
+        {
+            InputArchive reader(in, allocation);
+            reader(loaded);
+            REQUIRE(reader.NumObjects() == 2);
+        }
+        REQUIRE(loaded->name == "root");
+        REQUIRE(loaded->children.size() == 11);
+        REQUIRE(!loaded->children.back());
+        auto child = loaded->children[0];
+        REQUIRE(child->name == shared->name);
+        for (int i = 0; i < 10; ++i) {
+            REQUIRE(loaded->children[i].Get() == child.Get());
+        }
+        REQUIRE(child.UseCount() == 11);
+        REQUIRE(loaded.UseCount() == 1);
+    }
+}
+
+TEST_CASE("Weak edges stay weak") {
+    auto root = MakeNode(0, "root");
+    auto child = MakeNode(1, "child");
+    child->parent = root;
+    root->children.push_back(child);
+
+    SECTION("Back edge to an owned object") {
+        SharedPtr<Node> loaded;
+        {
+            std::istringstream in(Save(root));
+            InputArchive reader(in);
+            reader(loaded);
+        }
+        REQUIRE(loaded.UseCount() == 1);
+        REQUIRE(loaded->children[0]->parent.Lock().Get() == loaded.Get());
+        WeakPtr<Node> weak = loaded;
+        loaded = SharedPtr<Node>();
+        REQUIRE(weak.Expired());
+    }
+
+    SECTION("Weakly referenced only") {
+        // Written through the weak edge, owned by nobody after loading
+        SharedPtr<Node> loaded;
+        std::istringstream in(Save(child));
+        {
+            InputArchive reader(in);
+            reader(loaded);
+            REQUIRE(loaded->parent.Lock()->name == "root");
+        }
+        REQUIRE(loaded->parent.Expired());
+    }
+
+    SECTION("Expired") {
+        WeakPtr<Node> weak = MakeNode(2, "gone");
+        std::istringstream in(Save(weak));
+        InputArchive reader(in);
+        WeakPtr<Node> loaded = MakeNode(3, "overwritten");
+        reader(loaded);
+        REQUIRE(loaded.Expired());
+    }
+}
+
+TEST_CASE("Objects are shared across calls") {
+    auto a = MakeNode(0, "a");
+    auto b = MakeNode(1, "b");
+    b->children.push_back(a);
+    std::ostringstream out;
+    {
+        OutputArchive ar(out);
+        ar(a);
+        ar(b, a);
+    }
+
+    std::istringstream in(out.str());
+    InputArchive ar(in);
+    SharedPtr<Node> a2, b2, a3;
+    ar(a2);
+    ar(b2, a3);
+    REQUIRE(a2.Get() == a3.Get());
+    REQUIRE(b2->children[0].Get() == a2.Get());
+}
+
+TEST_CASE("Freed objects are not confused with new ones") {
+    std::ostringstream out;
+    {
+        OutputArchive ar(out);
+        for (int i = 0; i < 100; ++i) {
+            // Each node dies before the next one is allocated, likely at the same address
+            ar(MakeNode(i, "node"));
+        }
+        REQUIRE(ar.NumObjects() == 100);
+    }
+
+    std::istringstream in(out.str());
+    InputArchive ar(in);
+    for (int i = 0; i < 100; ++i) {
+        SharedPtr<Node> node;
+        ar(node);
+        REQUIRE(node->id == i);
+    }
+}
+
+TEST_CASE("Archive is usable after an exception") {
+    std::ostringstream out;
+    auto node = MakeNode(0, "node");
+    {
+        OutputArchive ar(out);
+        REQUIRE_THROWS_AS(ar(Faulty{true}, node), std::runtime_error);
+        REQUIRE_THROWS_AS(ar(node, Faulty{true}), std::runtime_error);
+        // The unwritten object is released
+        REQUIRE(node.UseCount() == 1);
+    }
+
+    out.str("");
+    {
+        OutputArchive ar(out);
+        REQUIRE_THROWS_AS(ar(Faulty{true}), std::runtime_error);
+        ar(Faulty{}, MakeNode(1, "kept"));
+    }
+    std::istringstream in(out.str());
+    InputArchive ar(in);
+    Faulty faulty;
+    SharedPtr<Node> kept;
+    ar(faulty, kept);
+    REQUIRE(kept->id == 1);
+}
+
+TEST_CASE("Aliasing pointers are rejected") {
+    auto node = MakeNode(0, "node");
+    SharedPtr<int> id(node, &node->id);
+    SharedPtr<std::string> name(node, &node->name);
+    std::ostringstream out;
+    OutputArchive ar(out);
+    ar(id);
+    REQUIRE_THROWS_AS(ar(name), std::runtime_error);
+    // The same pointer is still a reference to the written object
+    ar(id);
+    REQUIRE(ar.NumObjects() == 1);
+}
+
+TEST_CASE("Corrupted archives") {
+    auto root = MakeNode(0, "root");
+    root->children.push_back(MakeNode(1, "child"));
+    auto bytes = Save(root);
+
+    SharedPtr<Node> loaded;
+    {
+        std::istringstream in("junk");
+        REQUIRE_THROWS_AS(InputArchive(in), std::runtime_error);
+    }
+    for (size_t size = 4; size < bytes.size(); ++size) {
+        std::istringstream in(bytes.substr(0, size));
+        REQUIRE_THROWS_AS(InputArchive(in)(loaded), std::runtime_error);
+    }
+    {
+        std::istringstream in(bytes);
+        SharedPtr<Pixel> pixel;
+        InputArchive ar(in);
+        ar(loaded);
+        REQUIRE_THROWS_AS(ar(pixel), std::runtime_error);
+    }
+    {
+        // Length of 2^42 with nothing after it
+        auto huge = Save(std::string()).substr(0, 5) + "\x80\x80\x80\x80\x80\x80\x01";
+        std::string string;
+        std::vector<double> doubles;
+        std::vector<Pixel> pixels;
+        std::istringstream in1(huge), in2(huge), in3(huge);
+        REQUIRE_THROWS_AS(InputArchive(in1)(string), std::runtime_error);
+        REQUIRE_THROWS_AS(InputArchive(in2)(doubles), std::runtime_error);
+        REQUIRE_THROWS_AS(InputArchive(in3)(pixels), std::runtime_error);
+    }
+}
+
+TEST_CASE("SlabAllocator") {
+    SlabAllocator slab(256);
+    std::vector<SharedPtr<int>> small;
+    for (int i = 0; i < 100; ++i) {
+        small.push_back(slab.MakeShared<int>(i));
+    }
+    auto big = slab.MakeShared<std::vector<int>>(1000, 7);
+    WeakPtr<int> weak = small[0];
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(*small[i] == i);
+    }
+    REQUIRE(big->size() == 1000);
+    small.clear();
+    REQUIRE(weak.Expired());
+}
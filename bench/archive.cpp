@@ -0,0 +1,114 @@
+// Archive size and save/load throughput for a layered DAG with heavy sharing: every node points
+// to a few random nodes of the next layer and weakly to one of the previous layer. The size of a
+// naive serialization (every shared subtree written out again) is computed, not written.
+
+#include "bench.h"
+
+#include <archive/archive.h>
+
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr size_t kLayers = 12;
+constexpr size_t kWidth = 10000;
+constexpr size_t kChildren = 4;
+
+struct Node {
+    template <typename Archive>
+    void Serialize(Archive& ar) {
+        ar(id, name, weights, children, parent);
+    }
+
+    uint64_t id = 0;
+    std::string name;
+    std::vector<float> weights;
+    std::vector<SharedPtr<Node>> children;
+    WeakPtr<Node> parent;
+};
+
+size_t Next(size_t& seed) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    return seed >> 33;
+}
+
+// Returns the roots (the first layer); `all` keeps every node.
+std::vector<SharedPtr<Node>> MakeDag(std::vector<SharedPtr<Node>>& all) {
+    size_t seed = 1;
+    std::vector<std::vector<SharedPtr<Node>>> layers(kLayers);
+    for (size_t layer = kLayers; layer-- > 0;) {
+        for (size_t i = 0; i < kWidth; ++i) {
+            auto node = MakeShared<Node>();
+            node->id = layer * kWidth + i;
+            node->name = "node-" + std::to_string(node->id);
+            node->weights.assign(4, 0.5f);
+            if (layer + 1 < kLayers) {
+                for (size_t c = 0; c < kChildren; ++c) {
+                    auto& child = layers[layer + 1][Next(seed) % kWidth];
+                    node->children.push_back(child);
+                    child->parent = node;
+                }
+            }
+            layers[layer].push_back(node);
+            all.push_back(node);
+        }
+    }
+    return layers[0];
+}
+
+// Bytes of a serialization that repeats shared subtrees, by dynamic programming over the DAG.
+double NaiveSize(const std::vector<SharedPtr<Node>>& roots,
+                 const std::vector<SharedPtr<Node>>& all) {
+    std::unordered_map<const Node*, double> size;
+    // `all` goes from the last layer to the first, so children come first
+    for (auto& node : all) {
+        double own = 8 + 1 + node->name.size() + 1 + node->weights.size() * 4 + 1 + 1;
+        for (auto& child : node->children) {
+            own += size[child.Get()];
+        }
+        size[node.Get()] = own;
+    }
+    double res = 0;
+    for (auto& root : roots) {
+        res += size[root.Get()];
+    }
+    return res;
+}
+
+}  // namespace
+
+int main() {
+    std::vector<SharedPtr<Node>> all;
+    auto roots = MakeDag(all);
+    size_t nodes = all.size();
+
+    std::string bytes;
+    auto save = RunBench("OutputArchive save", nodes, [&] {
+        std::ostringstream out;
+        OutputArchive ar(out);
+        ar(roots);
+        bytes = out.str();
+    });
+    std::printf("%-56s %12.2f MB/s\n", "", bytes.size() / (save.ns_per_op * nodes) * 1e3);
+    std::printf("%-56s %12zu nodes\n", "graph", nodes);
+    std::printf("%-56s %12.2f MB\n", "archive size", bytes.size() / 1e6);
+    std::printf("%-56s %12.3g MB\n", "naive size (computed)", NaiveSize(roots, all) / 1e6);
+
+    for (auto [name, allocation] :
+         {std::pair{"InputArchive load + free, MakeShared", InputArchive::Allocation::kMakeShared},
+          std::pair{"InputArchive load + free, slabs", InputArchive::Allocation::kSlab}}) {
+        auto res = RunBench(name, nodes, [&] {
+            std::istringstream in(bytes);
+            std::vector<SharedPtr<Node>> loaded;
+            InputArchive ar(in, allocation);
+            ar(loaded);
+            DoNotOptimize(loaded);
+        });
+        std::printf("%-56s %12.2f MB/s\n", "", bytes.size() / (res.ns_per_op * nodes) * 1e3);
+    }
+    return 0;
+}
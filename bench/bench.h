@@ -0,0 +1,239 @@
+#pragma once
+
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Keeps the compiler from optimizing `value` (and everything it depends on) away.
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void ClobberMemory() {
+    asm volatile("" : : : "memory");
+}
+
+struct BenchResult {
+    std::string name;
+    size_t ops = 0;
+    double ns_per_op = 0;
+};
+
+// Runs `setup` and then `body` `repetitions` times after a warm-up run and returns the best time
+// of `body` in nanoseconds; `setup` isn't timed.
+template <typename S, typename F>
+double BestTime(S&& setup, F&& body, int repetitions = 5) {
+    using Clock = std::chrono::steady_clock;
+
+    setup();
+    body();
+    double best = 0;
+    for (int i = 0; i < repetitions; ++i) {
+        setup();
+        auto start = Clock::now();
+        body();
+        ClobberMemory();
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        best = i == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+// Runs `body` (which performs `ops` operations) `repetitions` times after a warm-up run
+// and reports the best time per operation.
+template <typename F>
+BenchResult RunBench(const std::string& name, size_t ops, F&& body, int repetitions = 5) {
+    BenchResult res{name, ops, BestTime([] {}, body, repetitions) / ops};
+    std::printf("%-56s %12.2f ns/op\n", res.name.c_str(), res.ns_per_op);
+    return res;
+}
+
+// Runs `body(thread_index)` (which performs `ops_per_thread` operations) on `threads` threads
+// started together and reports the wall time per operation over all threads.
+template <typename F>
+BenchResult RunThreadedBench(const std::string& name, int threads, size_t ops_per_thread,
+                             F&& body) {
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<int> ready = 0;
+    std::atomic<bool> go = false;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i] {
+            ready.fetch_add(1);
+            while (!go.load()) {
+            }
+            body(i);
+        });
+    }
+    while (ready.load() != threads) {
+    }
+    auto start = Clock::now();
+    go.store(true);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    BenchResult res{name + " [" + std::to_string(threads) + " threads]",
+                    ops_per_thread * threads, ns / (ops_per_thread * threads)};
+    std::printf("%-56s %12.2f ns/op %10.2f Mops/s\n", res.name.c_str(), res.ns_per_op,
+                1e3 / res.ns_per_op);
+    return res;
+}
+
+// 1, 2, 4, ... up to and including the number of hardware threads.
+inline std::vector<int> ThreadCounts() {
+    int max = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> res;
+    for (int threads = 1; threads < max; threads *= 2) {
+        res.push_back(threads);
+    }
+    res.push_back(max);
+    return res;
+}
+
+// Compares implementations of the same operations. `Run` times one implementation of one
+// operation and, when hardware counters are available, counts its events per operation in one
+// more run; `Report` prints every operation relative to the implementation that ran it first
+// (the baseline) and, given `--json=<path>` on the command line, writes the results there.
+class BenchSuite {
+public:
+    BenchSuite(std::string name, int argc, char** argv) : name_(std::move(name)) {
+        // libstdc++ skips atomic operations on the counters of `std::shared_ptr` until the process
+        // starts its first thread, which a real program does early
+        std::thread([] {}).join();
+        const std::string flag = "--json=";
+        for (int i = 1; i < argc; ++i) {
+            if (std::string(argv[i]).starts_with(flag)) {
+                json_path_ = argv[i] + flag.size();
+            }
+        }
+    }
+
+    template <typename F>
+    void Run(const std::string& operation, const std::string& implementation, size_t ops,
+             F&& body) {
+        Run(operation, implementation, ops, [] {}, body);
+    }
+
+    // `setup` runs before every run of `body` and isn't timed.
+    template <typename S, typename F>
+    void Run(const std::string& operation, const std::string& implementation, size_t ops,
+             S&& setup, F&& body) {
+        Entry entry{operation, implementation, {operation + ": " + implementation, ops}};
+        entry.result.ns_per_op = BestTime(setup, body) / ops;
+        if (counters_.Available()) {
+            setup();
+            counters_.Start();
+            body();
+            ClobberMemory();
+            entry.per_op = counters_.Stop();
+            for (double& count : entry.per_op) {
+                count /= ops;
+            }
+        }
+        std::printf("%-56s %12.2f ns/op\n", entry.result.name.c_str(), entry.result.ns_per_op);
+        entries_.push_back(std::move(entry));
+    }
+
+    void Report() const {
+        std::printf("\n%-28s %-28s %10s %10s", name_.c_str(), "", "ns/op", "vs base");
+        if (counters_.Available()) {
+            std::printf(" %10s %10s %10s %10s %10s\n", "cycles", "instrs", "L1d miss",
+                        "LLC miss", "br miss");
+        } else {
+            std::printf("  (no hardware counters, %s)\n", counters_.Error().c_str());
+        }
+        std::vector<std::string> operations;
+        for (auto& entry : entries_) {
+            if (std::find(operations.begin(), operations.end(), entry.operation) ==
+                operations.end()) {
+                operations.push_back(entry.operation);
+            }
+        }
+        for (auto& operation : operations) {
+            bool first = true;
+            for (auto& entry : entries_) {
+                if (entry.operation != operation) {
+                    continue;
+                }
+                std::printf("%-28s %-28s %10.2f %9.2fx", first ? operation.c_str() : "",
+                            entry.implementation.c_str(), entry.result.ns_per_op,
+                            Relative(entry));
+                if (counters_.Available()) {
+                    for (double count : entry.per_op) {
+                        if (std::isnan(count)) {
+                            std::printf(" %10s", "-");
+                        } else {
+                            std::printf(" %10.2f", count);
+                        }
+                    }
+                }
+                std::printf("\n");
+                first = false;
+            }
+        }
+        if (!json_path_.empty()) {
+            WriteJson(json_path_);
+        }
+    }
+
+    void WriteJson(const std::string& path) const {
+        std::ofstream out(path);
+        out << "{\"suite\": \"" << name_ << "\", \"results\": [";
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            const Entry& entry = entries_[i];
+            char numbers[128];
+            std::snprintf(numbers, sizeof(numbers),
+                          "\"ops\": %zu, \"ns_per_op\": %.3f, \"relative\": %.4f",
+                          entry.result.ops, entry.result.ns_per_op, Relative(entry));
+            out << (i == 0 ? "\n" : ",\n") << "  {\"operation\": \"" << entry.operation
+                << "\", \"implementation\": \"" << entry.implementation << "\", " << numbers;
+            // Per operation; null without the counter
+            for (int event = 0; event < PerfCounters::kNumEvents; ++event) {
+                double count = entry.per_op[event];
+                std::snprintf(numbers, sizeof(numbers), std::isnan(count) ? "null" : "%.3f",
+                              count);
+                out << ", \"" << PerfCounters::Name(PerfCounters::Event(event)) << "\": "
+                    << numbers;
+            }
+            out << "}";
+        }
+        out << "\n]}\n";
+        std::printf("results written to %s\n", path.c_str());
+    }
+
+private:
+    struct Entry {
+        std::string operation;
+        std::string implementation;
+        BenchResult result;
+        PerfCounters::Counts per_op = PerfCounters::None();
+    };
+
+    // Time per operation relative to the baseline of the operation
+    double Relative(const Entry& entry) const {
+        for (auto& base : entries_) {
+            if (base.operation == entry.operation) {
+                return entry.result.ns_per_op / base.result.ns_per_op;
+            }
+        }
+        return 1;
+    }
+
+    std::string name_;
+    std::string json_path_;
+    PerfCounters counters_;
+    std::vector<Entry> entries_;
+};
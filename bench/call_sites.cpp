@@ -0,0 +1,59 @@
+// Cost of counting SharedPtr copies by call site. Built twice: bench_call_sites has the counting
+// compiled in, bench_call_sites_off is the same code without it.
+
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+
+namespace {
+
+constexpr size_t kOps = 10'000'000;
+
+struct Base {
+    int value = 0;
+};
+
+struct Derived : Base {
+    int other = 0;
+};
+
+#ifdef SHARED_PTR_CALL_SITES
+const char* const kSuffix = " [call sites]";
+#else
+const char* const kSuffix = " [compiled out]";
+#endif
+
+}  // namespace
+
+int main() {
+    auto ptr = MakeShared<Derived>();
+    WeakPtr<Derived> weak = ptr;
+    const std::string suffix = kSuffix;
+
+    RunBench("copy + drop" + suffix, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            SharedPtr<Derived> copy = ptr;
+            DoNotOptimize(copy);
+        }
+    });
+    RunBench("converting copy + drop" + suffix, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            SharedPtr<Base> copy = ptr;
+            DoNotOptimize(copy);
+        }
+    });
+    RunBench("aliasing copy + drop" + suffix, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            SharedPtr<int> copy(ptr, &ptr->other);
+            DoNotOptimize(copy);
+        }
+    });
+    RunBench("Lock + drop" + suffix, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto copy = weak.Lock();
+            DoNotOptimize(copy);
+        }
+    });
+    return 0;
+}
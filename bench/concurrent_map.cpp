@@ -0,0 +1,111 @@
+// ConcurrentHashMap vs std::unordered_map<K, std::shared_ptr<V>> behind a std::shared_mutex,
+// for a read-heavy (95% lookups) and a 50/50 mix at 1, 8 and all hardware threads.
+
+#include "bench.h"
+
+#include <concurrent-map/concurrent_map.h>
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t kKeys = 1 << 16;
+constexpr size_t kOps = 200000;
+
+struct Value {
+    size_t payload = 0;
+};
+
+class LockedMap {
+public:
+    std::shared_ptr<Value> Find(size_t key) const {
+        std::shared_lock lock(mutex_);
+        auto it = map_.find(key);
+        return it == map_.end() ? nullptr : it->second;
+    }
+
+    void InsertOrAssign(size_t key, std::shared_ptr<Value> value) {
+        std::unique_lock lock(mutex_);
+        map_.insert_or_assign(key, std::move(value));
+    }
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<size_t, std::shared_ptr<Value>> map_;
+};
+
+size_t Next(size_t& seed) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    return seed >> 33;
+}
+
+}  // namespace
+
+int main() {
+    ConcurrentHashMap<size_t, Value> map;
+    LockedMap locked;
+    for (size_t i = 0; i < kKeys; ++i) {
+        map.Insert(i, MakeShared<Value>(Value{i}));
+        locked.InsertOrAssign(i, std::make_shared<Value>(Value{i}));
+    }
+
+    int all = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads : {1, 8, all}) {
+        for (size_t writes_percent : {5, 50}) {
+            char suffix[64];
+            std::snprintf(suffix, sizeof(suffix), " (%zu%% writes)", writes_percent);
+
+            RunThreadedBench(std::string("unordered_map + shared_mutex") + suffix, threads, kOps,
+                             [&](int thread) {
+                                 size_t seed = thread + 1;
+                                 size_t sum = 0;
+                                 for (size_t i = 0; i < kOps; ++i) {
+                                     size_t key = Next(seed) % kKeys;
+                                     if (Next(seed) % 100 < writes_percent) {
+                                         locked.InsertOrAssign(key,
+                                                               std::make_shared<Value>(Value{i}));
+                                     } else if (auto value = locked.Find(key)) {
+                                         sum += value->payload;
+                                     }
+                                 }
+                                 DoNotOptimize(sum);
+                             });
+            RunThreadedBench(std::string("ConcurrentHashMap::Find") + suffix, threads, kOps,
+                             [&](int thread) {
+                                 size_t seed = thread + 1;
+                                 size_t sum = 0;
+                                 for (size_t i = 0; i < kOps; ++i) {
+                                     size_t key = Next(seed) % kKeys;
+                                     if (Next(seed) % 100 < writes_percent) {
+                                         map.InsertOrAssign(key, MakeShared<Value>(Value{i}));
+                                     } else if (auto value = map.Find(key)) {
+                                         sum += value->payload;
+                                     }
+                                 }
+                                 DoNotOptimize(sum);
+                             });
+            RunThreadedBench(std::string("ConcurrentHashMap::Borrow") + suffix, threads, kOps,
+                             [&](int thread) {
+                                 size_t seed = thread + 1;
+                                 size_t sum = 0;
+                                 for (size_t i = 0; i < kOps; ++i) {
+                                     size_t key = Next(seed) % kKeys;
+                                     if (Next(seed) % 100 < writes_percent) {
+                                         map.InsertOrAssign(key, MakeShared<Value>(Value{i}));
+                                         continue;
+                                     }
+                                     EpochDomain::Guard guard;
+                                     if (auto value = map.Borrow(guard, key)) {
+                                         sum += value->payload;
+                                     }
+                                 }
+                                 DoNotOptimize(sum);
+                             });
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+// Cost of the contention profiler hooks on SharedPtr copies. Built twice: bench_contention_profiler
+// has the profiler compiled in and tries several sampling rates, bench_contention_profiler_off is
+// the same code without it.
+
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+
+#include <string>
+
+namespace {
+
+constexpr size_t kOps = 10'000'000;
+constexpr size_t kThreadedOps = 2'000'000;
+
+struct Payload {
+    int value = 0;
+};
+
+void Run(const std::string& suffix) {
+    auto ptr = MakeShared<Payload>();
+    RunBench("copy + drop" + suffix, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            SharedPtr<Payload> copy = ptr;
+            DoNotOptimize(copy);
+        }
+    });
+    for (int threads : ThreadCounts()) {
+        RunThreadedBench("copy + drop, shared object" + suffix, threads, kThreadedOps, [&](int) {
+            for (size_t i = 0; i < kThreadedOps; ++i) {
+                SharedPtr<Payload> copy = ptr;
+                DoNotOptimize(copy);
+            }
+        });
+    }
+}
+
+}  // namespace
+
+int main() {
+#ifdef SHARED_PTR_CONTENTION_PROFILER
+    for (uint64_t rate : {0, 1024, 64, 1}) {
+        ContentionProfiler::Global().SetSampleRate(rate);
+        Run(rate == 0 ? " [compiled in, off]" : " [1/" + std::to_string(rate) + "]");
+    }
+#else
+    Run(" [compiled out]");
+#endif
+    return 0;
+}
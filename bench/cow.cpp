@@ -0,0 +1,74 @@
+// Copy/read/mutate mixes over a large document: CowPtr vs plain deep copies.
+
+#include "bench.h"
+
+#include <cow/cow.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Document = std::vector<std::string>;
+
+Document MakeDocument() {
+    Document res;
+    for (int i = 0; i < 10000; ++i) {
+        res.push_back("line " + std::to_string(i) + " of a reasonably long document");
+    }
+    return res;
+}
+
+// Every operation hands a copy of the current value to one of the (long-living) readers,
+// which reads one line. Every `mutate_every`-th operation modifies the value.
+template <typename Value, typename Read, typename Mutate>
+void RunMix(const std::string& name, Value value, int mutate_every, Read read, Mutate mutate) {
+    constexpr size_t kOps = 500;
+    constexpr size_t kReaders = 16;
+    std::vector<Value> readers(kReaders, value);
+    RunBench(name, kOps, [&] {
+        size_t sum = 0;
+        for (size_t i = 0; i < kOps; ++i) {
+            auto& reader = readers[i % kReaders];
+            reader = value;
+            sum += read(reader, i).size();
+            if (mutate_every != 0 && i % mutate_every == 0) {
+                mutate(value, i);
+            }
+        }
+        DoNotOptimize(sum);
+    });
+}
+
+}  // namespace
+
+int main() {
+    auto document = MakeDocument();
+    auto read_deep = [](const Document& doc, size_t i) -> const std::string& {
+        return doc[i % doc.size()];
+    };
+    auto mutate_deep = [](Document& doc, size_t i) { doc[i % doc.size()] += '!'; };
+    auto read_cow = [](const CowPtr<Document>& doc, size_t i) -> const std::string& {
+        return doc.Read()[i % doc->size()];
+    };
+    auto mutate_cow = [](CowPtr<Document>& doc, size_t i) {
+        doc.Mutate()[i % doc->size()] += '!';
+    };
+
+    for (int mutate_every : {0, 100, 10, 1}) {
+        std::string mix = mutate_every == 0 ? "read only" : "1/" + std::to_string(mutate_every) +
+                                                                 " mutate";
+        RunMix("deep copy, " + mix, document, mutate_every, read_deep, mutate_deep);
+        RunMix("CowPtr, " + mix, CowPtr<Document>(document), mutate_every, read_cow, mutate_cow);
+    }
+
+    // Mutations with no other owners never clone
+    CowPtr<Document> unique(document);
+    RunBench("CowPtr, unique owner mutate", 100000, [&] {
+        for (size_t i = 0; i < 100000; ++i) {
+            unique.Mutate()[i % 100].back() = 'x';
+        }
+    });
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Cost of opting in to the cycle collector and its pause times: full and stepped collections of
+// many small garbage cycles mixed with live buffered nodes, and a buffered root in front of a
+// large live graph.
+
+#include "bench.h"
+
+#include <cycles/cycle_collector.h>
+
+#include <chrono>
+#include <vector>
+
+namespace {
+
+struct Node {
+    void Trace(CycleVisitor& visit) {
+        visit(next);
+    }
+
+    SharedPtr<Node> next;
+};
+
+constexpr size_t kOps = 1000000;
+constexpr size_t kRings = 20000;
+constexpr size_t kRingSize = 10;
+constexpr size_t kLive = 200000;
+
+void MakeGarbage(std::vector<SharedPtr<Node>>& live) {
+    for (size_t i = 0; i < kRings; ++i) {
+        auto first = MakeCollectable<Node>();
+        auto last = first;
+        for (size_t j = 1; j < kRingSize; ++j) {
+            last->next = MakeCollectable<Node>();
+            last = last->next;
+        }
+        last->next = first;
+    }
+    // Copied and dropped, so they are buffered too
+    live.clear();
+    for (size_t i = 0; i < kLive; ++i) {
+        live.push_back(MakeCollectable<Node>());
+        auto copy = live.back();
+    }
+}
+
+double Ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+}  // namespace
+
+int main() {
+    using Clock = std::chrono::steady_clock;
+    auto& collector = CycleCollector::Global();
+
+    auto plain = MakeShared<Node>();
+    auto collectable = MakeCollectable<Node>();
+    RunBench("copy + release, MakeShared", kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto copy = plain;
+            DoNotOptimize(copy);
+        }
+    });
+    RunBench("copy + release, MakeCollectable", kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto copy = collectable;
+            DoNotOptimize(copy);
+        }
+    });
+    RunBench("MakeShared + release", kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            DoNotOptimize(MakeShared<Node>());
+        }
+    });
+    RunBench("MakeCollectable + release", kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            DoNotOptimize(MakeCollectable<Node>());
+        }
+    });
+    collector.Collect();
+
+    std::vector<SharedPtr<Node>> live;
+    MakeGarbage(live);
+    size_t buffered = collector.NumBuffered();
+    auto start = Clock::now();
+    auto stats = collector.Collect();
+    std::printf("%-56s %12.2f ms (%zu roots, %zu traced, %zu freed)\n", "full collection",
+                Ms(start), buffered, stats.traced, stats.freed);
+
+    for (size_t budget : {100000, 10000, 1000}) {
+        MakeGarbage(live);
+        double worst = 0, total = 0;
+        size_t increments = 0;
+        CollectStats stats;
+        do {
+            auto start = Clock::now();
+            stats = collector.CollectStep(budget);
+            double ms = Ms(start);
+            worst = std::max(worst, ms);
+            total += ms;
+            ++increments;
+        } while (!stats.done);
+        std::printf("%-56s %12.3f ms worst, %.3f ms mean, %zu increments\n",
+                    ("steps of " + std::to_string(budget) + " units").c_str(), worst,
+                    total / increments, increments);
+    }
+
+    // A single buffered root whose live subgraph is a long list
+    live.clear();
+    auto head = MakeCollectable<Node>();
+    auto tail = head;
+    for (size_t i = 0; i < 1000000; ++i) {
+        tail->next = MakeCollectable<Node>();
+        tail = tail->next;
+    }
+    tail = nullptr;
+    collector.Collect();
+    {
+        auto copy = head;
+    }
+    start = Clock::now();
+    stats = collector.Collect();
+    std::printf("%-56s %12.2f ms (%zu traced)\n", "one root in front of a live 1M list", Ms(start),
+                stats.traced);
+    {
+        auto copy = head;
+    }
+    double worst = 0;
+    size_t increments = 0;
+    do {
+        auto start = Clock::now();
+        stats = collector.CollectStep(1000);
+        worst = std::max(worst, Ms(start));
+        ++increments;
+    } while (!stats.done);
+    std::printf("%-56s %12.3f ms worst, %zu increments\n", "same, steps of 1000 units", worst,
+                increments);
+
+    // Destroyed iteratively to keep the stack shallow
+    while (head) {
+        head = SharedPtr<Node>(head->next);
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Latency of dropping the last reference, inline vs deferred to the background reclaimer.
+// Most releases free a small object; every 1000th frees a tree of 10000 nodes. Reported are
+// percentiles of single releases on the releasing thread.
+
+#include "bench.h"
+
+#include <deferred/deferred.h>
+#include <intrusive/intrusive.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+constexpr size_t kReleases = 100000;
+constexpr size_t kTreeEvery = 1000;
+constexpr size_t kTreeSize = 10000;
+
+struct Node {
+    std::vector<SharedPtr<Node>> children;
+};
+
+template <typename Deleter>
+struct IntrusiveNode : SimpleRefCounted<IntrusiveNode<Deleter>, Deleter> {
+    std::vector<IntrusivePtr<IntrusiveNode<DefaultDelete>>> children;
+};
+
+// Returns the root; only the root is created with `make`, the rest are plain.
+template <typename Root, typename Make, typename MakeChild>
+Root MakeTree(size_t size, Make make, MakeChild make_child) {
+    Root root = make();
+    size_t made = 1;
+    std::vector<decltype(make_child())> level;
+    for (size_t i = 0; i < 16 && made < size; ++i, ++made) {
+        root->children.push_back(make_child());
+        level.push_back(root->children.back());
+    }
+    while (made < size) {
+        decltype(level) next;
+        for (auto& node : level) {
+            for (size_t i = 0; i < 16 && made < size; ++i, ++made) {
+                node->children.push_back(make_child());
+                next.push_back(node->children.back());
+            }
+        }
+        level = std::move(next);
+    }
+    return root;
+}
+
+template <typename Ptr>
+void Measure(const char* name, std::vector<Ptr>& ptrs) {
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<double> ns(ptrs.size());
+    for (size_t i = 0; i < ptrs.size(); ++i) {
+        auto start = Clock::now();
+        ptrs[i].Reset();
+        ns[i] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+    auto flush_start = Clock::now();
+    DeferredReclaimer::Global().Flush();
+    double flush = std::chrono::duration<double, std::milli>(Clock::now() - flush_start).count();
+
+    std::sort(ns.begin(), ns.end());
+    auto percentile = [&](double p) { return ns[std::min(ns.size() - 1, size_t(p * ns.size()))]; };
+    std::printf("%-40s p50 %8.0f  p99 %8.0f  p999 %10.0f  max %10.0f ns  (flush %.1f ms)\n", name,
+                percentile(0.5), percentile(0.99), percentile(0.999), ns.back(), flush);
+}
+
+template <typename Ptr, typename Make, typename MakeChild>
+void Run(const char* name, Make make, MakeChild make_child) {
+    std::vector<Ptr> ptrs;
+    for (size_t i = 0; i < kReleases; ++i) {
+        ptrs.push_back(MakeTree<Ptr>(i % kTreeEvery == 0 ? kTreeSize : 1, make, make_child));
+    }
+    Measure(name, ptrs);
+}
+
+}  // namespace
+
+int main() {
+    using Plain = IntrusiveNode<DefaultDelete>;
+    using Deferred = IntrusiveNode<DeferredDelete>;
+    auto child = [] { return MakeShared<Node>(); };
+    auto intrusive_child = [] { return IntrusivePtr<Plain>(new Plain()); };
+
+    Run<SharedPtr<Node>>("SharedPtr, MakeShared", child, child);
+    Run<SharedPtr<Node>>("SharedPtr, MakeSharedDeferred", [] { return MakeSharedDeferred<Node>(); },
+                         child);
+    Run<IntrusivePtr<Plain>>("IntrusivePtr, DefaultDelete", intrusive_child, intrusive_child);
+    Run<IntrusivePtr<Deferred>>("IntrusivePtr, DeferredDelete",
+                                [] { return IntrusivePtr<Deferred>(new Deferred()); },
+                                intrusive_child);
+    return 0;
+}
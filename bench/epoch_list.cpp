@@ -0,0 +1,91 @@
+// Read/write scaling of LockFreeSortedList vs a std::map of SharedPtr behind a reader-writer lock.
+
+#include "bench.h"
+
+#include <epoch/lock_free_list.h>
+
+#include <map>
+#include <random>
+#include <shared_mutex>
+
+namespace {
+
+constexpr int kKeys = 512;
+constexpr size_t kOps = 200000;
+
+struct Value {
+    Value(int value) : value(value) {
+    }
+    int value;
+};
+
+class LockedMap {
+public:
+    bool Insert(int key, int value) {
+        std::unique_lock guard(mutex_);
+        return map_.emplace(key, MakeShared<Value>(value)).second;
+    }
+    bool Remove(int key) {
+        SharedPtr<Value> removed;
+        std::unique_lock guard(mutex_);
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            return false;
+        }
+        removed = std::move(it->second);
+        map_.erase(it);
+        return true;
+    }
+    SharedPtr<Value> Find(int key) const {
+        std::shared_lock guard(mutex_);
+        auto it = map_.find(key);
+        return it == map_.end() ? SharedPtr<Value>() : it->second;
+    }
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::map<int, SharedPtr<Value>> map_;
+};
+
+template <typename Set>
+void RunMix(const std::string& name, Set& set, int write_percent) {
+    for (int threads : ThreadCounts()) {
+        RunThreadedBench(name, threads, kOps, [&](int thread) {
+            std::mt19937 gen(thread);
+            std::uniform_int_distribution<int> key_dist(0, kKeys - 1);
+            std::uniform_int_distribution<int> op_dist(0, 99);
+            size_t sum = 0;
+            for (size_t i = 0; i < kOps; ++i) {
+                int key = key_dist(gen);
+                int op = op_dist(gen);
+                if (op < write_percent / 2) {
+                    set.Insert(key, key);
+                } else if (op < write_percent) {
+                    set.Remove(key);
+                } else if (auto value = set.Find(key)) {
+                    sum += value->value;
+                }
+            }
+            DoNotOptimize(sum);
+        });
+    }
+}
+
+}  // namespace
+
+int main() {
+    LockFreeSortedList<int, Value> list;
+    LockedMap map;
+    for (int key = 0; key < kKeys; key += 2) {
+        list.Insert(key, key);
+        map.Insert(key, key);
+    }
+
+    for (int write_percent : {5, 50}) {
+        std::string mix = std::to_string(100 - write_percent) + "/" +
+                          std::to_string(write_percent) + " read/write";
+        RunMix("LockFreeSortedList, " + mix, list, write_percent);
+        RunMix("std::map + shared_mutex, " + mix, map, write_percent);
+    }
+    return 0;
+}
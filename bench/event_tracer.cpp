@@ -0,0 +1,56 @@
+// Cost of the lifecycle event hooks. Built twice: bench_event_tracer has the tracer compiled in and
+// runs with it off and on, bench_event_tracer_off is the same code without it.
+
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+#include <intrusive/intrusive.h>
+#include <unique/unique.h>
+
+#include <string>
+
+namespace {
+
+constexpr size_t kOps = 5'000'000;
+
+struct Payload {
+    int value = 0;
+};
+
+struct Intrusive : SimpleRefCounted<Intrusive> {
+    int value = 0;
+};
+
+void Run(const std::string& suffix) {
+    RunBench("MakeShared + drop" + suffix, kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto ptr = MakeShared<Payload>();
+            DoNotOptimize(ptr);
+        }
+    });
+    RunBench("MakeIntrusive + drop" + suffix, kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto ptr = MakeIntrusive<Intrusive>();
+            DoNotOptimize(ptr);
+        }
+    });
+    RunBench("new UniquePtr + drop" + suffix, kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            UniquePtr<Payload> ptr(new Payload());
+            DoNotOptimize(ptr);
+        }
+    });
+}
+
+}  // namespace
+
+int main() {
+#ifdef SMART_PTR_EVENT_TRACER
+    Run(" [compiled in, off]");
+    EventTracer::Global().Enable();
+    Run(" [on]");
+#else
+    Run(" [compiled out]");
+#endif
+    return 0;
+}
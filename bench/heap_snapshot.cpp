@@ -0,0 +1,62 @@
+// Time to take a heap snapshot (with the dominator tree) of an 8-ary tree of registered objects.
+// The number of objects is the first argument (10M by default).
+
+#define HEAP_REGISTRY 1
+
+#include "bench.h"
+
+#include <heap-snapshot/heap_snapshot.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+struct Node {
+    void Trace(HeapVisitor& visit) const {
+        visit(children);
+    }
+
+    std::vector<SharedPtr<Node>> children;
+};
+
+SharedPtr<Node> MakeTree(size_t size) {
+    auto root = MakeRegistered<Node>();
+    std::vector<Node*> level{root.Get()};
+    size_t made = 1;
+    while (made < size) {
+        std::vector<Node*> next;
+        for (Node* node : level) {
+            for (int i = 0; i < 8 && made < size; ++i, ++made) {
+                node->children.push_back(MakeRegistered<Node>());
+                next.push_back(node->children.back().Get());
+            }
+        }
+        level = std::move(next);
+    }
+    return root;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    using Clock = std::chrono::steady_clock;
+
+    size_t size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+    auto root = MakeTree(size);
+
+    for (int rep = 0; rep < 3; ++rep) {
+        auto start = Clock::now();
+        auto snapshot = HeapRegistry::Global().Snapshot();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::printf("%-56s %12.1f ms %8.2f ns/object\n",
+                    ("snapshot [" + std::to_string(snapshot.NumObjects()) + " objects]").c_str(),
+                    ms, ms * 1e6 / size);
+        if (rep == 0) {
+            snapshot.WriteText(std::cout, 5);
+        }
+    }
+    return 0;
+}
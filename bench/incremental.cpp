@@ -0,0 +1,87 @@
+// Worst-case tick of an event loop that drops large trees: inline destruction vs
+// IncrementalReclaimer with different budgets. A tree of 500k nodes is dropped every 50 ticks.
+// With glibc, a free that coalesces into a large chunk consolidates all the fast bins at once and
+// shows up as a long tick of its own; GLIBC_TUNABLES=glibc.malloc.mxfast=0 takes it out.
+
+#include "bench.h"
+
+#include <incremental/incremental.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+constexpr size_t kTrees = 10;
+constexpr size_t kTreeSize = 500'000;
+constexpr size_t kDropEvery = 50;
+
+struct Node {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(children);
+    }
+
+    std::vector<SharedPtr<Node>> children;
+};
+
+template <typename Make>
+SharedPtr<Node> MakeTree(Make make) {
+    auto root = make();
+    std::vector<Node*> level{root.Get()};
+    size_t made = 1;
+    while (made < kTreeSize) {
+        std::vector<Node*> next;
+        for (Node* node : level) {
+            for (int i = 0; i < 8 && made < kTreeSize; ++i, ++made) {
+                node->children.push_back(MakeShared<Node>());
+                next.push_back(node->children.back().Get());
+            }
+        }
+        level = std::move(next);
+    }
+    return root;
+}
+
+// `budget_us` of 0 means the trees are destroyed inline.
+template <typename Make>
+void Run(const char* name, Make make, uint64_t budget_us) {
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<SharedPtr<Node>> trees;
+    for (size_t i = 0; i < kTrees; ++i) {
+        trees.push_back(MakeTree(make));
+    }
+
+    auto& reclaimer = IncrementalReclaimer::Local();
+    std::vector<double> ticks;
+    size_t dropped = 0;
+    for (size_t tick = 0; dropped < kTrees || reclaimer.Pending() != 0; ++tick) {
+        auto start = Clock::now();
+        if (tick % kDropEvery == 0 && dropped < kTrees) {
+            trees[dropped++].Reset();
+        }
+        if (budget_us != 0) {
+            reclaimer.Reclaim(budget_us);
+        }
+        ticks.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+
+    std::sort(ticks.begin(), ticks.end());
+    auto percentile = [&](double p) {
+        return ticks[std::min(ticks.size() - 1, size_t(p * ticks.size()))];
+    };
+    std::printf("%-40s ticks %6zu  p50 %8.1f  p99 %8.1f  max %8.1f us\n", name, ticks.size(),
+                percentile(0.5), percentile(0.99), ticks.back());
+}
+
+}  // namespace
+
+int main() {
+    Run("inline", [] { return MakeShared<Node>(); }, 0);
+    for (uint64_t budget : {100, 500, 2000}) {
+        std::string name = "MakeSharedIncremental, budget " + std::to_string(budget) + " us";
+        Run(name.c_str(), [] { return MakeSharedIncremental<Node>(); }, budget);
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Handing an object to another process: a reference into a SharedSegment (8 bytes through a
+// pipe, the object stays where it is) vs serializing the object through a pipe. The child reads
+// the whole object and acknowledges; a round trip is one operation.
+
+#include "bench.h"
+
+#include <interprocess/interprocess.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kRounds = 2000;
+
+void WriteAll(int fd, const void* data, size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) {
+            _exit(1);
+        }
+        bytes += written;
+        size -= written;
+    }
+}
+
+void ReadAll(int fd, void* data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got <= 0) {
+            _exit(1);
+        }
+        bytes += got;
+        size -= got;
+    }
+}
+
+uint64_t Sum(const char* data, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i += 64) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+// Child process on the other ends of two pipes, running `serve(in, out)` until the input closes.
+class Peer {
+public:
+    template <typename F>
+    explicit Peer(F&& serve) {
+        int to_child[2], from_child[2];
+        if (pipe(to_child) != 0 || pipe(from_child) != 0) {
+            throw std::runtime_error("pipe");
+        }
+        pid_ = fork();
+        if (pid_ == 0) {
+            close(to_child[1]);
+            close(from_child[0]);
+            serve(to_child[0], from_child[1]);
+            _exit(0);
+        }
+        close(to_child[0]);
+        close(from_child[1]);
+        out_ = to_child[1];
+        in_ = from_child[0];
+    }
+    ~Peer() {
+        close(out_);
+        close(in_);
+        waitpid(pid_, nullptr, 0);
+    }
+
+    int In() const {
+        return in_;
+    }
+    int Out() const {
+        return out_;
+    }
+
+private:
+    pid_t pid_;
+    int in_;
+    int out_;
+};
+
+template <size_t kSize>
+void Compare(SharedSegment& segment) {
+    using Payload = std::array<char, kSize>;
+    std::string suffix = " (" + std::to_string(kSize) + " bytes)";
+
+    {
+        Peer peer([&](int in, int out) {
+            uint64_t offset;
+            while (read(in, &offset, sizeof(offset)) == sizeof(offset)) {
+                auto payload = InterprocessSharedPtr<Payload>::Adopt(segment, offset);
+                uint64_t sum = Sum(payload->data(), kSize);
+                WriteAll(out, &sum, sizeof(sum));
+            }
+        });
+        RunBench("InterprocessSharedPtr handoff" + suffix, kRounds, [&] {
+            for (size_t i = 0; i < kRounds; ++i) {
+                auto payload = segment.MakeShared<Payload>();
+                std::memset(payload->data(), static_cast<int>(i), kSize);
+                uint64_t offset = payload.Share();
+                WriteAll(peer.Out(), &offset, sizeof(offset));
+                uint64_t sum;
+                ReadAll(peer.In(), &sum, sizeof(sum));
+                DoNotOptimize(sum);
+            }
+        });
+    }
+
+    {
+        Peer peer([&](int in, int out) {
+            std::vector<char> buffer(kSize);
+            uint64_t size;
+            while (read(in, &size, sizeof(size)) == sizeof(size)) {
+                ReadAll(in, buffer.data(), size);
+                uint64_t sum = Sum(buffer.data(), size);
+                WriteAll(out, &sum, sizeof(sum));
+            }
+        });
+        std::vector<char> payload(kSize);
+        RunBench("serialized through a pipe" + suffix, kRounds, [&] {
+            for (size_t i = 0; i < kRounds; ++i) {
+                std::memset(payload.data(), static_cast<int>(i), kSize);
+                uint64_t size = kSize;
+                WriteAll(peer.Out(), &size, sizeof(size));
+                WriteAll(peer.Out(), payload.data(), kSize);
+                uint64_t sum;
+                ReadAll(peer.In(), &sum, sizeof(sum));
+                DoNotOptimize(sum);
+            }
+        });
+    }
+}
+
+}  // namespace
+
+int main() {
+    auto segment = SharedSegment::Create(64 << 20);
+    Compare<64>(segment);
+    Compare<4096>(segment);
+    Compare<65536>(segment);
+    Compare<1 << 20>(segment);
+    std::printf("%-56s %12zu bytes\n", "segment in use at exit", segment.BytesInUse());
+    return 0;
+}
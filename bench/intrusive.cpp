@@ -0,0 +1,92 @@
+// IntrusivePtr against boost::intrusive_ptr (when Boost is around), and against std::shared_ptr
+// and SharedPtr from their make functions, which also allocate once. Counters are plain on the
+// intrusive side and atomic on the shared side. Run with --json=<path> to save the results.
+
+#include "bench.h"
+
+#include <intrusive/intrusive.h>
+#include <shared-from-this/shared.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if __has_include(<boost/smart_ptr/intrusive_ptr.hpp>)
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <boost/smart_ptr/intrusive_ref_counter.hpp>
+#define HAVE_BOOST 1
+#endif
+
+namespace {
+
+constexpr size_t kOps = 2'000'000;
+constexpr size_t kDestroyOps = 500'000;
+
+struct Payload {
+    int64_t value = 0;
+};
+
+struct Intrusive : SimpleRefCounted<Intrusive> {
+    int64_t value = 0;
+};
+
+#ifdef HAVE_BOOST
+struct BoostIntrusive
+    : boost::intrusive_ref_counter<BoostIntrusive, boost::thread_unsafe_counter> {
+    int64_t value = 0;
+};
+#endif
+
+template <typename Ptr, typename Make>
+void RunAll(BenchSuite& suite, const std::string& name, Make make) {
+    suite.Run("make + destroy", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr ptr = make();
+            DoNotOptimize(ptr);
+        }
+    });
+
+    Ptr ptr = make();
+    suite.Run("copy + destroy", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr copy = ptr;
+            DoNotOptimize(copy);
+        }
+    });
+    suite.Run("move + move back", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr moved = std::move(ptr);
+            DoNotOptimize(moved);
+            ptr = std::move(moved);
+        }
+    });
+
+    std::vector<Ptr> pool;
+    suite.Run(
+        "destroy last", name, kDestroyOps,
+        [&] {
+            pool.clear();
+            for (size_t i = 0; i < kDestroyOps; ++i) {
+                pool.push_back(make());
+            }
+        },
+        [&] { pool.clear(); });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchSuite suite("IntrusivePtr", argc, argv);
+    RunAll<std::shared_ptr<Payload>>(suite, "std::shared_ptr",
+                                     [] { return std::make_shared<Payload>(); });
+#ifdef HAVE_BOOST
+    RunAll<boost::intrusive_ptr<BoostIntrusive>>(
+        suite, "boost::intrusive_ptr",
+        [] { return boost::intrusive_ptr<BoostIntrusive>(new BoostIntrusive()); });
+#endif
+    RunAll<SharedPtr<Payload>>(suite, "SharedPtr", [] { return MakeShared<Payload>(); });
+    RunAll<IntrusivePtr<Intrusive>>(suite, "IntrusivePtr",
+                                    [] { return MakeIntrusive<Intrusive>(); });
+    suite.Report();
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Teardown of long chains: the recursive destructors vs IterativeRelease, in ns per node.
+// The recursive ones overflow the stack somewhere past 100k nodes, so they're measured on
+// shorter chains only.
+
+#include "bench.h"
+
+#include <iterative/iterative.h>
+
+#include <chrono>
+#include <string>
+
+namespace {
+
+template <typename Deleter>
+struct UniqueNode {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(next);
+    }
+
+    UniquePtr<UniqueNode, Deleter> next;
+};
+
+struct SharedNode {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(next);
+    }
+
+    SharedPtr<SharedNode> next;
+};
+
+template <typename Deleter>
+struct IntrusiveNode : SimpleRefCounted<IntrusiveNode<Deleter>, Deleter> {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(next);
+    }
+
+    IntrusivePtr<IntrusiveNode> next;
+};
+
+// `make()` creates a node, `link(node, next)` links it. Best of 5 teardowns.
+template <typename Ptr, typename Make>
+void Measure(const std::string& name, size_t length, Make make) {
+    using Clock = std::chrono::steady_clock;
+
+    double best = 0;
+    for (int rep = 0; rep < 5; ++rep) {
+        Ptr head = make();
+        auto tail = head.Get();
+        for (size_t i = 1; i < length; ++i) {
+            tail->next = make();
+            tail = tail->next.Get();
+        }
+        auto start = Clock::now();
+        head = Ptr();
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        best = rep == 0 ? ns : std::min(best, ns);
+    }
+    std::printf("%-56s %12.2f ns/node\n", (name + " [" + std::to_string(length) + "]").c_str(),
+                best / length);
+}
+
+}  // namespace
+
+int main() {
+    using UniqueRecursive = UniquePtr<UniqueNode<Slug>>;
+    using UniqueIterative = UniquePtr<UniqueNode<IterativeDelete>, IterativeDelete>;
+    using IntrusiveRecursive = IntrusivePtr<IntrusiveNode<DefaultDelete>>;
+    using IntrusiveIterative = IntrusivePtr<IntrusiveNode<IterativeDelete>>;
+
+    for (size_t length : {1'000, 10'000, 10'000'000}) {
+        if (length < 100'000) {
+            Measure<UniqueRecursive>("UniquePtr, recursive", length,
+                                     [] { return UniqueRecursive(new UniqueNode<Slug>()); });
+        }
+        Measure<UniqueIterative>("UniquePtr, IterativeDelete", length, [] {
+            return UniqueIterative(new UniqueNode<IterativeDelete>());
+        });
+        if (length < 100'000) {
+            Measure<SharedPtr<SharedNode>>("SharedPtr, MakeShared", length,
+                                           [] { return MakeShared<SharedNode>(); });
+        }
+        Measure<SharedPtr<SharedNode>>("SharedPtr, MakeSharedIterative", length,
+                                       [] { return MakeSharedIterative<SharedNode>(); });
+        if (length < 100'000) {
+            Measure<IntrusiveRecursive>("IntrusivePtr, DefaultDelete", length, [] {
+                return IntrusiveRecursive(new IntrusiveNode<DefaultDelete>());
+            });
+        }
+        Measure<IntrusiveIterative>("IntrusivePtr, IterativeDelete", length, [] {
+            return IntrusiveIterative(new IntrusiveNode<IterativeDelete>());
+        });
+    }
+    return 0;
+}
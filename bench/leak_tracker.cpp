@@ -0,0 +1,54 @@
+// Cost of creating and dropping an object with leak tracking at different sampling rates.
+
+#include "bench.h"
+
+#include <leak-tracker/leak_tracker.h>
+
+namespace {
+
+constexpr size_t kOps = 1'000'000;
+
+struct Payload {
+    char data[32];
+};
+
+struct Plain : SimpleRefCounted<Plain> {
+    char data[32];
+};
+
+struct Tracked : TrackedRefCounted<Tracked> {
+    char data[32];
+};
+
+}  // namespace
+
+int main() {
+    auto& tracker = LeakTracker::Global();
+
+    RunBench("MakeShared", kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            DoNotOptimize(MakeShared<Payload>());
+        }
+    });
+    RunBench("MakeIntrusive, SimpleRefCounted", kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            DoNotOptimize(MakeIntrusive<Plain>());
+        }
+    });
+
+    for (uint64_t rate : {0, 10000, 100, 1}) {
+        tracker.SetSampleRate(rate);
+        std::string suffix = rate == 0 ? " [off]" : " [1/" + std::to_string(rate) + "]";
+        RunBench("MakeTracked" + suffix, kOps, [] {
+            for (size_t i = 0; i < kOps; ++i) {
+                DoNotOptimize(MakeTracked<Payload>());
+            }
+        });
+        RunBench("MakeIntrusive, TrackedRefCounted" + suffix, kOps, [] {
+            for (size_t i = 0; i < kOps; ++i) {
+                DoNotOptimize(MakeIntrusive<Tracked>());
+            }
+        });
+    }
+    return 0;
+}
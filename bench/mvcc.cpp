@@ -0,0 +1,150 @@
+// Versioned<T> under long-running snapshot readers and a steady writer: read and commit
+// throughput and the length of the version chains, without pruning and with a BackgroundPruner
+// at different intervals. The baseline keeps only the latest values behind a std::shared_mutex
+// (no snapshots at all).
+
+#include "bench.h"
+
+#include <mvcc/versioned.h>
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t kRecords = 1024;
+// Reads done with one snapshot before a reader takes a new one
+constexpr size_t kReadsPerSnapshot = 100000;
+constexpr auto kDuration = std::chrono::milliseconds(500);
+
+struct Row {
+    size_t id = 0;
+    size_t balance = 0;
+};
+
+size_t Next(size_t& seed) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    return seed >> 33;
+}
+
+// Runs `readers` copies of `read(thread, stop)` and one `write(stop)` for `kDuration`,
+// each returning the number of operations done.
+template <typename Read, typename Write>
+void Run(const std::string& name, int readers, Read&& read, Write&& write) {
+    std::atomic<bool> stop = false;
+    std::atomic<size_t> reads = 0;
+    size_t commits = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; ++i) {
+        threads.emplace_back([&, i] { reads += read(i, stop); });
+    }
+    std::thread writer([&] { commits = write(stop); });
+    std::this_thread::sleep_for(kDuration);
+    stop = true;
+    writer.join();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(kDuration).count();
+    std::printf("%-56s %10.2f Mreads/s %10.2f Kcommits/s\n",
+                (name + " [" + std::to_string(readers) + " readers]").c_str(),
+                reads / seconds / 1e6, commits / seconds / 1e3);
+}
+
+void RunVersioned(const std::string& name, int readers, std::optional<int> prune_ms) {
+    MvccDomain domain;
+    std::vector<SharedPtr<Versioned<Row>>> records;
+    for (size_t i = 0; i < kRecords; ++i) {
+        records.push_back(domain.MakeRecord<Row>());
+    }
+    domain.Commit([&](auto& tx) {
+        for (size_t i = 0; i < kRecords; ++i) {
+            records[i]->Write(tx, Row{i, 0});
+        }
+    });
+
+    std::optional<BackgroundPruner> pruner;
+    if (prune_ms) {
+        pruner.emplace(domain, std::chrono::milliseconds(*prune_ms));
+    }
+    Run(
+        name, readers,
+        [&](int thread, std::atomic<bool>& stop) {
+            size_t seed = thread + 1;
+            size_t ops = 0;
+            size_t sum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto snapshot = domain.BeginSnapshot();
+                EpochDomain::Guard guard;
+                for (size_t i = 0; i < kReadsPerSnapshot; ++i) {
+                    sum += records[Next(seed) % kRecords]->Borrow(guard, snapshot)->balance;
+                }
+                ops += kReadsPerSnapshot;
+            }
+            DoNotOptimize(sum);
+            return ops;
+        },
+        [&](std::atomic<bool>& stop) {
+            size_t seed = 0;
+            size_t ops = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                size_t id = Next(seed) % kRecords;
+                domain.Commit([&](auto& tx) { records[id]->Write(tx, Row{id, ops}); });
+                ++ops;
+            }
+            return ops;
+        });
+
+    size_t versions = 0;
+    for (auto& record : records) {
+        versions += record->NumVersions();
+    }
+    std::printf("%-56s %10.2f versions/record\n", "", static_cast<double>(versions) / kRecords);
+}
+
+void RunLocked(int readers) {
+    std::shared_mutex mutex;
+    std::vector<Row> rows(kRecords);
+    Run(
+        "latest values under shared_mutex", readers,
+        [&](int thread, std::atomic<bool>& stop) {
+            size_t seed = thread + 1;
+            size_t ops = 0;
+            size_t sum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (size_t i = 0; i < kReadsPerSnapshot; ++i) {
+                    std::shared_lock lock(mutex);
+                    sum += rows[Next(seed) % kRecords].balance;
+                }
+                ops += kReadsPerSnapshot;
+            }
+            DoNotOptimize(sum);
+            return ops;
+        },
+        [&](std::atomic<bool>& stop) {
+            size_t seed = 0;
+            size_t ops = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                size_t id = Next(seed) % kRecords;
+                std::unique_lock lock(mutex);
+                rows[id] = Row{id, ops++};
+            }
+            return ops;
+        });
+}
+
+}  // namespace
+
+int main() {
+    for (int readers : ThreadCounts()) {
+        RunLocked(readers);
+        RunVersioned("Versioned, no pruning", readers, std::nullopt);
+        RunVersioned("Versioned, pruner every 10 ms", readers, 10);
+        RunVersioned("Versioned, pruner every 1 ms", readers, 1);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Teardown of a large tree: plain recursive destruction vs ParallelRelease at 1..N threads.
+// The number of nodes is the first argument (50M by default).
+
+#include "bench.h"
+
+#include <parallel-release/parallel_release.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+struct Node {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(children);
+    }
+
+    std::vector<SharedPtr<Node>> children;
+    char payload[32] = {};
+};
+
+SharedPtr<Node> MakeTree(size_t size) {
+    auto root = MakeShared<Node>();
+    std::vector<Node*> level{root.Get()};
+    size_t made = 1;
+    while (made < size) {
+        std::vector<Node*> next;
+        for (Node* node : level) {
+            for (int i = 0; i < 8 && made < size; ++i, ++made) {
+                node->children.push_back(MakeShared<Node>());
+                next.push_back(node->children.back().Get());
+            }
+        }
+        level = std::move(next);
+    }
+    return root;
+}
+
+template <typename F>
+void Measure(const char* name, size_t size, F release) {
+    using Clock = std::chrono::steady_clock;
+
+    auto root = MakeTree(size);
+    auto start = Clock::now();
+    release(root);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::printf("%-56s %12.1f ms %8.2f ns/node\n", name, ms, ms * 1e6 / size);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 50'000'000;
+    std::printf("%zu nodes\n", size);
+
+    Measure("destructor", size, [](SharedPtr<Node>& root) { root.Reset(); });
+
+    auto counts = ThreadCounts();
+    if (counts.back() < 4) {
+        // Still shows the scheduling overhead on small machines
+        counts = {1, 2, 4};
+    }
+    for (int threads : counts) {
+        ParallelRelease pool(threads);
+        std::string name = "ParallelRelease [" + std::to_string(threads) + " threads]";
+        Measure(name.c_str(), size, [&](SharedPtr<Node>& root) { pool.Release(root); });
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Hardware counters of the calling thread through `perf_event_open`, user space only (which
+// `perf_event_paranoid` up to 2 allows). Every event is opened on its own, so the ones the CPU
+// or the hypervisor doesn't have are simply missing; with none of them, benchmarks fall back to
+// wall time. Counts are scaled by enabled/running time in case the kernel multiplexed them.
+class PerfCounters {
+public:
+    enum Event { kCycles, kInstructions, kL1Misses, kLlcMisses, kBranchMisses, kNumEvents };
+
+    // NaN for the events that aren't available
+    using Counts = std::array<double, kNumEvents>;
+
+    // Every event missing
+    static Counts None() {
+        Counts res;
+        res.fill(NAN);
+        return res;
+    }
+
+    static const char* Name(Event event) {
+        static const char* const kNames[kNumEvents] = {"cycles", "instructions", "l1d_misses",
+                                                       "llc_misses", "branch_misses"};
+        return kNames[event];
+    }
+
+    PerfCounters() {
+        const uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D |
+                                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const uint64_t llc_read_miss = PERF_COUNT_HW_CACHE_LL |
+                                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        Open(kCycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        Open(kInstructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        Open(kL1Misses, PERF_TYPE_HW_CACHE, l1d_read_miss);
+        Open(kLlcMisses, PERF_TYPE_HW_CACHE, llc_read_miss);
+        Open(kBranchMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool Available() const {
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Why the first event couldn't be opened, if none could.
+    const std::string& Error() const {
+        return error_;
+    }
+
+    void Start() {
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    Counts Stop() {
+        Counts res = None();
+        for (int i = 0; i < kNumEvents; ++i) {
+            if (fds_[i] >= 0) {
+                ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+        for (int i = 0; i < kNumEvents; ++i) {
+            // value, time enabled, time running
+            uint64_t values[3];
+            if (fds_[i] < 0 || read(fds_[i], values, sizeof(values)) != sizeof(values)) {
+                continue;
+            }
+            res[i] = values[2] == 0 ? 0 : values[0] * (double(values[1]) / values[2]);
+        }
+        return res;
+    }
+
+private:
+    void Open(Event event, uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds_[event] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds_[event] < 0 && error_.empty()) {
+            error_ = std::string(Name(event)) + ": " + std::strerror(errno);
+        }
+    }
+
+    std::array<int, kNumEvents> fds_;
+    std::string error_;
+};
@@ -0,0 +1,122 @@
+// Warm restart of a cache kept in a PersistentHeap: mapping the heap file again vs rebuilding the
+// cache from scratch. The cache is a chained hash table of small entries filling most of a 1 GB
+// heap (pass another size in MB as the first argument). The file stays in the page cache, so
+// "remap" doesn't include reading it from disk.
+
+#include "bench.h"
+
+#include <persistent/persistent.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+namespace {
+
+struct Entry : PersistentRefCounted<Entry> {
+    Entry(uint64_t key) : key(key) {
+        for (size_t i = 0; i < sizeof(value); ++i) {
+            value[i] = static_cast<char>(key + i);
+        }
+    }
+
+    uint64_t key;
+    char value[32];
+    OffsetIntrusivePtr<Entry> next;
+};
+
+struct Cache : PersistentRefCounted<Cache> {
+    Cache(SharedSegment& segment, size_t num_buckets) : num_buckets(num_buckets) {
+        auto memory = segment.Allocate(num_buckets * sizeof(OffsetIntrusivePtr<Entry>));
+        auto array = static_cast<OffsetIntrusivePtr<Entry>*>(memory);
+        for (size_t i = 0; i < num_buckets; ++i) {
+            ::new (array + i) OffsetIntrusivePtr<Entry>();
+        }
+        buckets = array;
+    }
+    ~Cache() {
+        SharedSegment& segment = PersistentHeap::Containing(this).Segment();
+        for (size_t i = 0; i < num_buckets; ++i) {
+            buckets.Get()[i].~OffsetIntrusivePtr();
+        }
+        segment.Deallocate(buckets.Get());
+    }
+
+    OffsetIntrusivePtr<Entry>& Bucket(uint64_t key) {
+        return buckets.Get()[(key * 0x9E3779B97F4A7C15ull >> 20) % num_buckets];
+    }
+
+    void Insert(PersistentHeap& heap, uint64_t key) {
+        auto entry = heap.MakeIntrusive<Entry>(key);
+        auto& bucket = Bucket(key);
+        entry->next = bucket;
+        bucket = entry;
+    }
+
+    const Entry* Find(uint64_t key) {
+        for (const Entry* entry = Bucket(key).Get(); entry != nullptr; entry = entry->next.Get()) {
+            if (entry->key == key) {
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    size_t num_buckets;
+    OffsetPtr<OffsetIntrusivePtr<Entry>> buckets;
+};
+
+double Ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    using Clock = std::chrono::steady_clock;
+
+    size_t size = (argc > 1 ? std::atoll(argv[1]) : 1024) << 20;
+    // Entries take 128-byte chunks; leave some room for the buckets
+    size_t entries = size / 128 * 7 / 8;
+    std::string path = "/tmp/bench-persistent-heap-" + std::to_string(getpid());
+    std::remove(path.c_str());
+
+    auto start = Clock::now();
+    {
+        PersistentHeap heap(path, size);
+        auto cache = heap.MakeIntrusive<Cache>(heap.Segment(), entries / 4);
+        for (size_t key = 0; key < entries; ++key) {
+            cache->Insert(heap, key);
+        }
+        heap.SetRoot(cache);
+        std::printf("%-56s %12.1f ms (%zu entries, %zu MB)\n", "rebuild", Ms(start), entries,
+                    heap.Segment().BytesInUse() >> 20);
+        start = Clock::now();
+        heap.Sync();
+        std::printf("%-56s %12.1f ms\n", "msync", Ms(start));
+    }
+
+    start = Clock::now();
+    {
+        PersistentHeap heap(path, 0);
+        auto cache = heap.Root<Cache>();
+        const Entry* entry = cache->Find(entries / 2);
+        DoNotOptimize(entry);
+        std::printf("%-56s %12.3f ms\n", "remap + first lookup", Ms(start));
+
+        start = Clock::now();
+        size_t found = 0;
+        for (size_t key = 0; key < entries; ++key) {
+            found += cache->Find(key) != nullptr;
+        }
+        std::printf("%-56s %12.1f ms (%zu found)\n", "lookup of every key after remap", Ms(start),
+                    found);
+    }
+
+    std::remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,59 @@
+// Reader scaling for a published config: copying a global pointer on every read
+// (SharedPtr under a mutex, std::shared_ptr with its atomic counter) vs ReadMostlySharedPtr.
+
+#include "bench.h"
+
+#include <read-mostly/read_mostly.h>
+
+#include <memory>
+#include <mutex>
+
+namespace {
+
+struct Config {
+    int value = 1;
+};
+
+constexpr size_t kReads = 1000000;
+
+}  // namespace
+
+int main() {
+    std::mutex mutex;
+    auto global = MakeShared<Config>();
+    auto std_global = std::make_shared<Config>();
+    ReadMostlySharedPtr<Config> published(MakeShared<Config>());
+
+    for (int threads : ThreadCounts()) {
+        RunThreadedBench("SharedPtr copy under mutex", threads, kReads, [&](int) {
+            size_t sum = 0;
+            for (size_t i = 0; i < kReads; ++i) {
+                SharedPtr<Config> copy;
+                {
+                    std::lock_guard guard(mutex);
+                    copy = global;
+                }
+                sum += copy->value;
+                std::lock_guard guard(mutex);
+                copy.Reset();
+            }
+            DoNotOptimize(sum);
+        });
+        RunThreadedBench("std::shared_ptr copy", threads, kReads, [&](int) {
+            size_t sum = 0;
+            for (size_t i = 0; i < kReads; ++i) {
+                auto copy = std_global;
+                sum += copy->value;
+            }
+            DoNotOptimize(sum);
+        });
+        RunThreadedBench("ReadMostlySharedPtr::Read", threads, kReads, [&](int) {
+            size_t sum = 0;
+            for (size_t i = 0; i < kReads; ++i) {
+                sum += published.Read()->value;
+            }
+            DoNotOptimize(sum);
+        });
+    }
+    return 0;
+}
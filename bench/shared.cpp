@@ -0,0 +1,98 @@
+// SharedPtr against std::shared_ptr (and boost::shared_ptr, when Boost is around). Run with
+// --json=<path> to save the results.
+
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if __has_include(<boost/make_shared.hpp>)
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#define HAVE_BOOST 1
+#endif
+
+namespace {
+
+constexpr size_t kOps = 2'000'000;
+constexpr size_t kDestroyOps = 500'000;
+
+struct Payload {
+    int64_t value = 0;
+    int64_t other = 0;
+};
+
+// `New` and `Make` return a fresh pointer, `Alias` a pointer to the `value` of its argument.
+template <typename Ptr, typename New, typename Make, typename Alias>
+void RunAll(BenchSuite& suite, const std::string& name, New new_ptr, Make make, Alias alias) {
+    suite.Run("new + destroy", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr ptr = new_ptr();
+            DoNotOptimize(ptr);
+        }
+    });
+    suite.Run("MakeShared + destroy", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr ptr = make();
+            DoNotOptimize(ptr);
+        }
+    });
+
+    Ptr ptr = make();
+    suite.Run("copy + destroy", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr copy = ptr;
+            DoNotOptimize(copy);
+        }
+    });
+    suite.Run("move + move back", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr moved = std::move(ptr);
+            DoNotOptimize(moved);
+            ptr = std::move(moved);
+        }
+    });
+    suite.Run("aliasing copy + destroy", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto field = alias(ptr);
+            DoNotOptimize(field);
+        }
+    });
+
+    // The last reference: the object and the block go
+    std::vector<Ptr> pool;
+    suite.Run(
+        "destroy last", name, kDestroyOps,
+        [&] {
+            pool.clear();
+            for (size_t i = 0; i < kDestroyOps; ++i) {
+                pool.push_back(make());
+            }
+        },
+        [&] { pool.clear(); });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchSuite suite("SharedPtr", argc, argv);
+    RunAll<std::shared_ptr<Payload>>(
+        suite, "std::shared_ptr", [] { return std::shared_ptr<Payload>(new Payload()); },
+        [] { return std::make_shared<Payload>(); },
+        [](const auto& ptr) { return std::shared_ptr<int64_t>(ptr, &ptr->value); });
+#ifdef HAVE_BOOST
+    RunAll<boost::shared_ptr<Payload>>(
+        suite, "boost::shared_ptr", [] { return boost::shared_ptr<Payload>(new Payload()); },
+        [] { return boost::make_shared<Payload>(); },
+        [](const auto& ptr) { return boost::shared_ptr<int64_t>(ptr, &ptr->value); });
+#endif
+    RunAll<SharedPtr<Payload>>(
+        suite, "SharedPtr", [] { return SharedPtr<Payload>(new Payload()); },
+        [] { return MakeShared<Payload>(); },
+        [](const auto& ptr) { return SharedPtr<int64_t>(ptr, &ptr->value); });
+    suite.Report();
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Three-stage parsing pipeline (lines -> key/value fields -> checksum) over the same input,
+// passing either copied `std::string`s or `SharedBuffer` slices between the stages.
+
+#include "bench.h"
+
+#include <shared-buffer/shared_buffer.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Record {
+    std::string key;
+    std::string value;
+};
+
+struct RecordView {
+    SharedBuffer key;
+    SharedBuffer value;
+};
+
+size_t Checksum(std::string_view key, std::string_view value) {
+    return key.size() * 31 + value.size() + static_cast<unsigned char>(value.back());
+}
+
+size_t ParseStrings(const std::string& input) {
+    std::vector<std::string> lines;
+    for (size_t begin = 0; begin < input.size();) {
+        size_t end = input.find('\n', begin);
+        lines.push_back(input.substr(begin, end - begin));
+        begin = end + 1;
+    }
+
+    std::vector<Record> records;
+    records.reserve(lines.size());
+    for (const auto& line : lines) {
+        size_t eq = line.find('=');
+        records.push_back({line.substr(0, eq), line.substr(eq + 1)});
+    }
+
+    size_t sum = 0;
+    for (const auto& record : records) {
+        sum += Checksum(record.key, record.value);
+    }
+    return sum;
+}
+
+size_t ParseBuffers(const SharedBuffer& input) {
+    std::vector<SharedBuffer> lines;
+    std::string_view view = input.View();
+    for (size_t begin = 0; begin < view.size();) {
+        size_t end = view.find('\n', begin);
+        lines.push_back(input.Slice(begin, end - begin));
+        begin = end + 1;
+    }
+
+    std::vector<RecordView> records;
+    records.reserve(lines.size());
+    for (const auto& line : lines) {
+        size_t eq = line.View().find('=');
+        auto [key, value] = line.Split(eq);
+        records.push_back({std::move(key), value.Slice(1)});
+    }
+
+    size_t sum = 0;
+    for (const auto& record : records) {
+        sum += Checksum(record.key.View(), record.value.View());
+    }
+    return sum;
+}
+
+}  // namespace
+
+int main() {
+    std::string input;
+    for (int i = 0; i < 200000; ++i) {
+        input += "some.configuration.key." + std::to_string(i) + "=" +
+                 std::string(20 + i % 40, 'v') + "\n";
+    }
+    auto buffer = SharedBuffer::Copy(input);
+    size_t lines = 200000;
+
+    RunBench("pipeline, std::string copies (per line)", lines,
+             [&] { DoNotOptimize(ParseStrings(input)); });
+    RunBench("pipeline, SharedBuffer slices (per line)", lines,
+             [&] { DoNotOptimize(ParseBuffers(buffer)); });
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Hot-path cost of the SharedPtr counters. Built twice: bench_shared_stats has them compiled in,
+// bench_shared_stats_off is the same code without them.
+
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+
+#include <string>
+
+namespace {
+
+constexpr size_t kOps = 10'000'000;
+constexpr size_t kThreadedOps = 2'000'000;
+
+struct Payload {
+    int value = 0;
+};
+
+#ifdef SHARED_PTR_STATS
+const std::string kSuffix = " [stats]";
+#else
+const std::string kSuffix = " [compiled out]";
+#endif
+
+}  // namespace
+
+int main() {
+    auto ptr = MakeShared<Payload>();
+    WeakPtr<Payload> weak = ptr;
+
+    RunBench("copy + drop" + kSuffix, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            SharedPtr<Payload> copy = ptr;
+            DoNotOptimize(copy);
+        }
+    });
+    RunBench("Lock + drop" + kSuffix, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto copy = weak.Lock();
+            DoNotOptimize(copy);
+        }
+    });
+    RunBench("MakeShared + drop" + kSuffix, kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto fresh = MakeShared<Payload>();
+            DoNotOptimize(fresh);
+        }
+    });
+    RunBench("SharedPtr(new T) + drop" + kSuffix, kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            SharedPtr<Payload> fresh(new Payload());
+            DoNotOptimize(fresh);
+        }
+    });
+    for (int threads : ThreadCounts()) {
+        RunThreadedBench("copy + drop, shared object" + kSuffix, threads, kThreadedOps, [&](int) {
+            for (size_t i = 0; i < kThreadedOps; ++i) {
+                SharedPtr<Payload> copy = ptr;
+                DoNotOptimize(copy);
+            }
+        });
+    }
+    return 0;
+}
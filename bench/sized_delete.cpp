@@ -0,0 +1,211 @@
+// Free throughput of unsized vs sized deallocation against a small size-class allocator.
+// Unsized `operator delete` has to find the size class through a two-level page map
+// (as tcmalloc/jemalloc do); sized `operator delete` computes it from the size directly.
+// The allocator is single-threaded and only meant for this benchmark.
+
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+#include <unique/unique.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace {
+
+constexpr size_t kChunkBits = 16;
+constexpr size_t kChunkSize = size_t{1} << kChunkBits;
+constexpr size_t kGranularity = 16;
+constexpr size_t kMaxSmall = 1024;
+constexpr size_t kNumClasses = kMaxSmall / kGranularity + 1;
+constexpr size_t kLevelBits = 16;
+
+struct FreeObject {
+    FreeObject* next;
+};
+
+FreeObject* free_lists[kNumClasses];
+uint8_t* page_map[size_t{1} << kLevelBits];
+
+size_t SizeClass(size_t size) {
+    return (size + kGranularity - 1) / kGranularity;
+}
+
+uint8_t& PageMapEntry(uintptr_t address) {
+    size_t page = address >> kChunkBits;
+    size_t high = (page >> kLevelBits) & ((size_t{1} << kLevelBits) - 1);
+    size_t low = page & ((size_t{1} << kLevelBits) - 1);
+    if (page_map[high] == nullptr) {
+        page_map[high] = static_cast<uint8_t*>(std::calloc(size_t{1} << kLevelBits, 1));
+    }
+    return page_map[high][low];
+}
+
+void Refill(size_t cls) {
+    auto chunk = static_cast<char*>(std::aligned_alloc(kChunkSize, kChunkSize));
+    if (chunk == nullptr) {
+        throw std::bad_alloc();
+    }
+    PageMapEntry(reinterpret_cast<uintptr_t>(chunk)) = static_cast<uint8_t>(cls);
+    size_t object_size = cls * kGranularity;
+    for (size_t offset = 0; offset + object_size <= kChunkSize; offset += object_size) {
+        auto object = reinterpret_cast<FreeObject*>(chunk + offset);
+        object->next = free_lists[cls];
+        free_lists[cls] = object;
+    }
+}
+
+void* Allocate(size_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+    if (size > kMaxSmall) {
+        if (void* ptr = std::malloc(size)) {
+            return ptr;
+        }
+        throw std::bad_alloc();
+    }
+    size_t cls = SizeClass(size);
+    if (free_lists[cls] == nullptr) {
+        Refill(cls);
+    }
+    FreeObject* object = free_lists[cls];
+    free_lists[cls] = object->next;
+    return object;
+}
+
+void Deallocate(void* ptr, size_t cls) {
+    auto object = static_cast<FreeObject*>(ptr);
+    object->next = free_lists[cls];
+    free_lists[cls] = object;
+}
+
+void DeallocateUnsized(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    uint8_t cls = PageMapEntry(reinterpret_cast<uintptr_t>(ptr) & ~(kChunkSize - 1));
+    if (cls == 0) {
+        std::free(ptr);
+    } else {
+        Deallocate(ptr, cls);
+    }
+}
+
+void DeallocateSized(void* ptr, size_t size) {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (size > kMaxSmall) {
+        std::free(ptr);
+    } else {
+        Deallocate(ptr, SizeClass(size == 0 ? 1 : size));
+    }
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    return Allocate(size);
+}
+void* operator new[](size_t size) {
+    return Allocate(size);
+}
+void operator delete(void* ptr) noexcept {
+    DeallocateUnsized(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    DeallocateUnsized(ptr);
+}
+void operator delete(void* ptr, size_t size) noexcept {
+    DeallocateSized(ptr, size);
+}
+void operator delete[](void* ptr, size_t) noexcept {
+    // Array cookies make the size unreliable here
+    DeallocateUnsized(ptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Node {
+    int64_t payload[5];
+};
+
+int main() {
+    // A batch that fits in cache, spread over several size classes, so the cost of finding
+    // the size class is not hidden behind cache misses on the objects themselves
+    constexpr size_t kBatch = 4096;
+    constexpr size_t kSizes[] = {16, 24, 48, 64, 96, 128, 256, 512};
+    constexpr size_t kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+    constexpr int kRounds = 64;
+
+    std::vector<void*> objects(kBatch);
+    for (size_t i = 0; i < kBatch; ++i) {
+        objects[i] = ::operator new(kSizes[i % kNumSizes]);
+    }
+
+    RunBench("unsized operator delete + new", kBatch * kRounds, [&] {
+        for (int round = 0; round < kRounds; ++round) {
+            for (size_t i = 0; i < kBatch; ++i) {
+                ::operator delete(objects[i]);
+            }
+            for (size_t i = 0; i < kBatch; ++i) {
+                objects[i] = ::operator new(kSizes[i % kNumSizes]);
+            }
+        }
+    });
+    RunBench("sized operator delete + new", kBatch * kRounds, [&] {
+        for (int round = 0; round < kRounds; ++round) {
+            for (size_t i = 0; i < kBatch; ++i) {
+                ::operator delete(objects[i], kSizes[i % kNumSizes]);
+            }
+            for (size_t i = 0; i < kBatch; ++i) {
+                objects[i] = ::operator new(kSizes[i % kNumSizes]);
+            }
+        }
+    });
+
+    std::vector<Node*> raw(kBatch);
+    RunBench("new Node + unsized delete", kBatch * kRounds, [&] {
+        for (int round = 0; round < kRounds; ++round) {
+            for (auto& node : raw) {
+                node = new Node();
+            }
+            for (auto node : raw) {
+                node->~Node();
+                ::operator delete(node);
+            }
+        }
+    });
+
+    std::vector<UniquePtr<Node>> unique(kBatch);
+    RunBench("UniquePtr<Node> create + destroy", kBatch * kRounds, [&] {
+        for (int round = 0; round < kRounds; ++round) {
+            for (auto& ptr : unique) {
+                ptr.Reset(new Node());
+            }
+            for (auto& ptr : unique) {
+                ptr.Reset();
+            }
+        }
+    });
+
+    std::vector<SharedPtr<Node>> shared(kBatch);
+    RunBench("MakeShared<Node> create + destroy", kBatch * kRounds, [&] {
+        for (int round = 0; round < kRounds; ++round) {
+            for (auto& ptr : shared) {
+                ptr = MakeShared<Node>();
+            }
+            for (auto& ptr : shared) {
+                ptr.Reset();
+            }
+        }
+    });
+
+    for (size_t i = 0; i < kBatch; ++i) {
+        ::operator delete(objects[i], kSizes[i % kNumSizes]);
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+// UniquePtr against std::unique_ptr (and boost::movelib::unique_ptr, when Boost is around). Run
+// with --json=<path> to save the results.
+
+#include "bench.h"
+
+#include <unique/unique.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if __has_include(<boost/move/unique_ptr.hpp>)
+#include <boost/move/unique_ptr.hpp>
+#define HAVE_BOOST 1
+#endif
+
+namespace {
+
+constexpr size_t kOps = 2'000'000;
+constexpr size_t kDestroyOps = 500'000;
+
+struct Payload {
+    int64_t value = 0;
+};
+
+// Stateless, so it should take no space
+struct Deleter {
+    void operator()(Payload* ptr) const {
+        delete ptr;
+    }
+};
+
+template <typename Ptr, typename WithDeleter, typename Array>
+void RunAll(BenchSuite& suite, const std::string& name) {
+    static_assert(sizeof(WithDeleter) == sizeof(void*));
+
+    suite.Run("new + destroy", name, kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr ptr(new Payload());
+            DoNotOptimize(ptr);
+        }
+    });
+    suite.Run("new + destroy, deleter", name, kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            WithDeleter ptr(new Payload());
+            DoNotOptimize(ptr);
+        }
+    });
+    suite.Run("new[4] + destroy", name, kOps, [] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Array ptr(new Payload[4]);
+            DoNotOptimize(ptr);
+        }
+    });
+
+    Ptr ptr(new Payload());
+    suite.Run("move + move back", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr moved = std::move(ptr);
+            DoNotOptimize(moved);
+            ptr = std::move(moved);
+        }
+    });
+
+    std::vector<Ptr> pool;
+    suite.Run(
+        "destroy", name, kDestroyOps,
+        [&] {
+            pool.clear();
+            for (size_t i = 0; i < kDestroyOps; ++i) {
+                pool.emplace_back(new Payload());
+            }
+        },
+        [&] { pool.clear(); });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchSuite suite("UniquePtr", argc, argv);
+    RunAll<std::unique_ptr<Payload>, std::unique_ptr<Payload, Deleter>,
+           std::unique_ptr<Payload[]>>(suite, "std::unique_ptr");
+#ifdef HAVE_BOOST
+    RunAll<boost::movelib::unique_ptr<Payload>, boost::movelib::unique_ptr<Payload, Deleter>,
+           boost::movelib::unique_ptr<Payload[]>>(suite, "boost::movelib::unique_ptr");
+#endif
+    RunAll<UniquePtr<Payload>, UniquePtr<Payload, Deleter>, UniquePtr<Payload[]>>(suite,
+                                                                                  "UniquePtr");
+    suite.Report();
+    return 0;
+}
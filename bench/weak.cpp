@@ -0,0 +1,79 @@
+// WeakPtr against std::weak_ptr (and boost::weak_ptr, when Boost is around). Run with
+// --json=<path> to save the results.
+
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+
+#include <memory>
+
+#if __has_include(<boost/weak_ptr.hpp>)
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#define HAVE_BOOST 1
+#endif
+
+namespace {
+
+constexpr size_t kOps = 2'000'000;
+
+struct Payload {
+    int value = 0;
+};
+
+template <typename Weak, typename Shared, typename Lock>
+void RunAll(BenchSuite& suite, const std::string& name, const Shared& alive, Lock lock) {
+    suite.Run("from shared + destroy", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Weak weak = alive;
+            DoNotOptimize(weak);
+        }
+    });
+
+    Weak weak = alive;
+    suite.Run("copy + destroy", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Weak copy = weak;
+            DoNotOptimize(copy);
+        }
+    });
+    suite.Run("Lock + drop", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto locked = lock(weak);
+            DoNotOptimize(locked);
+        }
+    });
+
+    Weak expired;
+    {
+        Shared temporary(new Payload());
+        expired = temporary;
+    }
+    suite.Run("Lock expired", name, kOps, [&] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto locked = lock(expired);
+            DoNotOptimize(locked);
+        }
+    });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchSuite suite("WeakPtr", argc, argv);
+    auto std_alive = std::make_shared<Payload>();
+    RunAll<std::weak_ptr<Payload>>(suite, "std::weak_ptr", std_alive,
+                                   [](const auto& weak) { return weak.lock(); });
+#ifdef HAVE_BOOST
+    auto boost_alive = boost::make_shared<Payload>();
+    RunAll<boost::weak_ptr<Payload>>(suite, "boost::weak_ptr", boost_alive,
+                                     [](const auto& weak) { return weak.lock(); });
+#endif
+    auto alive = MakeShared<Payload>();
+    RunAll<WeakPtr<Payload>>(suite, "WeakPtr", alive,
+                             [](const auto& weak) { return weak.Lock(); });
+    suite.Report();
+    return 0;
+}
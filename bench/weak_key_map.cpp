@@ -0,0 +1,91 @@
+// Identity-keyed lookups with key churn: WeakKeyHashMap vs std::unordered_map keyed by raw
+// pointers with a side WeakPtr (needed to tell a live key from a reused address), which has to
+// be swept for expired keys explicitly.
+
+#include "bench.h"
+
+#include <weak-key-map/weak_key_map.h>
+
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Object {
+    int id = 0;
+};
+
+struct Entry {
+    WeakPtr<Object> key;
+    int value = 0;
+};
+
+constexpr size_t kKeys = 100000;
+constexpr size_t kLookups = 1000000;
+constexpr size_t kChurn = 1000;
+
+std::vector<size_t> MakeIndices(size_t count) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> dist(0, kKeys - 1);
+    std::vector<size_t> res(count);
+    for (auto& ind : res) {
+        ind = dist(gen);
+    }
+    return res;
+}
+
+}  // namespace
+
+int main() {
+    auto lookups = MakeIndices(kLookups);
+    auto victims = MakeIndices(kChurn);
+
+    std::vector<SharedPtr<Object>> keys;
+    for (size_t i = 0; i < kKeys; ++i) {
+        keys.push_back(MakeShared<Object>());
+    }
+
+    WeakKeyHashMap<Object, int> weak_map;
+    std::unordered_map<Object*, Entry> raw_map;
+    for (size_t i = 0; i < kKeys; ++i) {
+        weak_map[keys[i]] = i;
+        raw_map[keys[i].Get()] = {keys[i], static_cast<int>(i)};
+    }
+
+    RunBench("WeakKeyHashMap::Find", kLookups, [&] {
+        size_t sum = 0;
+        for (auto ind : lookups) {
+            sum += *weak_map.Find(keys[ind]);
+        }
+        DoNotOptimize(sum);
+    });
+    RunBench("unordered_map<T*, {WeakPtr, V}>::find", kLookups, [&] {
+        size_t sum = 0;
+        for (auto ind : lookups) {
+            auto it = raw_map.find(keys[ind].Get());
+            if (it != raw_map.end() && it->second.key.OwnerEqual(keys[ind])) {
+                sum += it->second.value;
+            }
+        }
+        DoNotOptimize(sum);
+    });
+
+    // Every round kills kChurn keys and inserts fresh ones
+    RunBench("WeakKeyHashMap churn round (per key)", kChurn, [&] {
+        for (auto ind : victims) {
+            keys[ind] = MakeShared<Object>();
+            weak_map[keys[ind]] = ind;
+        }
+    });
+    RunBench("unordered_map churn round + sweep (per key)", kChurn, [&] {
+        for (auto ind : victims) {
+            keys[ind] = MakeShared<Object>();
+            raw_map[keys[ind].Get()] = {keys[ind], static_cast<int>(ind)};
+        }
+        for (auto it = raw_map.begin(); it != raw_map.end();) {
+            it = it->second.key.Expired() ? raw_map.erase(it) : std::next(it);
+        }
+    });
+    return 0;
+}
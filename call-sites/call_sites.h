@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t, uint64_t
+#include <cstdio>   // std::snprintf
+#include <cstdlib>  // std::atexit, std::getenv
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <source_location>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// Counts of `SharedPtr` copies by the line of code that made them.
+//
+// Compiled in with `SHARED_PTR_CALL_SITES` defined: then, the copy, converting and aliasing
+// constructors of `SharedPtr` and `WeakPtr::Lock` take an extra parameter defaulted to
+// `std::source_location::current()`, which is the location of the caller. `operator=` can't take
+// one, so it takes its argument by value: a copy assignment is counted as the copy or conversion
+// that makes the argument, at the line of the assignment. Moves aren't counted. Copies made by
+// library code (say, when a `std::vector` grows) are attributed to the library line.
+//
+// Every thread counts into its own table; the tables of finished threads are folded into a
+// common one. At exit, the sites with the most copies are written to the file named by the
+// `SHARED_PTR_CALL_SITES_REPORT` environment variable, or to stderr.
+class CallSites {
+public:
+    enum Kind { kCopy, kConvert, kAlias, kLock };
+
+    struct Site {
+        std::string file;
+        uint32_t line = 0;
+        uint32_t column = 0;
+        std::string function;
+        Kind kind = kCopy;
+        uint64_t count = 0;
+    };
+
+    static CallSites& Global() {
+        static CallSites* sites = new CallSites();
+        return *sites;
+    }
+
+    CallSites(const CallSites&) = delete;
+    CallSites& operator=(const CallSites&) = delete;
+
+    static void Record(Kind kind, const std::source_location& location) {
+        Local().Add(kind, location);
+    }
+
+    static const char* KindName(Kind kind) {
+        static const char* const kNames[] = {"copy", "convert", "alias", "lock"};
+        return kNames[kind];
+    }
+
+    // All the sites, the most copies first.
+    std::vector<Site> Report() const {
+        std::map<std::tuple<std::string, uint32_t, uint32_t, Kind>, Site> merged;
+        auto add = [&merged](const Key& key, uint64_t count) {
+            if (count == 0) {
+                return;
+            }
+            Site& site = merged[{key.file, key.line, key.column, key.kind}];
+            site.file = key.file, site.line = key.line, site.column = key.column;
+            site.function = key.function, site.kind = key.kind;
+            site.count += count;
+        };
+
+        std::lock_guard lock(mutex_);
+        for (auto& [key, count] : retired_) {
+            add(key, count);
+        }
+        for (Table* table : tables_) {
+            std::lock_guard table_lock(table->mutex);
+            for (auto& [key, count] : table->counts) {
+                add(key, count.load(std::memory_order_relaxed));
+            }
+        }
+
+        std::vector<Site> res;
+        for (auto& [key, site] : merged) {
+            res.push_back(std::move(site));
+        }
+        std::stable_sort(res.begin(), res.end(), [](const Site& left, const Site& right) {
+            return left.count > right.count;
+        });
+        return res;
+    }
+
+    void WriteReport(std::ostream& out, size_t top = 50) const {
+        auto sites = Report();
+        uint64_t total = 0;
+        for (auto& site : sites) {
+            total += site.count;
+        }
+        out << total << " SharedPtr copies from " << sites.size() << " sites\n";
+        for (size_t i = 0; i < std::min(top, sites.size()); ++i) {
+            const Site& site = sites[i];
+            char line[64];
+            std::snprintf(line, sizeof(line), "%12llu %-8s ",
+                          static_cast<unsigned long long>(site.count), KindName(site.kind));
+            out << line << site.file << ":" << site.line << ":" << site.column << " in "
+                << site.function << "\n";
+        }
+    }
+
+    // Forgets the counts so far. Only while no thread copies: the owner of a table increments
+    // with a plain load and store, so a count zeroed in between would come back.
+    void Reset() {
+        std::lock_guard lock(mutex_);
+        retired_.clear();
+        for (Table* table : tables_) {
+            std::lock_guard table_lock(table->mutex);
+            for (auto& [key, count] : table->counts) {
+                count.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    // `source_location` strings are literals, so the pointers identify them within a program
+    // (the same file may still come with different pointers from different translation units).
+    struct Key {
+        const char* file;
+        const char* function;
+        uint32_t line;
+        uint32_t column;
+        Kind kind;
+
+        bool operator==(const Key& other) const {
+            return file == other.file && function == other.function && line == other.line &&
+                   column == other.column && kind == other.kind;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            size_t hash = reinterpret_cast<uintptr_t>(key.file);
+            hash = (hash ^ key.line) * 0x100000001b3;
+            hash = (hash ^ key.column) * 0x100000001b3;
+            return (hash ^ key.kind) * 0x100000001b3;
+        }
+    };
+
+    // Only its thread inserts and increments, so lookups and increments need no lock; the
+    // mutex keeps `Report` off the map while it's being changed.
+    struct Table {
+        Table() {
+            CallSites& sites = Global();
+            std::lock_guard lock(sites.mutex_);
+            sites.tables_.push_back(this);
+        }
+
+        ~Table() {
+            CallSites& sites = Global();
+            std::lock_guard lock(sites.mutex_);
+            for (auto& [key, count] : counts) {
+                sites.retired_[key] += count.load(std::memory_order_relaxed);
+            }
+            sites.tables_.erase(std::find(sites.tables_.begin(), sites.tables_.end(), this));
+        }
+
+        void Add(Kind kind, const std::source_location& location) {
+            Key key{location.file_name(), location.function_name(), location.line(),
+                    location.column(), kind};
+            auto it = counts.find(key);
+            if (it == counts.end()) {
+                std::lock_guard lock(mutex);
+                it = counts.try_emplace(key, 0).first;
+            }
+            it->second.store(it->second.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
+        }
+
+        std::mutex mutex;
+        std::unordered_map<Key, std::atomic<uint64_t>, KeyHash> counts;
+    };
+
+    CallSites() {
+        std::atexit([] {
+            const char* path = std::getenv("SHARED_PTR_CALL_SITES_REPORT");
+            if (path != nullptr && *path != '\0') {
+                std::ofstream out(path);
+                Global().WriteReport(out);
+            } else {
+                Global().WriteReport(std::cerr);
+            }
+        });
+    }
+
+    static Table& Local() {
+        thread_local Table table;
+        return table;
+    }
+
+    mutable std::mutex mutex_;
+    std::vector<Table*> tables_;
+    std::unordered_map<Key, uint64_t, KeyHash> retired_;
+};
@@ -0,0 +1,125 @@
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+
+#include <catch.hpp>
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef SHARED_PTR_CALL_SITES
+#error "The test is built with the call sites compiled in"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Base {
+    int value = 0;
+};
+
+struct Derived : Base {
+    int other = 0;
+};
+
+uint64_t CountAt(uint32_t line, CallSites::Kind kind) {
+    uint64_t res = 0;
+    for (auto& site : CallSites::Global().Report()) {
+        if (site.line == line && site.kind == kind &&
+            site.file.find("call-sites/test.cpp") != std::string::npos) {
+            res += site.count;
+        }
+    }
+    return res;
+}
+
+}  // namespace
+
+TEST_CASE("Every path is attributed to its line") {
+    CallSites::Global().Reset();
+    auto ptr = MakeShared<Derived>();
+    WeakPtr<Derived> weak = ptr;
+
+    uint32_t copy_line = __LINE__ + 2;
+    for (int i = 0; i < 10; ++i) {
+        SharedPtr<Derived> copy = ptr;
+    }
+    uint32_t convert_line = __LINE__ + 2;
+    for (int i = 0; i < 20; ++i) {
+        SharedPtr<Base> base = ptr;
+    }
+    uint32_t alias_line = __LINE__ + 2;
+    for (int i = 0; i < 30; ++i) {
+        SharedPtr<int> field(ptr, &ptr->other);
+    }
+    uint32_t lock_line = __LINE__ + 2;
+    for (int i = 0; i < 40; ++i) {
+        auto locked = weak.Lock();
+    }
+    SharedPtr<Base> assigned;
+    uint32_t assign_line = __LINE__ + 3;
+    for (int i = 0; i < 25; ++i) {
+        SharedPtr<Derived> copy;
+        copy = ptr;
+        assigned = ptr;
+    }
+
+    REQUIRE(CountAt(copy_line, CallSites::kCopy) == 10);
+    REQUIRE(CountAt(convert_line, CallSites::kConvert) == 20);
+    REQUIRE(CountAt(alias_line, CallSites::kAlias) == 30);
+    REQUIRE(CountAt(lock_line, CallSites::kLock) == 40);
+    REQUIRE(CountAt(assign_line, CallSites::kCopy) == 25);
+    REQUIRE(CountAt(assign_line + 1, CallSites::kConvert) == 25);
+
+    // Nothing else: moves and `MakeShared` aren't counted
+    SharedPtr<Derived> moved = std::move(ptr);
+    moved = MakeShared<Derived>();
+    assigned = std::move(moved);
+    auto sites = CallSites::Global().Report();
+    REQUIRE(sites.size() == 6);
+    REQUIRE(sites[0].count == 40);
+    REQUIRE(sites[0].kind == CallSites::kLock);
+    REQUIRE(!sites[0].function.empty());
+    REQUIRE(sites[5].count == 10);
+}
+
+TEST_CASE("Passing by value is attributed to the caller") {
+    CallSites::Global().Reset();
+    auto ptr = MakeShared<Base>();
+    auto take = [](SharedPtr<Base> copy) { return copy.UseCount(); };
+
+    uint32_t first = __LINE__ + 1;
+    take(ptr);
+    uint32_t second = __LINE__ + 1;
+    take(ptr), take(ptr);
+
+    REQUIRE(CountAt(first, CallSites::kCopy) == 1);
+    REQUIRE(CountAt(second, CallSites::kCopy) == 2);
+}
+
+TEST_CASE("Threads") {
+    CallSites::Global().Reset();
+    auto ptr = MakeShared<Base>();
+    uint32_t line = __LINE__ + 5;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&ptr] {
+            for (int j = 0; j < 1000; ++j) {
+                SharedPtr<Base> copy = ptr;
+            }
+        });
+    }
+    // Counted while the threads run and after they finish
+    REQUIRE(CountAt(line, CallSites::kCopy) <= 4000);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(CountAt(line, CallSites::kCopy) == 4000);
+
+    std::ostringstream text;
+    CallSites::Global().WriteReport(text);
+    REQUIRE(text.str().find("4000 SharedPtr copies from 1 sites") == 0);
+    REQUIRE(text.str().find("copy     ") != std::string::npos);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <execinfo.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t, uintptr_t
+#include <cstdlib>  // std::free
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+// Backtraces of up to `MaxFrames` frames, each distinct one stored once under a dense id.
+// Thread-safe.
+template <size_t MaxFrames>
+class StackTable {
+public:
+    // Deeper backtraces are cut to their innermost `MaxFrames` frames.
+    uint32_t Intern(void* const* frames, size_t depth) {
+        Stack stack;
+        stack.depth = std::min(depth, MaxFrames);
+        std::copy(frames, frames + stack.depth, stack.frames.begin());
+
+        std::lock_guard lock(mutex_);
+        auto [it, inserted] = ids_.try_emplace(stack, stacks_.size());
+        if (inserted) {
+            stacks_.push_back(stack);
+        }
+        return it->second;
+    }
+
+    std::vector<void*> Frames(uint32_t id) const {
+        std::lock_guard lock(mutex_);
+        const Stack& stack = stacks_[id];
+        return {stack.frames.begin(), stack.frames.begin() + stack.depth};
+    }
+
+private:
+    struct Stack {
+        std::array<void*, MaxFrames> frames{};
+        size_t depth = 0;
+
+        bool operator==(const Stack& other) const {
+            return depth == other.depth &&
+                   std::equal(frames.begin(), frames.begin() + depth, other.frames.begin());
+        }
+    };
+
+    struct StackHash {
+        size_t operator()(const Stack& stack) const {
+            size_t hash = stack.depth;
+            for (size_t i = 0; i < stack.depth; ++i) {
+                hash = (hash ^ reinterpret_cast<uintptr_t>(stack.frames[i])) * 0x100000001b3;
+            }
+            return hash;
+        }
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<Stack, uint32_t, StackHash> ids_;
+    std::vector<Stack> stacks_;
+};
+
+// One indented line per frame, symbolized by `backtrace_symbols` (function names need
+// `-rdynamic`; otherwise, `addr2line` takes the module offsets).
+inline void WriteFrames(std::ostream& out, const std::vector<void*>& frames) {
+    char** symbols = backtrace_symbols(frames.data(), frames.size());
+    for (size_t i = 0; i < frames.size(); ++i) {
+        out << "    " << (symbols != nullptr ? symbols[i] : "?") << "\n";
+    }
+    std::free(symbols);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>      // size_t
+#include <new>          // std::align_val_t
+#include <type_traits>  // std::has_virtual_destructor_v
+
+template <typename T, typename = void>
+inline constexpr bool kHasUnsizedClassDelete = false;
+
+template <typename T>
+inline constexpr bool
+    kHasUnsizedClassDelete<T, std::void_t<decltype(T::operator delete(static_cast<void*>(nullptr)))>> =
+        true;
+
+template <typename T, typename = void>
+inline constexpr bool kHasSizedClassDelete = false;
+
+template <typename T>
+inline constexpr bool kHasSizedClassDelete<
+    T, std::void_t<decltype(T::operator delete(static_cast<void*>(nullptr), size_t{}))>> = true;
+
+// Same as `delete ptr`, but passes the statically known size (and alignment) to the allocator,
+// so size-class allocators don't have to look it up on free.
+// Types with a virtual destructor only know their size dynamically, and types with their own
+// `operator delete` must keep it, so both are released with plain `delete`.
+template <typename T>
+void SizedDelete(T* ptr) {
+    using U = std::remove_cv_t<T>;
+    if constexpr (std::has_virtual_destructor_v<U> || kHasUnsizedClassDelete<U> ||
+                  kHasSizedClassDelete<U>) {
+        delete ptr;
+    } else {
+        static_assert(sizeof(U) > 0, "Can't delete an incomplete type");
+        if (ptr == nullptr) {
+            return;
+        }
+        ptr->~T();
+        void* raw = const_cast<U*>(ptr);
+        if constexpr (alignof(U) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(raw, sizeof(U), std::align_val_t(alignof(U)));
+        } else {
+            ::operator delete(raw, sizeof(U));
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <atomic>
+
+// Counts the live instances, from any thread. `value` is overwritten on destruction, so a read
+// after free is likely to see -1.
+struct Tracked {
+    Tracked() {
+        ++alive;
+    }
+
+    Tracked(int value) : value(value) {
+        ++alive;
+    }
+
+    Tracked(const Tracked& other) : value(other.value) {
+        ++alive;
+    }
+
+    ~Tracked() {
+        value = -1;
+        --alive;
+    }
+
+    inline static std::atomic<int> alive = 0;
+    int value = 0;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cxxabi.h>
+
+#include <cstdlib>  // std::free
+#include <string>
+#include <typeinfo>
+
+// Demangled name of `type`, or the mangled one if it can't be demangled.
+inline std::string TypeName(const std::type_info& type) {
+    int status = 0;
+    char* name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    if (status != 0) {
+        return type.name();
+    }
+    std::string res = name;
+    std::free(name);
+    return res;
+}
+
+template <typename T>
+std::string TypeName() {
+    return TypeName(typeid(T));
+}
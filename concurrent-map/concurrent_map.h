@@ -0,0 +1,223 @@
+#pragma once
+
+#include <epoch/epoch.h>
+
+#include <atomic>
+#include <cstddef>     // size_t
+#include <functional>  // std::hash
+#include <memory>      // std::unique_ptr
+#include <mutex>
+#include <vector>
+
+// Sharded hash map from keys to `SharedPtr<V>` with lock-free reads.
+// Buckets are chains of immutable entries. Writers take the lock of their shard, link new entries
+// in and unlink old ones; unlinked entries and outgrown tables are retired through
+// `EpochDomain::Global()`, so a replaced value is released only once no reader can see it.
+// Readers never lock: `Find` walks the chain inside an epoch guard and copies the value out,
+// `Borrow` doesn't even touch the counter and returns a pointer that is valid while the caller's
+// guard lives.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class ConcurrentHashMap {
+    struct Entry {
+        Entry(const K& key, SharedPtr<V> value, Entry* next)
+            : key(key), value(std::move(value)), next(next) {
+        }
+
+        const K key;
+        const SharedPtr<V> value;
+        std::atomic<Entry*> next;
+    };
+
+    struct Table {
+        explicit Table(size_t size) : mask(size - 1), buckets(new std::atomic<Entry*>[size]) {
+            for (size_t i = 0; i < size; ++i) {
+                buckets[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<Entry*>[]> buckets;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::atomic<Table*> table = nullptr;
+        std::atomic<size_t> size = 0;
+    };
+
+public:
+    explicit ConcurrentHashMap(size_t shards = 64) : shards_(RoundUp(shards)) {
+        for (auto& shard : shards_) {
+            shard.table.store(new Table(kInitialBuckets), std::memory_order_relaxed);
+        }
+    }
+
+    ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+    ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+    // No operation may run concurrently with the destructor.
+    ~ConcurrentHashMap() {
+        for (auto& shard : shards_) {
+            Table* table = shard.table.load(std::memory_order_relaxed);
+            for (size_t i = 0; i <= table->mask; ++i) {
+                for (Entry* entry = table->buckets[i].load(std::memory_order_relaxed);
+                     entry != nullptr;) {
+                    Entry* next = entry->next.load(std::memory_order_relaxed);
+                    delete entry;
+                    entry = next;
+                }
+            }
+            delete table;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Readers
+
+    SharedPtr<V> Find(const K& key) const {
+        EpochDomain::Guard guard;
+        Entry* entry = Lookup(key);
+        return entry == nullptr ? SharedPtr<V>() : entry->value;
+    }
+
+    // Borrowed view of the value, valid while `guard` is alive.
+    const V* Borrow([[maybe_unused]] const EpochDomain::Guard& guard, const K& key) const {
+        Entry* entry = Lookup(key);
+        return entry == nullptr ? nullptr : entry->value.Get();
+    }
+
+    bool Contains(const K& key) const {
+        EpochDomain::Guard guard;
+        return Lookup(key) != nullptr;
+    }
+
+    // Exact when there are no concurrent modifications.
+    size_t Size() const {
+        size_t res = 0;
+        for (auto& shard : shards_) {
+            res += shard.size.load(std::memory_order_relaxed);
+        }
+        return res;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Writers
+
+    // Returns false (and drops `value`) if `key` is already there.
+    bool Insert(const K& key, SharedPtr<V> value) {
+        return Store(key, std::move(value), false);
+    }
+
+    // Returns whether the key is new. The replaced value is released through the epoch domain.
+    bool InsertOrAssign(const K& key, SharedPtr<V> value) {
+        return Store(key, std::move(value), true);
+    }
+
+    bool Erase(const K& key) {
+        size_t hash = HashOf(key);
+        Shard& shard = ShardOf(hash);
+        std::lock_guard lock(shard.mutex);
+        Table* table = shard.table.load(std::memory_order_relaxed);
+        std::atomic<Entry*>* link = &table->buckets[hash & table->mask];
+        for (Entry* entry = link->load(std::memory_order_relaxed); entry != nullptr;
+             entry = link->load(std::memory_order_relaxed)) {
+            if (entry->key == key) {
+                link->store(entry->next.load(std::memory_order_relaxed), std::memory_order_release);
+                shard.size.fetch_sub(1, std::memory_order_relaxed);
+                EpochDomain::Global().Retire(entry);
+                return true;
+            }
+            link = &entry->next;
+        }
+        return false;
+    }
+
+private:
+    static constexpr size_t kInitialBuckets = 16;
+
+    static size_t RoundUp(size_t size) {
+        size_t res = 1;
+        while (res < size) {
+            res *= 2;
+        }
+        return res;
+    }
+
+    size_t HashOf(const K& key) const {
+        // Spread the bits: std::hash of integers is the identity
+        size_t hash = Hash()(key) * 0x9E3779B97F4A7C15ull;
+        return hash ^ (hash >> 32);
+    }
+
+    // Low bits pick the bucket, high bits pick the shard.
+    Shard& ShardOf(size_t hash) const {
+        return const_cast<Shard&>(shards_[(hash >> 48) & (shards_.size() - 1)]);
+    }
+
+    // Must be called inside a guard.
+    Entry* Lookup(const K& key) const {
+        size_t hash = HashOf(key);
+        Table* table = ShardOf(hash).table.load(std::memory_order_acquire);
+        for (Entry* entry = table->buckets[hash & table->mask].load(std::memory_order_acquire);
+             entry != nullptr; entry = entry->next.load(std::memory_order_acquire)) {
+            if (entry->key == key) {
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    bool Store(const K& key, SharedPtr<V> value, bool assign) {
+        size_t hash = HashOf(key);
+        Shard& shard = ShardOf(hash);
+        std::lock_guard lock(shard.mutex);
+        Table* table = shard.table.load(std::memory_order_relaxed);
+        std::atomic<Entry*>* head = &table->buckets[hash & table->mask];
+        std::atomic<Entry*>* link = head;
+        for (Entry* entry = link->load(std::memory_order_relaxed); entry != nullptr;
+             entry = link->load(std::memory_order_relaxed)) {
+            if (entry->key == key) {
+                if (!assign) {
+                    return false;
+                }
+                // Entries are immutable: replace the whole entry
+                auto replacement =
+                    new Entry(key, std::move(value), entry->next.load(std::memory_order_relaxed));
+                link->store(replacement, std::memory_order_release);
+                EpochDomain::Global().Retire(entry);
+                return false;
+            }
+            link = &entry->next;
+        }
+
+        head->store(new Entry(key, std::move(value), head->load(std::memory_order_relaxed)),
+                    std::memory_order_release);
+        if (shard.size.fetch_add(1, std::memory_order_relaxed) + 1 > table->mask + 1) {
+            Grow(shard, table);
+        }
+        return true;
+    }
+
+    // Rebuilds the shard in a table twice as large. Readers keep using the old table (and its
+    // entries) until they are done, so both are retired instead of deleted.
+    void Grow(Shard& shard, Table* table) {
+        size_t size = (table->mask + 1) * 2;
+        auto grown = new Table(size);
+        for (size_t i = 0; i <= table->mask; ++i) {
+            for (Entry* entry = table->buckets[i].load(std::memory_order_relaxed);
+                 entry != nullptr;) {
+                Entry* next = entry->next.load(std::memory_order_relaxed);
+                auto& bucket = grown->buckets[HashOf(entry->key) & (size - 1)];
+                bucket.store(new Entry(entry->key, entry->value,
+                                       bucket.load(std::memory_order_relaxed)),
+                             std::memory_order_relaxed);
+                EpochDomain::Global().Retire(entry);
+                entry = next;
+            }
+        }
+        shard.table.store(grown, std::memory_order_release);
+        EpochDomain::Global().Retire(table);
+    }
+
+    std::vector<Shard> shards_;
+};
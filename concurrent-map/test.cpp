@@ -0,0 +1,148 @@
+#include "concurrent_map.h"
+
+#include <common/tracked.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <cstdint>  // uint32_t
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("ConcurrentHashMap basics") {
+    ConcurrentHashMap<std::string, int> map;
+    REQUIRE(map.Size() == 0);
+    REQUIRE(!map.Find("a"));
+
+    REQUIRE(map.Insert("a", MakeShared<int>(1)));
+    REQUIRE(!map.Insert("a", MakeShared<int>(2)));
+    REQUIRE(*map.Find("a") == 1);
+    REQUIRE(map.Contains("a"));
+
+    REQUIRE(!map.InsertOrAssign("a", MakeShared<int>(3)));
+    REQUIRE(map.InsertOrAssign("b", MakeShared<int>(4)));
+    REQUIRE(*map.Find("a") == 3);
+    REQUIRE(*map.Find("b") == 4);
+    REQUIRE(map.Size() == 2);
+
+    {
+        EpochDomain::Guard guard;
+        const int* value = map.Borrow(guard, "b");
+        REQUIRE(value != nullptr);
+        REQUIRE(*value == 4);
+        REQUIRE(map.Borrow(guard, "c") == nullptr);
+    }
+
+    REQUIRE(map.Erase("a"));
+    REQUIRE(!map.Erase("a"));
+    REQUIRE(!map.Find("a"));
+    REQUIRE(map.Size() == 1);
+}
+
+TEST_CASE("ConcurrentHashMap grows") {
+    ConcurrentHashMap<int, int> map(4);
+    const int n = 10000;
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(map.Insert(i, MakeShared<int>(i * 2)));
+    }
+    REQUIRE(map.Size() == n);
+    for (int i = 0; i < n; ++i) {
+        auto value = map.Find(i);
+        REQUIRE(value);
+        REQUIRE(*value == i * 2);
+    }
+    for (int i = 0; i < n; i += 2) {
+        REQUIRE(map.Erase(i));
+    }
+    REQUIRE(map.Size() == n / 2);
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(map.Contains(i) == (i % 2 == 1));
+    }
+}
+
+TEST_CASE("ConcurrentHashMap releases values") {
+    auto& domain = EpochDomain::Global();
+    domain.Barrier();
+    int alive = Tracked::alive;
+    {
+        ConcurrentHashMap<int, Tracked> map;
+        map.Insert(1, MakeShared<Tracked>(1));
+        map.Insert(2, MakeShared<Tracked>(2));
+        REQUIRE(Tracked::alive == alive + 2);
+
+        SECTION("Found values outlive replacement") {
+            auto found = map.Find(1);
+            map.InsertOrAssign(1, MakeShared<Tracked>(3));
+            domain.Barrier();
+            REQUIRE(found->value == 1);
+            REQUIRE(Tracked::alive == alive + 3);
+            found = SharedPtr<Tracked>();
+            REQUIRE(Tracked::alive == alive + 2);
+        }
+
+        SECTION("Erased values are released after the grace period") {
+            map.Erase(2);
+            domain.Barrier();
+            REQUIRE(Tracked::alive == alive + 1);
+        }
+    }
+    domain.Barrier();
+    REQUIRE(Tracked::alive == alive);
+}
+
+TEST_CASE("ConcurrentHashMap concurrent readers and writers") {
+    ConcurrentHashMap<int, Tracked> map(8);
+    const int keys = 512;
+    for (int i = 0; i < keys; ++i) {
+        map.Insert(i, MakeShared<Tracked>(i));
+    }
+
+    std::atomic<bool> stop = false;
+    std::atomic<int> bad = 0;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&, t] {
+            uint32_t seed = t;
+            while (!stop.load(std::memory_order_relaxed)) {
+                seed = seed * 1103515245 + 12345;
+                int key = static_cast<int>((seed >> 8) & (keys - 1));
+                if (auto value = map.Find(key)) {
+                    // Values of key k are always k or k + keys
+                    if (value->value % keys != key) {
+                        ++bad;
+                    }
+                }
+                EpochDomain::Guard guard;
+                if (auto value = map.Borrow(guard, key); value && value->value % keys != key) {
+                    ++bad;
+                }
+            }
+        });
+    }
+
+    std::thread writer([&] {
+        for (int round = 0; round < 20; ++round) {
+            for (int i = 0; i < keys; ++i) {
+                if ((i + round) % 3 == 0) {
+                    map.Erase(i);
+                } else {
+                    map.InsertOrAssign(i, MakeShared<Tracked>(i + (round % 2) * keys));
+                }
+            }
+        }
+        // Force growth while readers are running
+        for (int i = keys; i < keys * 8; ++i) {
+            map.Insert(i * keys, MakeShared<Tracked>(0));
+        }
+    });
+
+    writer.join();
+    stop = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    REQUIRE(bad == 0);
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <common/backtrace.h>
+#include <common/type_name.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>      // std::popcount
+#include <chrono>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t, uint64_t
+#include <cstdio>   // std::snprintf
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+// Sampling profiler of contention on the reference counters of control blocks.
+//
+// Compiled in with `SHARED_PTR_CONTENTION_PROFILER` defined for the whole program (it adds a field
+// to `ControlBlockBasic`); without it, the hooks in the counters are empty. Once compiled in,
+// every thread samples one in `SampleRate()` of its counter operations (increments, weak
+// promotions, decrements through `SharedPtr`/`WeakPtr`). A sample records the thread and the time
+// for the block; when the previous sample of the same block came from another thread less than
+// `Window()` ago, the cache line has most likely moved between cores, and the sample counts as
+// shared.
+//
+// One in `SiteSampleRate()` control blocks also records the backtrace of its creation. `Report`
+// groups the blocks by type and creation site, those that died included, and orders them by
+// shared samples.
+class ContentionProfiler {
+public:
+    static constexpr size_t kMaxFrames = 16;
+
+    struct Group {
+        const std::type_info* type = nullptr;
+        // Creation site, innermost first; empty if the creation wasn't sampled
+        std::vector<void*> frames;
+        size_t objects = 0;
+        uint64_t samples = 0;
+        uint64_t shared = 0;
+        // Distinct threads (modulo 64) that touched the objects
+        int threads = 0;
+    };
+
+    static ContentionProfiler& Global() {
+        static ContentionProfiler* profiler = new ContentionProfiler();
+        return *profiler;
+    }
+
+    ContentionProfiler(const ContentionProfiler&) = delete;
+    ContentionProfiler& operator=(const ContentionProfiler&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Settings
+
+    // One operation in `rate` per thread; 0 stops sampling.
+    void SetSampleRate(uint64_t rate) {
+        rate_.store(rate, std::memory_order_relaxed);
+        generation_.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint64_t SampleRate() const {
+        return rate_.load(std::memory_order_relaxed);
+    }
+    void SetSiteSampleRate(uint64_t rate) {
+        site_rate_.store(rate, std::memory_order_relaxed);
+        generation_.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint64_t SiteSampleRate() const {
+        return site_rate_.load(std::memory_order_relaxed);
+    }
+    void SetWindow(std::chrono::nanoseconds window) {
+        window_ns_.store(window.count(), std::memory_order_relaxed);
+    }
+    std::chrono::nanoseconds Window() const {
+        return std::chrono::nanoseconds(window_ns_.load(std::memory_order_relaxed));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Hooks of `ControlBlockBasic`
+
+    // Inline part of the counter hook: the per-thread countdown.
+    static bool ShouldSample() {
+        return Global().Countdown(Local().ops, Global().rate_);
+    }
+
+    // `profiled` is the field of the block, so the destructor knows to call `Destroyed`.
+    void Created(const void* block, std::atomic<bool>& profiled) {
+        if (!Countdown(Local().sites, site_rate_)) {
+            return;
+        }
+        uint32_t stack = CaptureStack();
+        Shard& shard = ShardOf(block);
+        std::lock_guard lock(shard.mutex);
+        shard.live[block].site = stack;
+        profiled.store(true, std::memory_order_relaxed);
+    }
+
+    void Record(const void* block, const std::type_info& type, std::atomic<bool>& profiled) {
+        uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch())
+                           .count();
+        uint32_t thread = Local().index;
+        uint64_t window = window_ns_.load(std::memory_order_relaxed);
+
+        Shard& shard = ShardOf(block);
+        std::lock_guard lock(shard.mutex);
+        Entry& entry = shard.live[block];
+        entry.type = &type;
+        ++entry.samples;
+        if (entry.samples > 1 && entry.last_thread != thread && now - entry.last_time < window) {
+            ++entry.shared;
+        }
+        entry.last_thread = thread;
+        entry.last_time = now;
+        entry.threads |= uint64_t(1) << (thread % 64);
+        profiled.store(true, std::memory_order_relaxed);
+    }
+
+    // Folds the stats of a dying block into its group.
+    void Destroyed(const void* block) {
+        Shard& shard = ShardOf(block);
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.live.find(block);
+        if (it == shard.live.end()) {
+            return;
+        }
+        if (it->second.type != nullptr) {
+            Fold(shard.retired, it->second);
+        }
+        shard.live.erase(it);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Reports
+
+    // The `top` groups with the most shared samples.
+    std::vector<Group> Report(size_t top = 20) const {
+        std::map<Key, Aggregate> groups;
+        for (auto& shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            for (auto& [key, aggregate] : shard.retired) {
+                groups[key] += aggregate;
+            }
+            for (auto& [block, entry] : shard.live) {
+                if (entry.type != nullptr) {
+                    Fold(groups, entry);
+                }
+            }
+        }
+
+        std::vector<Group> res;
+        for (auto& [key, aggregate] : groups) {
+            Group group;
+            group.type = key.type;
+            if (key.site != kNoSite) {
+                group.frames = stacks_.Frames(key.site);
+            }
+            group.objects = aggregate.objects;
+            group.samples = aggregate.samples;
+            group.shared = aggregate.shared;
+            group.threads = std::popcount(aggregate.threads);
+            res.push_back(std::move(group));
+        }
+        std::sort(res.begin(), res.end(), [](const Group& left, const Group& right) {
+            return left.shared > right.shared;
+        });
+        res.resize(std::min(top, res.size()));
+        return res;
+    }
+
+    void WriteReport(std::ostream& out, size_t top = 20) const {
+        auto groups = Report(top);
+        out << "counter samples shared between threads (1/" << SampleRate() << " sampled, window "
+            << Window().count() << " ns)\n";
+        for (auto& group : groups) {
+            char line[128];
+            std::snprintf(line, sizeof(line),
+                          "%10llu shared / %10llu samples, %zu objects, %d threads: ",
+                          static_cast<unsigned long long>(group.shared),
+                          static_cast<unsigned long long>(group.samples), group.objects,
+                          group.threads);
+            out << line << TypeName(*group.type) << "\n";
+            WriteFrames(out, group.frames);
+        }
+    }
+
+    // Forgets the samples of the blocks that died; the live ones start over.
+    void Reset() {
+        for (auto& shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            shard.retired.clear();
+            for (auto& [block, entry] : shard.live) {
+                entry = Entry{.site = entry.site};
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t kNoSite = -1;
+    static constexpr size_t kShards = 64;
+
+    struct ThreadState {
+        uint32_t index = 0;
+        uint64_t generation = -1;
+        uint64_t ops = 0;
+        uint64_t sites = 0;
+    };
+
+    struct Entry {
+        const std::type_info* type = nullptr;
+        uint32_t site = kNoSite;
+        uint32_t last_thread = 0;
+        uint64_t last_time = 0;
+        uint64_t samples = 0;
+        uint64_t shared = 0;
+        uint64_t threads = 0;
+    };
+
+    struct Key {
+        const std::type_info* type;
+        uint32_t site;
+
+        bool operator<(const Key& other) const {
+            return type != other.type ? type->before(*other.type) : site < other.site;
+        }
+    };
+
+    struct Aggregate {
+        size_t objects = 0;
+        uint64_t samples = 0;
+        uint64_t shared = 0;
+        uint64_t threads = 0;
+
+        Aggregate& operator+=(const Aggregate& other) {
+            objects += other.objects;
+            samples += other.samples;
+            shared += other.shared;
+            threads |= other.threads;
+            return *this;
+        }
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<const void*, Entry> live;
+        std::map<Key, Aggregate> retired;
+    };
+
+    ContentionProfiler() = default;
+
+    static ThreadState& Local() {
+        thread_local ThreadState state{Global().threads_.fetch_add(1, std::memory_order_relaxed)};
+        return state;
+    }
+
+    bool Countdown(uint64_t& left, const std::atomic<uint64_t>& rate_setting) {
+        uint64_t rate = rate_setting.load(std::memory_order_relaxed);
+        if (rate == 0) {
+            return false;
+        }
+        ThreadState& state = Local();
+        uint64_t generation = generation_.load(std::memory_order_relaxed);
+        if (state.generation != generation) {
+            state.generation = generation;
+            state.ops = SampleRate();
+            state.sites = SiteSampleRate();
+        }
+        if (left == 0 || --left != 0) {
+            return false;
+        }
+        left = rate;
+        return true;
+    }
+
+    static void Fold(std::map<Key, Aggregate>& groups, const Entry& entry) {
+        groups[{entry.type, entry.site}] += {1, entry.samples, entry.shared, entry.threads};
+    }
+
+    // Never inlined, so the backtrace starts at a known frame; this one and `Created` are
+    // skipped.
+    [[gnu::noinline]] uint32_t CaptureStack() {
+        std::array<void*, kMaxFrames + 2> frames;
+        int depth = backtrace(frames.data(), frames.size());
+        return stacks_.Intern(frames.data() + 2, std::max(depth - 2, 0));
+    }
+
+    Shard& ShardOf(const void* block) {
+        return shards_[(reinterpret_cast<uintptr_t>(block) >> 4) % kShards];
+    }
+
+    std::atomic<uint64_t> rate_ = 64;
+    std::atomic<uint64_t> site_rate_ = 64;
+    std::atomic<uint64_t> window_ns_ = 100'000;
+    std::atomic<uint64_t> generation_ = 0;
+    std::atomic<uint32_t> threads_ = 0;
+    Shard shards_[kShards];
+    StackTable<kMaxFrames> stacks_;
+};
@@ -0,0 +1,116 @@
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+
+#include <catch.hpp>
+
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifndef SHARED_PTR_CONTENTION_PROFILER
+#error "The test is built with the profiler compiled in"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Hot {
+    int value = 0;
+};
+
+struct Cold {
+    int value = 0;
+};
+
+// Copies and drops `ptr` on `threads` threads, which yield now and then to interleave even on
+// a single core.
+template <typename T>
+void Hammer(const SharedPtr<T>& ptr, int threads) {
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&ptr] {
+            for (int j = 0; j < 20000; ++j) {
+                SharedPtr<T> copy = ptr;
+                if (j % 100 == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+}  // namespace
+
+TEST_CASE("Contended objects come first") {
+    auto& profiler = ContentionProfiler::Global();
+    profiler.SetSampleRate(1);
+    profiler.SetSiteSampleRate(1);
+    profiler.SetWindow(std::chrono::seconds(1));
+    profiler.Reset();
+
+    auto hot = MakeShared<Hot>();
+    auto cold = MakeShared<Cold>();
+    Hammer(hot, 4);
+    Hammer(cold, 1);
+
+    auto report = profiler.Report(10);
+    REQUIRE(report.size() >= 2);
+    REQUIRE(*report[0].type == typeid(ControlBlockRawMemory<Hot>));
+    REQUIRE(report[0].shared > 0);
+    REQUIRE(report[0].threads >= 4);
+    REQUIRE(report[0].objects == 1);
+    REQUIRE(!report[0].frames.empty());
+    for (auto& group : report) {
+        if (*group.type == typeid(ControlBlockRawMemory<Cold>)) {
+            REQUIRE(group.shared == 0);
+            REQUIRE(group.samples >= 40000);
+        }
+    }
+
+    std::ostringstream text;
+    profiler.WriteReport(text, 1);
+    REQUIRE(text.str().find("ControlBlockRawMemory<(anonymous namespace)::Hot>") !=
+            std::string::npos);
+}
+
+TEST_CASE("Dead objects stay in the report") {
+    auto& profiler = ContentionProfiler::Global();
+    profiler.SetSampleRate(1);
+    profiler.Reset();
+
+    for (int i = 0; i < 3; ++i) {
+        auto hot = MakeShared<Hot>();
+        WeakPtr<Hot> weak = hot;
+        Hammer(hot, 2);
+    }
+    auto report = profiler.Report(1);
+    REQUIRE(report.size() == 1);
+    REQUIRE(*report[0].type == typeid(ControlBlockRawMemory<Hot>));
+    REQUIRE(report[0].objects == 3);
+}
+
+TEST_CASE("Sampling") {
+    auto& profiler = ContentionProfiler::Global();
+    profiler.SetSampleRate(100);
+    profiler.Reset();
+
+    auto cold = MakeShared<Cold>();
+    for (int i = 0; i < 10000; ++i) {
+        SharedPtr<Cold> copy = cold;
+    }
+    auto report = profiler.Report();
+    REQUIRE(report.size() == 1);
+    // An increment and a decrement per copy
+    REQUIRE(report[0].samples == 200);
+
+    profiler.SetSampleRate(0);
+    for (int i = 0; i < 10000; ++i) {
+        SharedPtr<Cold> copy = cold;
+    }
+    REQUIRE(profiler.Report()[0].samples == 200);
+}
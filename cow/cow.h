@@ -0,0 +1,84 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+
+#include <utility>  // std::forward
+
+// Value wrapper with copy-on-write semantics.
+// Copies share one `T`; `Mutate()` clones it only if somebody else still shares it.
+// The shared object is never handed out as a `SharedPtr`/`WeakPtr` that could be used to write
+// to it, so the only owners are `CowPtr`s and `UseCount() == 1` means nobody else can read it.
+template <typename T>
+class CowPtr {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    CowPtr() : data_(MakeShared<T>()) {
+    }
+
+    CowPtr(const T& value) : data_(MakeShared<T>(value)) {
+    }
+
+    CowPtr(T&& value) : data_(MakeShared<T>(std::move(value))) {
+    }
+
+    // There are no separate move operations: moving shares the value like a copy does, so a
+    // moved-from `CowPtr` still holds it and `operator*`/`Mutate()` never see null.
+    CowPtr(const CowPtr&) = default;
+    CowPtr& operator=(const CowPtr&) = default;
+
+    template <typename... Args>
+    static CowPtr Make(Args&&... args) {
+        CowPtr res(Tag{});
+        res.data_ = MakeShared<T>(std::forward<Args>(args)...);
+        return res;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    const T& operator*() const {
+        return *data_;
+    }
+    const T* operator->() const {
+        return data_.Get();
+    }
+    const T& Read() const {
+        return *data_;
+    }
+
+    // Whether this is the only owner of the object.
+    // `UseCount()` is an acquire load, so the reads of the owners that have dropped their copies
+    // happen before our writes.
+    bool IsUnique() const {
+        return data_.UseCount() == 1;
+    }
+    size_t UseCount() const {
+        return data_.UseCount();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    // Returns a reference that can be written to. Clones the object if it is shared.
+    // The reference is valid until this `CowPtr` is copied or assigned to.
+    T& Mutate() {
+        if (!IsUnique()) {
+            data_ = MakeShared<T>(static_cast<const T&>(*data_));
+        }
+        return *data_;
+    }
+
+    void Swap(CowPtr& other) {
+        data_.Swap(other.data_);
+    }
+
+private:
+    struct Tag {};
+
+    explicit CowPtr(Tag) {
+    }
+
+    SharedPtr<T> data_;
+};
@@ -0,0 +1,96 @@
+#include "cow.h"
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Counted {
+    Counted() = default;
+    Counted(const Counted& other) : value(other.value) {
+        ++copies;
+    }
+
+    inline static int copies = 0;
+    int value = 0;
+};
+
+TEST_CASE("CowPtr") {
+    SECTION("Copies share") {
+        CowPtr<std::string> a(std::string("abc"));
+        CowPtr<std::string> b;
+        EXPECT_ZERO_ALLOCATIONS(b = a);
+        REQUIRE(&*a == &*b);
+        REQUIRE(a.UseCount() == 2);
+        REQUIRE(b->size() == 3);
+    }
+
+    SECTION("Mutate clones shared values") {
+        auto a = CowPtr<std::vector<int>>::Make(3, 1);
+        auto b = a;
+        b.Mutate().push_back(2);
+        REQUIRE(a->size() == 3);
+        REQUIRE(b->size() == 4);
+        REQUIRE(a.IsUnique());
+        REQUIRE(b.IsUnique());
+    }
+
+    SECTION("Unique owner mutates in place") {
+        auto a = CowPtr<std::vector<int>>::Make(3, 1);
+        const std::vector<int>* before = &*a;
+        EXPECT_ZERO_ALLOCATIONS(a.Mutate()[0] = 5);
+        REQUIRE(&*a == before);
+        REQUIRE(a.Read()[0] == 5);
+
+        {
+            auto b = a;
+        }
+        REQUIRE(a.IsUnique());
+        a.Mutate()[1] = 6;
+        REQUIRE(&*a == before);
+    }
+
+    SECTION("Clones only once") {
+        Counted::copies = 0;
+        CowPtr<Counted> a;
+        auto b = a;
+        b.Mutate().value = 1;
+        b.Mutate().value = 2;
+        a.Mutate().value = 3;
+        REQUIRE(Counted::copies == 1);
+        REQUIRE(a->value == 3);
+        REQUIRE(b->value == 2);
+    }
+
+    SECTION("Readers keep their snapshot") {
+        CowPtr<std::string> a(std::string("abc"));
+        auto reader = a;
+        a.Mutate() += "d";
+        REQUIRE(*reader == "abc");
+        REQUIRE(*a == "abcd");
+    }
+
+    SECTION("Moved-from still holds the value") {
+        CowPtr<std::string> a(std::string("abc"));
+        auto b = std::move(a);
+        REQUIRE(*a == "abc");
+        REQUIRE(a.UseCount() == 2);
+        a.Mutate() += "d";
+        REQUIRE(*a == "abcd");
+        REQUIRE(*b == "abc");
+
+        b = std::move(a);
+        REQUIRE(*a == "abcd");
+    }
+
+    SECTION("Swap") {
+        CowPtr<int> a(1), b(2);
+        a.Swap(b);
+        REQUIRE(*a == 2);
+        REQUIRE(*b == 1);
+    }
+}
@@ -0,0 +1,519 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+#include <intrusive/intrusive.h>
+
+#include <atomic>
+#include <cstddef>  // size_t
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>  // std::forward
+#include <vector>
+
+// Opt-in collector of reference cycles (synchronous trial deletion after Bacon and Rajan).
+//
+// Only collectable nodes take part: objects created with `MakeCollectable<T>` (for `SharedPtr`)
+// or derived from `CollectedRefCounted<T>` (for `IntrusivePtr`). Their type registers a trace
+// function, a member `void Trace(CycleVisitor& visit)` calling `visit(ptr)` for every strong
+// pointer it holds.
+//
+// When a strong count of a node drops to a nonzero value, the node may have become the entry to
+// a garbage cycle, so it's buffered as a possible root. A collection looks at the subgraph
+// reachable from the roots: a node whose count is larger than the number of edges to it from
+// inside the subgraph is referenced from outside, and so is every node reachable from it. The
+// rest is garbage; the collector resets the pointers held by the garbage nodes, and they are
+// destroyed through the usual release paths.
+//
+// `Collect` runs a whole collection at once. `CollectStep(budget)` does a bounded amount of it,
+// counted in nodes traced and roots taken, and the next call resumes where it stopped, so a pause
+// doesn't depend on the size of the live graph behind the roots. The graph may change between
+// steps: the collector holds a reference to every node it has reached, and the garbage it found
+// is checked again in one go before anything is freed. That check is the only part not split by
+// the budget; it costs as much as the garbage candidates themselves.
+//
+// A step must not run concurrently with changes of the collectable graph (it's synchronous);
+// releasing pointers from several threads otherwise is fine. A node is buffered before its count
+// goes down, while the reference being dropped still keeps it alive: once the count is lower,
+// another thread may free the node at any moment.
+
+class CycleNode;
+
+// Passed to `Trace`.
+class CycleVisitor {
+public:
+    template <typename U>
+    void operator()(SharedPtr<U>& ptr);
+    template <typename U>
+    void operator()(IntrusivePtr<U>& ptr);
+    template <typename P>
+    void operator()(std::vector<P>& ptrs) {
+        for (auto& ptr : ptrs) {
+            (*this)(ptr);
+        }
+    }
+
+private:
+    friend class CycleCollector;
+
+    CycleVisitor(void (*visit)(void*, CycleNode*), void* context, bool reset)
+        : visit_(visit), context_(context), reset_(reset) {
+    }
+
+    void (*visit_)(void*, CycleNode*);
+    void* context_;
+    // Reset the pointers instead of reporting them
+    bool reset_;
+};
+
+class CycleNode {
+public:
+    virtual ~CycleNode() = default;
+
+private:
+    friend class CycleCollector;
+    template <typename T>
+    friend class ControlBlockCollected;
+    template <typename Derived>
+    friend class CollectedRefCounted;
+
+    static constexpr size_t kNotBuffered = -1;
+
+    virtual size_t CollectorRefCount() const = 0;
+    virtual void CollectorTrace(CycleVisitor& visit) = 0;
+    virtual void CollectorAcquire() = 0;
+    // Drops a reference of the collector: destroys the node at zero, but never buffers it.
+    virtual void CollectorRelease() = 0;
+
+    std::atomic<bool> buffered_ = false;
+    // Position in the root buffer, guarded by its mutex
+    size_t index_ = kNotBuffered;
+};
+
+struct CollectStats {
+    size_t roots = 0;
+    // Nodes in the subgraphs looked at
+    size_t traced = 0;
+    // Garbage nodes
+    size_t freed = 0;
+    // Whether the collection is over; the counts are for all of its steps so far
+    bool done = true;
+};
+
+class CycleCollector {
+public:
+    static CycleCollector& Global() {
+        static CycleCollector* collector = new CycleCollector();
+        return *collector;
+    }
+
+    // Finishes the collection in progress, if any, and runs a whole new one.
+    CollectStats Collect() {
+        std::lock_guard collect_lock(collect_mutex_);
+        if (phase_ != Phase::kIdle) {
+            Step(kUnbounded);
+        }
+        Step(kUnbounded);
+        return stats_;
+    }
+
+    // Does about `budget` units of work of the collection in progress, starting a new one if
+    // there is none. The roots of a collection are those buffered when it starts.
+    CollectStats CollectStep(size_t budget) {
+        std::lock_guard collect_lock(collect_mutex_);
+        Step(budget);
+        return stats_;
+    }
+
+    size_t NumBuffered() const {
+        std::lock_guard lock(mutex_);
+        return buffer_.size() - tombstones_;
+    }
+
+private:
+    template <typename T>
+    friend class ControlBlockCollected;
+    template <typename Derived>
+    friend class CollectedRefCounted;
+
+    enum class Phase {
+        kIdle,
+        // Taking roots and counting the internal edges of everything reachable from them
+        kMark,
+        // Finding the nodes referenced from outside
+        kScanRoots,
+        // Marking live whatever they reach
+        kScan,
+        // Resetting the pointers held by the garbage
+        kCut,
+        // Dropping the references to all the nodes, which frees the garbage
+        kRelease,
+    };
+
+    struct Info {
+        CycleNode* node;
+        // Edges from inside the subgraph
+        size_t internal = 0;
+        bool live = false;
+    };
+
+    static constexpr size_t kUnbounded = -1;
+
+    CycleCollector() = default;
+
+    // Called before a decrement that may leave the count nonzero, by the holder of the reference
+    void PossibleRoot(CycleNode* node) {
+        if (node->buffered_.exchange(true, std::memory_order_relaxed)) {
+            return;
+        }
+        std::lock_guard lock(mutex_);
+        node->index_ = buffer_.size();
+        buffer_.push_back(node);
+    }
+
+    // Decrement to zero: the node is about to be destroyed
+    void Forget(CycleNode* node) {
+        if (!node->buffered_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::lock_guard lock(mutex_);
+        if (node->index_ != CycleNode::kNotBuffered) {
+            buffer_[node->index_] = nullptr;
+            ++tombstones_;
+            if (tombstones_ * 2 > buffer_.size()) {
+                Compact();
+            }
+        }
+    }
+
+    void Compact() {
+        size_t size = 0;
+        for (CycleNode* node : buffer_) {
+            if (node != nullptr) {
+                node->index_ = size;
+                buffer_[size++] = node;
+            }
+        }
+        buffer_.resize(size);
+        tombstones_ = 0;
+    }
+
+    // Null if the buffer is empty. The root may be buffered again while it's looked at.
+    CycleNode* TakeRoot() {
+        std::lock_guard lock(mutex_);
+        while (!buffer_.empty()) {
+            CycleNode* node = buffer_.back();
+            buffer_.pop_back();
+            if (node == nullptr) {
+                --tombstones_;
+                continue;
+            }
+            node->index_ = CycleNode::kNotBuffered;
+            node->buffered_.store(false, std::memory_order_relaxed);
+            return node;
+        }
+        return nullptr;
+    }
+
+    template <typename F>
+    static CycleVisitor Visitor(F& visit) {
+        auto call = [](void* context, CycleNode* node) { (*static_cast<F*>(context))(node); };
+        return CycleVisitor(call, &visit, false);
+    }
+
+    // Adds `node` to the subgraph, holding a reference to it until the collection is over.
+    Info& Reach(CycleNode* node) {
+        auto [it, inserted] = ids_.try_emplace(node, graph_.size());
+        if (inserted) {
+            node->CollectorAcquire();
+            graph_.push_back({node});
+            stack_.push_back(it->second);
+        }
+        return graph_[it->second];
+    }
+
+    // Referenced from outside, apart from the reference of the collector
+    static bool HasExternal(const Info& info) {
+        return info.node->CollectorRefCount() > info.internal + 1;
+    }
+
+    void Start() {
+        {
+            std::lock_guard lock(mutex_);
+            roots_left_ = buffer_.size() - tombstones_;
+        }
+        stats_ = CollectStats();
+        stats_.done = false;
+        phase_ = Phase::kMark;
+    }
+
+    void Step(size_t budget) {
+        if (phase_ == Phase::kIdle) {
+            Start();
+        }
+        auto count_edge = [this](CycleNode* child) { ++Reach(child).internal; };
+        CycleVisitor mark = Visitor(count_edge);
+        auto mark_live = [this](CycleNode* child) {
+            // An edge added since the node was marked may lead out of the subgraph
+            auto it = ids_.find(child);
+            if (it != ids_.end() && !graph_[it->second].live) {
+                graph_[it->second].live = true;
+                stack_.push_back(it->second);
+            }
+        };
+        CycleVisitor scan = Visitor(mark_live);
+        CycleVisitor cut(nullptr, nullptr, true);
+
+        for (size_t work = 0; work < budget;) {
+            switch (phase_) {
+                case Phase::kMark:
+                    if (!stack_.empty()) {
+                        size_t id = stack_.back();
+                        stack_.pop_back();
+                        graph_[id].node->CollectorTrace(mark);
+                        ++work;
+                    } else if (CycleNode* root = roots_left_ > 0 ? TakeRoot() : nullptr) {
+                        --roots_left_;
+                        ++stats_.roots;
+                        Reach(root);
+                        ++work;
+                    } else {
+                        stats_.traced = graph_.size();
+                        cursor_ = 0;
+                        phase_ = Phase::kScanRoots;
+                    }
+                    break;
+                case Phase::kScanRoots:
+                    if (cursor_ < graph_.size()) {
+                        Info& info = graph_[cursor_];
+                        if (HasExternal(info)) {
+                            info.live = true;
+                            stack_.push_back(cursor_);
+                        }
+                        ++cursor_;
+                        ++work;
+                    } else {
+                        phase_ = Phase::kScan;
+                    }
+                    break;
+                case Phase::kScan:
+                    if (!stack_.empty()) {
+                        size_t id = stack_.back();
+                        stack_.pop_back();
+                        graph_[id].node->CollectorTrace(scan);
+                        ++work;
+                    } else {
+                        FindGarbage(scan);
+                        cursor_ = 0;
+                        phase_ = Phase::kCut;
+                    }
+                    break;
+                case Phase::kCut:
+                    if (cursor_ < garbage_.size()) {
+                        garbage_[cursor_++]->CollectorTrace(cut);
+                        ++work;
+                    } else {
+                        cursor_ = 0;
+                        phase_ = Phase::kRelease;
+                    }
+                    break;
+                case Phase::kRelease:
+                    if (cursor_ < graph_.size()) {
+                        graph_[cursor_++].node->CollectorRelease();
+                        ++work;
+                    } else {
+                        graph_.clear();
+                        ids_.clear();
+                        garbage_.clear();
+                        stats_.done = true;
+                        phase_ = Phase::kIdle;
+                        return;
+                    }
+                    break;
+                case Phase::kIdle:
+                    return;
+            }
+        }
+    }
+
+    // Edges and counts seen in earlier steps may be stale, so the candidates are checked again
+    // in one go: a candidate referenced from anything but the other candidates is live, with
+    // everything it reaches. The rest can't be reached from outside any more, so the following
+    // steps may free it bit by bit.
+    void FindGarbage(CycleVisitor& scan) {
+        std::vector<size_t> candidates;
+        for (size_t id = 0; id < graph_.size(); ++id) {
+            if (!graph_[id].live) {
+                candidates.push_back(id);
+                graph_[id].internal = 0;
+            }
+        }
+        auto count_edge = [this](CycleNode* child) {
+            auto it = ids_.find(child);
+            if (it != ids_.end() && !graph_[it->second].live) {
+                ++graph_[it->second].internal;
+            }
+        };
+        CycleVisitor recount = Visitor(count_edge);
+        for (size_t id : candidates) {
+            graph_[id].node->CollectorTrace(recount);
+        }
+        for (size_t id : candidates) {
+            if (HasExternal(graph_[id])) {
+                graph_[id].live = true;
+                stack_.push_back(id);
+            }
+        }
+        while (!stack_.empty()) {
+            size_t id = stack_.back();
+            stack_.pop_back();
+            graph_[id].node->CollectorTrace(scan);
+        }
+
+        for (size_t id : candidates) {
+            if (!graph_[id].live) {
+                garbage_.push_back(graph_[id].node);
+                // To be released, must not get into the buffer again
+                garbage_.back()->buffered_.store(true, std::memory_order_relaxed);
+            }
+        }
+        stats_.freed = garbage_.size();
+    }
+
+    std::mutex collect_mutex_;
+    mutable std::mutex mutex_;
+    std::vector<CycleNode*> buffer_;
+    size_t tombstones_ = 0;
+
+    // State of the collection in progress, guarded by `collect_mutex_`
+    Phase phase_ = Phase::kIdle;
+    size_t roots_left_ = 0;
+    std::vector<Info> graph_;
+    std::unordered_map<CycleNode*, size_t> ids_;
+    std::vector<size_t> stack_;
+    // Every edge out of it is cut while the collector holds it, then it's let go
+    std::vector<CycleNode*> garbage_;
+    size_t cursor_ = 0;
+    CollectStats stats_;
+};
+
+// Control block of `MakeCollectable`.
+template <typename T>
+class ControlBlockCollected : public ControlBlockBasic, public CycleNode {
+public:
+    template <typename... Args>
+    ControlBlockCollected(Args&&... args) {
+        new (&x) T(std::forward<Args>(args)...);
+        ++strong_cnt;
+    }
+    void DecreaseStrong() override {
+        // A reference taken from a `WeakPtr` meanwhile isn't buffered here, but it will be when
+        // it's dropped
+        if (strong_cnt.load(std::memory_order_relaxed) != 1) {
+            CycleCollector::Global().PossibleRoot(this);
+        }
+        if (strong_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Destroy();
+        }
+    }
+    void DestroyObject() override {
+        Get()->~T();
+    }
+    T* Get() {
+        return reinterpret_cast<T*>(&x);
+    }
+
+    alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
+
+private:
+    size_t CollectorRefCount() const override {
+        return strong_cnt.load(std::memory_order_acquire);
+    }
+    void CollectorTrace(CycleVisitor& visit) override {
+        Get()->Trace(visit);
+    }
+    void CollectorAcquire() override {
+        IncreaseStrong();
+    }
+    void CollectorRelease() override {
+        if (strong_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Destroy();
+        }
+    }
+
+    void Destroy() {
+        CycleCollector::Global().Forget(this);
+        DestroyObject();
+        DecreaseWeak();
+    }
+};
+
+template <typename T, typename... Args>
+SharedPtr<T> MakeCollectable(Args&&... args) {
+    auto block = new ControlBlockCollected<T>(std::forward<Args>(args)...);
+    return SharedPtr<T>(block, block->Get());
+}
+
+// Base for collectable `IntrusivePtr` targets, in place of `RefCounted`. Objects are deleted
+// with `SizedDelete`.
+template <typename Derived>
+class CollectedRefCounted : public CycleNode {
+public:
+    void IncRef() {
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    void DecRef() {
+        if (count_.load(std::memory_order_relaxed) != 1) {
+            CycleCollector::Global().PossibleRoot(this);
+        }
+        if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Destroy();
+        }
+    }
+    size_t RefCount() const {
+        return count_.load(std::memory_order_acquire);
+    }
+
+private:
+    size_t CollectorRefCount() const override {
+        return RefCount();
+    }
+    void CollectorTrace(CycleVisitor& visit) override {
+        static_cast<Derived*>(this)->Trace(visit);
+    }
+    void CollectorAcquire() override {
+        IncRef();
+    }
+    void CollectorRelease() override {
+        if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Destroy();
+        }
+    }
+
+    void Destroy() {
+        CycleCollector::Global().Forget(this);
+        SizedDelete(static_cast<Derived*>(this));
+    }
+
+    std::atomic<size_t> count_ = 0;
+};
+
+template <typename U>
+void CycleVisitor::operator()(SharedPtr<U>& ptr) {
+    if (reset_) {
+        ptr.Reset();
+    } else if (auto node = dynamic_cast<CycleNode*>(ptr.buffer)) {
+        visit_(context_, node);
+    }
+}
+
+template <typename U>
+void CycleVisitor::operator()(IntrusivePtr<U>& ptr) {
+    if (reset_) {
+        ptr.Reset();
+    } else if constexpr (std::is_base_of_v<CycleNode, U>) {
+        if (ptr) {
+            visit_(context_, ptr.Get());
+        }
+    }
+}
@@ -0,0 +1,299 @@
+#include "cycle_collector.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node {
+    Node() {
+        ++alive;
+    }
+    ~Node() {
+        --alive;
+    }
+
+    void Trace(CycleVisitor& visit) {
+        visit(next);
+        visit(children);
+    }
+
+    inline static std::atomic<int> alive = 0;
+    SharedPtr<Node> next;
+    std::vector<SharedPtr<Node>> children;
+};
+
+struct IntrusiveNode : CollectedRefCounted<IntrusiveNode> {
+    IntrusiveNode() {
+        ++alive;
+    }
+    ~IntrusiveNode() {
+        --alive;
+    }
+
+    void Trace(CycleVisitor& visit) {
+        visit(next);
+        visit(shared);
+    }
+
+    inline static std::atomic<int> alive = 0;
+    IntrusivePtr<IntrusiveNode> next;
+    SharedPtr<Node> shared;
+};
+
+// Ring of `n` nodes, returns one of them
+SharedPtr<Node> MakeRing(int n) {
+    auto first = MakeCollectable<Node>();
+    auto last = first;
+    for (int i = 1; i < n; ++i) {
+        auto node = MakeCollectable<Node>();
+        last->next = node;
+        last = node;
+    }
+    last->next = first;
+    return first;
+}
+
+}  // namespace
+
+TEST_CASE("Cycles leak without the collector") {
+    auto& collector = CycleCollector::Global();
+    collector.Collect();
+
+    MakeRing(3);
+    REQUIRE(Node::alive == 3);
+    // Building the ring dropped local references to every node
+    REQUIRE(collector.NumBuffered() == 3);
+
+    auto stats = collector.Collect();
+    REQUIRE(stats.roots == 3);
+    REQUIRE(stats.traced == 3);
+    REQUIRE(stats.freed == 3);
+    REQUIRE(Node::alive == 0);
+    REQUIRE(collector.NumBuffered() == 0);
+}
+
+TEST_CASE("SharedPtr cycles") {
+    auto& collector = CycleCollector::Global();
+    collector.Collect();
+
+    SECTION("Self loop") {
+        auto node = MakeCollectable<Node>();
+        node->next = node;
+        node = nullptr;
+        REQUIRE(Node::alive == 1);
+        REQUIRE(collector.Collect().freed == 1);
+    }
+
+    SECTION("Referenced from outside") {
+        auto ring = MakeRing(4);
+        auto inside = ring->next->next;
+        ring = nullptr;
+        REQUIRE(collector.Collect().freed == 0);
+        REQUIRE(Node::alive == 4);
+        REQUIRE(inside->next->next->next->next.Get() == inside.Get());
+
+        inside = nullptr;
+        REQUIRE(collector.Collect().freed == 4);
+    }
+
+    SECTION("Garbage holding live nodes") {
+        auto live = MakeCollectable<Node>();
+        {
+            auto ring = MakeRing(2);
+            ring->children.push_back(live);
+        }
+        REQUIRE(live.UseCount() == 2);
+        REQUIRE(collector.Collect().freed == 2);
+        REQUIRE(live.UseCount() == 1);
+        REQUIRE(Node::alive == 1);
+    }
+
+    SECTION("Acyclic graphs are left alone") {
+        auto root = MakeCollectable<Node>();
+        auto shared = MakeCollectable<Node>();
+        root->children = {shared, shared, shared};
+        shared = nullptr;
+        REQUIRE(collector.Collect().freed == 0);
+        root = nullptr;
+        REQUIRE(Node::alive == 0);
+    }
+
+    SECTION("Plain MakeShared objects keep nodes alive") {
+        auto holder = MakeShared<Node>();
+        {
+            auto ring = MakeRing(2);
+            holder->next = ring;
+        }
+        REQUIRE(collector.Collect().freed == 0);
+        holder = nullptr;
+        REQUIRE(collector.Collect().freed == 2);
+    }
+    REQUIRE(Node::alive == 0);
+    REQUIRE(collector.NumBuffered() == 0);
+}
+
+TEST_CASE("IntrusivePtr cycles") {
+    auto& collector = CycleCollector::Global();
+    collector.Collect();
+
+    SECTION("Intrusive ring") {
+        IntrusivePtr<IntrusiveNode> a(new IntrusiveNode());
+        a->next = new IntrusiveNode();
+        a->next->next = a;
+        a = nullptr;
+        REQUIRE(IntrusiveNode::alive == 2);
+        REQUIRE(collector.Collect().freed == 2);
+    }
+
+    SECTION("Mixed cycle") {
+        {
+            IntrusivePtr<IntrusiveNode> a(new IntrusiveNode());
+            a->shared = MakeCollectable<Node>();
+            a->shared->children.push_back(MakeCollectable<Node>());
+            // Intrusive pointers to a collectable object can't be held by `Node`, so close the
+            // loop through another intrusive node
+            a->next = new IntrusiveNode();
+            a->next->next = a;
+        }
+        // The shared nodes are only reachable from the garbage
+        REQUIRE(collector.Collect().freed == 4);
+        REQUIRE(Node::alive == 0);
+    }
+    REQUIRE(IntrusiveNode::alive == 0);
+}
+
+TEST_CASE("Bounded increments") {
+    auto& collector = CycleCollector::Global();
+    collector.Collect();
+
+    SECTION("Garbage rings") {
+        for (int i = 0; i < 10; ++i) {
+            MakeRing(5);
+        }
+        REQUIRE(collector.NumBuffered() == 50);
+        int steps = 0;
+        CollectStats stats;
+        do {
+            stats = collector.CollectStep(8);
+            ++steps;
+        } while (!stats.done);
+        REQUIRE(stats.roots == 50);
+        REQUIRE(stats.traced == 50);
+        REQUIRE(stats.freed == 50);
+        // Taking the roots, tracing and scanning each node is work
+        REQUIRE(steps >= 150 / 8);
+    }
+
+    SECTION("Live list behind one root") {
+        auto head = MakeCollectable<Node>();
+        auto tail = head;
+        for (int i = 0; i < 1000; ++i) {
+            tail->next = MakeCollectable<Node>();
+            tail = tail->next;
+        }
+        tail = nullptr;
+        collector.Collect();
+        {
+            auto copy = head;
+        }
+        REQUIRE(collector.NumBuffered() == 1);
+
+        int steps = 0;
+        CollectStats stats;
+        do {
+            stats = collector.CollectStep(100);
+            ++steps;
+        } while (!stats.done);
+        REQUIRE(stats.roots == 1);
+        REQUIRE(stats.traced == 1001);
+        REQUIRE(stats.freed == 0);
+        REQUIRE(steps > 10);
+        REQUIRE(Node::alive == 1001);
+        REQUIRE(head.UseCount() == 1);
+
+        while (head) {
+            head = SharedPtr<Node>(head->next);
+        }
+    }
+
+    SECTION("Graph changes between steps") {
+        auto ring = MakeRing(2);
+        REQUIRE(collector.NumBuffered() == 2);
+
+        // Both roots are taken and traced
+        REQUIRE(!collector.CollectStep(4).done);
+
+        // Moving the edge out of the ring changes no count, so the edges seen by the collector
+        // are stale: by them the ring has no references from outside
+        SharedPtr<Node> outside = std::move(ring->next);
+        ring = nullptr;
+
+        auto stats = collector.CollectStep(1000);
+        REQUIRE(stats.done);
+        REQUIRE(stats.freed == 0);
+        REQUIRE(Node::alive == 2);
+        REQUIRE(!outside->next->next);
+        outside = nullptr;
+    }
+
+    REQUIRE(collector.Collect().done);
+    REQUIRE(collector.NumBuffered() == 0);
+    REQUIRE(Node::alive == 0);
+}
+
+TEST_CASE("Dead roots leave the buffer") {
+    auto& collector = CycleCollector::Global();
+    collector.Collect();
+
+    std::vector<SharedPtr<Node>> nodes;
+    for (int i = 0; i < 100; ++i) {
+        auto node = MakeCollectable<Node>();
+        auto copy = node;
+        nodes.push_back(node);
+    }
+    REQUIRE(collector.NumBuffered() == 100);
+    nodes.clear();
+    REQUIRE(collector.NumBuffered() == 0);
+    REQUIRE(collector.Collect().roots == 0);
+}
+
+TEST_CASE("Releases from several threads") {
+    auto& collector = CycleCollector::Global();
+    collector.Collect();
+
+    // Every thread holds every node and lets go of them at once with the others; half of the
+    // nodes are in rings of two
+    const int threads = 4;
+    std::vector<std::vector<SharedPtr<Node>>> copies(threads);
+    for (int i = 0; i < 10'000; ++i) {
+        auto node = i % 2 == 0 ? MakeCollectable<Node>() : MakeRing(2);
+        for (auto& copy : copies) {
+            copy.push_back(node);
+        }
+    }
+
+    std::atomic<int> ready = 0;
+    std::vector<std::thread> workers;
+    for (auto& copy : copies) {
+        workers.emplace_back([&copy, &ready] {
+            ++ready;
+            while (ready != threads) {
+            }
+            copy.clear();
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    REQUIRE(Node::alive == 5'000 * 2);
+
+    REQUIRE(collector.Collect().freed == 5'000 * 2);
+    REQUIRE(collector.NumBuffered() == 0);
+    REQUIRE(Node::alive == 0);
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+
+#include <atomic>
+#include <cstdint>  // uint64_t
+#include <cstdlib>  // std::atexit
+#include <thread>
+#include <utility>  // std::exchange, std::forward
+
+#include <common/sized_delete.h>
+
+// Destruction moved off the releasing thread: objects whose last reference is dropped are pushed
+// onto a lock-free queue and destroyed by a background thread, so releasing a large structure
+// costs the releasing thread one push instead of the whole destructor cascade.
+//
+// Policies: `MakeSharedDeferred<T>` for `SharedPtr` (the control block itself is queued),
+// `DeferredDelete` as the deleter of `RefCounted` or `UniquePtr` (a small node is allocated).
+//
+// At exit the background thread drains the queue and is joined. Whatever is released after that
+// (by later static destructors) is destroyed right away on the releasing thread.
+class DeferredReclaimer {
+public:
+    // Link in the queue, embedded into whatever is queued.
+    struct Item {
+        Item* next = nullptr;
+        void (*reclaim)(Item*) = nullptr;
+    };
+
+    static DeferredReclaimer& Global() {
+        static DeferredReclaimer* reclaimer = [] {
+            auto reclaimer = new DeferredReclaimer();
+            std::atexit([] { Global().Shutdown(); });
+            return reclaimer;
+        }();
+        return *reclaimer;
+    }
+
+    // `item->reclaim(item)` will be called on the background thread.
+    void Push(Item* item) {
+        // Counted first, so that `reclaimed_` never gets ahead of it
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+        if (reclaiming_) {
+            // From a destructor run by the reclaimer: destroyed right after it
+            item->next = cascade_;
+            cascade_ = item;
+            return;
+        }
+        Enqueue(item);
+        if (stopped_.load(std::memory_order_acquire)) {
+            Drain();
+        }
+    }
+
+    // Waits until everything pushed before the call (and everything that pushes in turn) is
+    // destroyed, but not for what is pushed after it. Must not be called from a destructor run by
+    // the reclaimer.
+    void Flush() {
+        if (stopped_.load(std::memory_order_acquire)) {
+            return;
+        }
+        FlushMarker marker;
+        marker.reclaim = &FlushMarker::Tag;
+        Enqueue(&marker);
+        while (!marker.done.load(std::memory_order_acquire)) {
+            marker.done.wait(false, std::memory_order_acquire);
+        }
+    }
+
+    // Items waiting to be destroyed
+    uint64_t Pending() const {
+        uint64_t reclaimed = reclaimed_.load(std::memory_order_acquire);
+        return pushed_.load(std::memory_order_acquire) - reclaimed;
+    }
+
+private:
+    // Queued by `Flush`, done when the reclaimer gets to it. Whatever the items before it push
+    // is destroyed before the reclaimer moves on, so it's done by then too.
+    struct FlushMarker : Item {
+        static void Tag(Item*) {
+        }
+
+        std::atomic<bool> done = false;
+    };
+
+    DeferredReclaimer() : thread_([this] { Run(); }) {
+    }
+
+    void Enqueue(Item* item) {
+        Item* head = head_.load(std::memory_order_relaxed);
+        do {
+            item->next = head;
+        } while (!head_.compare_exchange_weak(head, item, std::memory_order_release,
+                                              std::memory_order_relaxed));
+        if (head == nullptr) {
+            // The queue was empty, the thread may be asleep
+            Wake();
+        }
+    }
+
+    void Wake() {
+        wakeups_.fetch_add(1, std::memory_order_release);
+        wakeups_.notify_one();
+    }
+
+    void Run() {
+        reclaiming_ = true;
+        while (true) {
+            uint64_t wakeups = wakeups_.load(std::memory_order_acquire);
+            Item* batch = head_.exchange(nullptr, std::memory_order_acquire);
+            if (batch != nullptr) {
+                Reclaim(batch);
+            } else if (stopping_.load(std::memory_order_acquire)) {
+                return;
+            } else {
+                wakeups_.wait(wakeups, std::memory_order_acquire);
+            }
+        }
+    }
+
+    // Runs at exit: static objects destroyed from now on may still release deferred objects.
+    void Shutdown() {
+        stopping_.store(true, std::memory_order_release);
+        Wake();
+        thread_.join();
+        stopped_.store(true, std::memory_order_release);
+        // Pushed after the thread saw the queue empty for the last time
+        Drain();
+    }
+
+    // Reclaims on the calling thread until the queue is empty.
+    void Drain() {
+        reclaiming_ = true;
+        while (Item* batch = head_.exchange(nullptr, std::memory_order_acquire)) {
+            Reclaim(batch);
+        }
+        reclaiming_ = false;
+    }
+
+    void Reclaim(Item* batch) {
+        // The stack is in reverse order of pushes
+        Item* ordered = nullptr;
+        while (batch != nullptr) {
+            Item* next = batch->next;
+            batch->next = ordered;
+            ordered = batch;
+            batch = next;
+        }
+        uint64_t count = 0;
+        while (ordered != nullptr) {
+            Item* next = ordered->next;
+            if (ordered->reclaim == &FlushMarker::Tag) {
+                reclaimed_.fetch_add(std::exchange(count, 0), std::memory_order_release);
+                auto marker = static_cast<FlushMarker*>(ordered);
+                marker->done.store(true, std::memory_order_release);
+                marker->done.notify_all();
+            } else {
+                ordered->reclaim(ordered);
+                ++count;
+                // Depth first, so that the stack of cascades stays as small as the pushes
+                while (cascade_ != nullptr) {
+                    Item* item = std::exchange(cascade_, cascade_->next);
+                    item->reclaim(item);
+                    ++count;
+                }
+            }
+            ordered = next;
+        }
+        reclaimed_.fetch_add(count, std::memory_order_release);
+    }
+
+    // Set on the thread that is reclaiming, so that pushes from destructors are told apart
+    static inline thread_local bool reclaiming_ = false;
+    // Pushes from destructors run by the reclaiming thread
+    static inline thread_local Item* cascade_ = nullptr;
+
+    std::atomic<Item*> head_ = nullptr;
+    std::atomic<uint64_t> pushed_ = 0;
+    std::atomic<uint64_t> reclaimed_ = 0;
+    std::atomic<uint64_t> wakeups_ = 0;
+    std::atomic<bool> stopping_ = false;
+    std::atomic<bool> stopped_ = false;
+    std::thread thread_;
+};
+
+// Control block of `MakeSharedDeferred`: the last `DecreaseStrong` queues the block, and the
+// reclaimer destroys the object and drops the collective weak reference.
+template <typename T>
+class ControlBlockDeferred : public ControlBlockBasic, DeferredReclaimer::Item {
+public:
+    template <typename... Args>
+    ControlBlockDeferred(Args&&... args) {
+        new (&x) T(std::forward<Args>(args)...);
+        ++strong_cnt;
+        reclaim = [](DeferredReclaimer::Item* item) {
+            auto self = static_cast<ControlBlockDeferred*>(item);
+            self->DestroyObject();
+            self->DecreaseWeak();
+        };
+    }
+    void DecreaseStrong() override {
+        if (strong_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            DeferredReclaimer::Global().Push(this);
+        }
+    }
+    void DestroyObject() override {
+        Get()->~T();
+    }
+    T* Get() {
+        return reinterpret_cast<T*>(&x);
+    }
+
+    alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
+};
+
+template <typename T, typename... Args>
+SharedPtr<T> MakeSharedDeferred(Args&&... args) {
+    auto block = new ControlBlockDeferred<T>(std::forward<Args>(args)...);
+    return SharedPtr<T>(block, block->Get());
+}
+
+// Deleter for `RefCounted` (`Destroy`) and `UniquePtr` (`operator()`) that hands the object to
+// the reclaimer, which deletes it with `SizedDelete`.
+struct DeferredDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        struct Node : DeferredReclaimer::Item {
+            T* object;
+        };
+        auto node = new Node();
+        node->object = object;
+        node->reclaim = [](DeferredReclaimer::Item* item) {
+            auto self = static_cast<Node*>(item);
+            SizedDelete(self->object);
+            delete self;
+        };
+        DeferredReclaimer::Global().Push(node);
+    }
+
+    template <typename T>
+    void operator()(T* object) const {
+        Destroy(object);
+    }
+};
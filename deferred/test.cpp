@@ -0,0 +1,139 @@
+#include "deferred.h"
+
+#include <common/tracked.h>
+#include <intrusive/intrusive.h>
+#include <shared-from-this/weak.h>
+#include <unique/unique.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Remembers the thread that destroyed it last
+struct Remembering : Tracked {
+    ~Remembering() {
+        destroyed_on = std::this_thread::get_id();
+    }
+
+    inline static std::thread::id destroyed_on;
+};
+
+struct TreeNode : Remembering {
+    std::vector<SharedPtr<TreeNode>> children;
+};
+
+struct Intrusive : Remembering, SimpleRefCounted<Intrusive, DeferredDelete> {};
+
+}  // namespace
+
+TEST_CASE("MakeSharedDeferred") {
+    auto& reclaimer = DeferredReclaimer::Global();
+    reclaimer.Flush();
+
+    auto ptr = MakeSharedDeferred<Remembering>();
+    WeakPtr<Remembering> weak = ptr;
+    auto copy = ptr;
+    ptr = SharedPtr<Remembering>();
+    REQUIRE(Tracked::alive == 1);
+    copy = SharedPtr<Remembering>();
+    REQUIRE(weak.Expired());
+
+    reclaimer.Flush();
+    REQUIRE(Tracked::alive == 0);
+    REQUIRE(Remembering::destroyed_on != std::this_thread::get_id());
+    REQUIRE(reclaimer.Pending() == 0);
+}
+
+TEST_CASE("Cascades are flushed") {
+    auto& reclaimer = DeferredReclaimer::Global();
+    {
+        // Deferred nodes all the way down: each level is pushed by the reclaimer itself
+        auto root = MakeSharedDeferred<TreeNode>();
+        std::vector<SharedPtr<TreeNode>> level{root};
+        for (int depth = 0; depth < 4; ++depth) {
+            std::vector<SharedPtr<TreeNode>> next;
+            for (auto& node : level) {
+                for (int i = 0; i < 4; ++i) {
+                    node->children.push_back(MakeSharedDeferred<TreeNode>());
+                    next.push_back(node->children.back());
+                }
+            }
+            level = std::move(next);
+        }
+    }
+    reclaimer.Flush();
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("DeferredDelete") {
+    auto& reclaimer = DeferredReclaimer::Global();
+
+    SECTION("RefCounted") {
+        IntrusivePtr<Intrusive> ptr(new Intrusive());
+        auto copy = ptr;
+        ptr.Reset();
+        copy.Reset();
+        reclaimer.Flush();
+    }
+
+    SECTION("UniquePtr") {
+        UniquePtr<Remembering, DeferredDelete> ptr(new Remembering());
+        ptr.Reset();
+        reclaimer.Flush();
+    }
+    REQUIRE(Tracked::alive == 0);
+    REQUIRE(Remembering::destroyed_on != std::this_thread::get_id());
+}
+
+TEST_CASE("Releases from many threads") {
+    auto& reclaimer = DeferredReclaimer::Global();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            for (int i = 0; i < 1000; ++i) {
+                auto ptr = MakeSharedDeferred<Remembering>();
+                auto copy = ptr;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    reclaimer.Flush();
+    REQUIRE(Tracked::alive == 0);
+    REQUIRE(reclaimer.Pending() == 0);
+}
+
+TEST_CASE("Flush while others keep pushing") {
+    auto& reclaimer = DeferredReclaimer::Global();
+    std::atomic<bool> stop = false;
+    std::thread pusher([&stop] {
+        while (!stop.load()) {
+            auto ptr = MakeSharedDeferred<TreeNode>();
+            ptr->children.push_back(MakeSharedDeferred<TreeNode>());
+            ptr = SharedPtr<TreeNode>();
+            // Slower than the reclaimer, or every flush would wait for a longer backlog
+            std::this_thread::yield();
+        }
+    });
+
+    auto ptr = MakeSharedDeferred<Remembering>();
+    WeakPtr<Remembering> weak = ptr;
+    ptr = SharedPtr<Remembering>();
+    for (int i = 0; i < 100; ++i) {
+        reclaimer.Flush();
+    }
+    REQUIRE(weak.Expired());
+
+    stop = true;
+    pusher.join();
+    reclaimer.Flush();
+    REQUIRE(Tracked::alive == 0);
+    REQUIRE(reclaimer.Pending() == 0);
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+
+#include <atomic>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint64_t
+#include <mutex>
+#include <utility>  // std::forward
+#include <vector>
+
+// Epoch-based reclamation.
+// Readers pin the current epoch for the duration of a `Guard`; while pinned, they may
+// dereference raw pointers loaded from shared structures. Retired objects go into a per-thread
+// limbo list tagged with the epoch they were retired in, and are freed once the global epoch has
+// advanced twice since: by then every reader that could have seen them has unpinned.
+// The epoch only advances when every pinned thread has observed the current one.
+class EpochDomain {
+    struct Retired {
+        void* ptr;
+        void (*reclaim)(void*);
+    };
+
+    struct Limbo {
+        uint64_t epoch = 0;
+        std::vector<Retired> objects;
+    };
+
+    struct ThreadRecord {
+        // (epoch << 1) | pinned
+        std::atomic<uint64_t> state = 0;
+        std::atomic<bool> in_use = false;
+        ThreadRecord* next = nullptr;
+
+        size_t nesting = 0;
+        size_t retired_since_collect = 0;
+        Limbo limbo[3];
+    };
+
+    // Releases the record of the current thread when it exits.
+    struct LocalRecord {
+        ~LocalRecord() {
+            if (record != nullptr) {
+                Global().Unregister(record);
+            }
+        }
+
+        ThreadRecord* record = nullptr;
+    };
+
+public:
+    class Guard {
+    public:
+        Guard() {
+            Global().Pin();
+        }
+        ~Guard() {
+            Global().Unpin();
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    // The process-wide domain. It is never destroyed, so threads can retire objects at any point,
+    // including their own exit.
+    static EpochDomain& Global() {
+        static EpochDomain* domain = new EpochDomain();
+        return *domain;
+    }
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    // Schedules `reclaim(ptr)` for when no reader can hold `ptr` anymore.
+    void Retire(void* ptr, void (*reclaim)(void*)) {
+        ThreadRecord* record = Local();
+        uint64_t epoch = epoch_.load(std::memory_order_acquire);
+        Limbo& limbo = record->limbo[epoch % 3];
+        if (limbo.epoch != epoch) {
+            // Retired at least three epochs ago
+            Free(limbo);
+            limbo.epoch = epoch;
+        }
+        limbo.objects.push_back({ptr, reclaim});
+        if (++record->retired_since_collect >= kCollectEvery && record->nesting == 0) {
+            Collect(record);
+        }
+    }
+
+    template <typename T>
+    void Retire(T* ptr) {
+        Retire(ptr, [](void* object) { delete static_cast<T*>(object); });
+    }
+
+    // Tries to advance the epoch and frees everything of the current thread (and of the exited
+    // threads) that is old enough. Returns whether the epoch advanced.
+    bool TryAdvance() {
+        uint64_t epoch = epoch_.load(std::memory_order_acquire);
+        for (auto record = records_.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            uint64_t state = record->state.load(std::memory_order_acquire);
+            if ((state & 1) && (state >> 1) != epoch) {
+                return false;
+            }
+        }
+        return epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+    }
+
+    // Waits until everything retired by this thread and by the exited threads so far is freed.
+    // The calling thread must not be pinned; spins while other threads stay pinned.
+    void Barrier() {
+        ThreadRecord* record = Local();
+        uint64_t target = epoch_.load(std::memory_order_acquire) + 2;
+        while (epoch_.load(std::memory_order_acquire) < target) {
+            TryAdvance();
+        }
+        Collect(record);
+    }
+
+    uint64_t Epoch() const {
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t kCollectEvery = 64;
+
+    EpochDomain() = default;
+
+    void Pin() {
+        ThreadRecord* record = Local();
+        if (record->nesting++ == 0) {
+            uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+            record->state.store((epoch << 1) | 1, std::memory_order_relaxed);
+            // The pin has to be visible before any pointer is loaded
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void Unpin() {
+        ThreadRecord* record = Local();
+        if (--record->nesting == 0) {
+            record->state.store(0, std::memory_order_release);
+        }
+    }
+
+    ThreadRecord* Local() {
+        thread_local LocalRecord local;
+        if (local.record == nullptr) {
+            local.record = Register();
+        }
+        return local.record;
+    }
+
+    ThreadRecord* Register() {
+        for (auto record = records_.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            bool free = false;
+            if (record->in_use.compare_exchange_strong(free, true)) {
+                return record;
+            }
+        }
+        auto record = new ThreadRecord();
+        record->in_use.store(true, std::memory_order_relaxed);
+        record->next = records_.load(std::memory_order_relaxed);
+        while (!records_.compare_exchange_weak(record->next, record, std::memory_order_acq_rel)) {
+        }
+        return record;
+    }
+
+    // Hands whatever the exiting thread couldn't free yet over to the orphan list.
+    void Unregister(ThreadRecord* record) {
+        Collect(record);
+        {
+            std::lock_guard guard(orphans_mutex_);
+            for (auto& limbo : record->limbo) {
+                if (!limbo.objects.empty()) {
+                    orphans_.push_back(std::move(limbo));
+                    limbo = Limbo();
+                }
+            }
+        }
+        record->retired_since_collect = 0;
+        record->state.store(0, std::memory_order_release);
+        record->in_use.store(false, std::memory_order_release);
+    }
+
+    void Collect(ThreadRecord* record) {
+        record->retired_since_collect = 0;
+        TryAdvance();
+        uint64_t epoch = epoch_.load(std::memory_order_acquire);
+        for (auto& limbo : record->limbo) {
+            if (limbo.epoch + 2 <= epoch) {
+                Free(limbo);
+            }
+        }
+
+        std::vector<Limbo> ready;
+        {
+            std::lock_guard guard(orphans_mutex_);
+            for (size_t i = 0; i < orphans_.size();) {
+                if (orphans_[i].epoch + 2 <= epoch) {
+                    ready.push_back(std::move(orphans_[i]));
+                    orphans_[i] = std::move(orphans_.back());
+                    orphans_.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+        }
+        for (auto& limbo : ready) {
+            Free(limbo);
+        }
+    }
+
+    // Reclaiming may retire more objects (e.g. a node releasing its successor),
+    // so the list is swapped out first.
+    static void Free(Limbo& limbo) {
+        std::vector<Retired> objects;
+        objects.swap(limbo.objects);
+        for (auto& object : objects) {
+            object.reclaim(object.ptr);
+        }
+    }
+
+    std::atomic<uint64_t> epoch_ = 0;
+    std::atomic<ThreadRecord*> records_ = nullptr;
+    std::mutex orphans_mutex_;
+    std::vector<Limbo> orphans_;
+};
+
+// Control block of `MakeEpochShared`: when the last strong reference is dropped, destroying
+// the object is deferred until no reader pinned in `EpochDomain::Global()` can reach it.
+// Pinned readers may hold raw pointers to the object without owning it; to take ownership they
+// use `TryIncreaseStrong`, which fails once the object is retired.
+template <typename T>
+class ControlBlockEpoch : public ControlBlockBasic {
+public:
+    template <typename... Args>
+    ControlBlockEpoch(Args&&... args) {
+        new (&x) T(std::forward<Args>(args)...);
+        ++strong_cnt;
+    }
+    void DecreaseStrong() override {
+        if (strong_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            EpochDomain::Global().Retire(this, [](void* block) {
+                auto self = static_cast<ControlBlockEpoch*>(block);
+                self->DestroyObject();
+                self->DecreaseWeak();
+            });
+        }
+    }
+    void DestroyObject() override {
+        Get()->~T();
+    }
+    T* Get() {
+        return reinterpret_cast<T*>(&x);
+    }
+
+    alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
+};
+
+template <typename T, typename... Args>
+SharedPtr<T> MakeEpochShared(Args&&... args) {
+    auto block = new ControlBlockEpoch<T>(std::forward<Args>(args)...);
+    return SharedPtr<T>(block, block->Get());
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "epoch.h"
+
+#include <atomic>
+#include <cstddef>  // size_t
+#include <cstdint>  // uintptr_t
+#include <utility>  // std::pair
+
+// Lock-free sorted set of keys with values (Harris-Michael list).
+// Nodes are `MakeEpochShared` objects; the list holds one strong reference to every linked node
+// and drops it when the node is unlinked, so the node is reclaimed through the epoch domain once
+// no reader can reach it. Readers traverse raw pointers inside an `EpochDomain::Guard` and never
+// touch the counters, except to hand out a `SharedPtr` to a found value.
+// Keys are compared with `operator<`.
+template <typename K, typename V>
+class LockFreeSortedList {
+    struct Node {
+        template <typename... Args>
+        Node(const K& key, Args&&... args) : key(key), value(std::forward<Args>(args)...) {
+        }
+
+        K key;
+        V value;
+        // Next block, with the lowest bit set once this node is logically deleted
+        std::atomic<uintptr_t> next = 0;
+    };
+
+    using Block = ControlBlockEpoch<Node>;
+
+    static constexpr uintptr_t kMark = 1;
+
+    static Block* BlockOf(uintptr_t link) {
+        return reinterpret_cast<Block*>(link & ~kMark);
+    }
+    static uintptr_t LinkTo(Block* block) {
+        return reinterpret_cast<uintptr_t>(block);
+    }
+    static bool Equal(const K& left, const K& right) {
+        return !(left < right) && !(right < left);
+    }
+
+public:
+    LockFreeSortedList() {
+    }
+    LockFreeSortedList(const LockFreeSortedList&) = delete;
+    LockFreeSortedList& operator=(const LockFreeSortedList&) = delete;
+
+    // No operation may run concurrently with the destructor.
+    ~LockFreeSortedList() {
+        Block* curr = BlockOf(head_.load(std::memory_order_acquire));
+        while (curr != nullptr) {
+            Block* next = BlockOf(curr->Get()->next.load(std::memory_order_relaxed));
+            curr->DecreaseStrong();
+            curr = next;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    // Inserts `V(args...)` unless `key` is already there.
+    template <typename... Args>
+    bool Insert(const K& key, Args&&... args) {
+        EpochDomain::Guard guard;
+        auto node = MakeEpochShared<Node>(key, std::forward<Args>(args)...);
+        auto block = static_cast<Block*>(node.buffer);
+        while (true) {
+            auto [pred, curr] = Search(key);
+            if (curr != nullptr && Equal(curr->Get()->key, key)) {
+                return false;
+            }
+            node->next.store(LinkTo(curr), std::memory_order_relaxed);
+            uintptr_t expected = LinkTo(curr);
+            if (pred->compare_exchange_strong(expected, LinkTo(block), std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+                // The reference now belongs to the list
+                node.buffer = nullptr, node.x = nullptr;
+                size_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+
+    bool Remove(const K& key) {
+        EpochDomain::Guard guard;
+        while (true) {
+            auto [pred, curr] = Search(key);
+            if (curr == nullptr || !Equal(curr->Get()->key, key)) {
+                return false;
+            }
+            auto& next = curr->Get()->next;
+            uintptr_t succ = next.load(std::memory_order_acquire);
+            if ((succ & kMark) != 0) {
+                // Somebody else is removing it, search again to help
+                continue;
+            }
+            if (!next.compare_exchange_strong(succ, succ | kMark, std::memory_order_acq_rel)) {
+                continue;
+            }
+            size_.fetch_sub(1, std::memory_order_relaxed);
+            uintptr_t expected = LinkTo(curr);
+            if (pred->compare_exchange_strong(expected, succ, std::memory_order_acq_rel)) {
+                curr->DecreaseStrong();
+            } else {
+                Search(key);
+            }
+            return true;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    // Shares ownership of the node, so the value stays alive after it is removed.
+    SharedPtr<const V> Find(const K& key) const {
+        EpochDomain::Guard guard;
+        Block* curr = LowerBound(key);
+        if (curr == nullptr || !Equal(curr->Get()->key, key) || IsDeleted(curr) ||
+            !curr->TryIncreaseStrong()) {
+            return SharedPtr<const V>();
+        }
+        return SharedPtr<const V>(curr, &curr->Get()->value);
+    }
+
+    bool Contains(const K& key) const {
+        EpochDomain::Guard guard;
+        Block* curr = LowerBound(key);
+        return curr != nullptr && Equal(curr->Get()->key, key) && !IsDeleted(curr);
+    }
+
+    // Calls `callback(const K&, const V&)` for every node in order. Nodes inserted or removed
+    // concurrently may or may not be visited.
+    template <typename F>
+    void ForEach(F&& callback) const {
+        EpochDomain::Guard guard;
+        for (Block* curr = BlockOf(head_.load(std::memory_order_acquire)); curr != nullptr;
+             curr = BlockOf(curr->Get()->next.load(std::memory_order_acquire))) {
+            if (!IsDeleted(curr)) {
+                callback(curr->Get()->key, curr->Get()->value);
+            }
+        }
+    }
+
+    // Exact when there are no concurrent modifications.
+    size_t Size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static bool IsDeleted(Block* block) {
+        return (block->Get()->next.load(std::memory_order_acquire) & kMark) != 0;
+    }
+
+    // First node with key >= `key`, deleted or not. Wait-free.
+    Block* LowerBound(const K& key) const {
+        Block* curr = BlockOf(head_.load(std::memory_order_acquire));
+        while (curr != nullptr && curr->Get()->key < key) {
+            curr = BlockOf(curr->Get()->next.load(std::memory_order_acquire));
+        }
+        return curr;
+    }
+
+    // Finds the first live node with key >= `key` and the link pointing to it,
+    // unlinking the deleted nodes on the way.
+    std::pair<std::atomic<uintptr_t>*, Block*> Search(const K& key) {
+        while (true) {
+            std::atomic<uintptr_t>* pred = &head_;
+            Block* curr = BlockOf(pred->load(std::memory_order_acquire));
+            bool restart = false;
+            while (curr != nullptr) {
+                uintptr_t next = curr->Get()->next.load(std::memory_order_acquire);
+                if ((next & kMark) != 0) {
+                    uintptr_t expected = LinkTo(curr);
+                    if (!pred->compare_exchange_strong(expected, next & ~kMark,
+                                                       std::memory_order_acq_rel)) {
+                        // `pred` changed or got deleted itself
+                        restart = true;
+                        break;
+                    }
+                    curr->DecreaseStrong();
+                    curr = BlockOf(next);
+                    continue;
+                }
+                if (!(curr->Get()->key < key)) {
+                    break;
+                }
+                pred = &curr->Get()->next;
+                curr = BlockOf(next);
+            }
+            if (!restart) {
+                return {pred, curr};
+            }
+        }
+    }
+
+    std::atomic<uintptr_t> head_ = 0;
+    std::atomic<size_t> size_ = 0;
+};
@@ -0,0 +1,154 @@
+#include "lock_free_list.h"
+
+#include <common/tracked.h>
+#include <shared-from-this/weak.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("EpochDomain") {
+    auto& domain = EpochDomain::Global();
+    domain.Barrier();
+
+    SECTION("Retired objects are freed after two epochs") {
+        int alive = Tracked::alive;
+        domain.Retire(new Tracked(1));
+        REQUIRE(Tracked::alive == alive + 1);
+        domain.Barrier();
+        REQUIRE(Tracked::alive == alive);
+    }
+
+    SECTION("Pinned readers hold the epoch back") {
+        int alive = Tracked::alive;
+        std::atomic<int> step = 0;
+        std::thread reader([&] {
+            EpochDomain::Guard guard;
+            step = 1;
+            while (step != 2) {
+            }
+        });
+        while (step != 1) {
+        }
+
+        uint64_t epoch = domain.Epoch();
+        domain.Retire(new Tracked(1));
+        domain.TryAdvance();
+        domain.TryAdvance();
+        REQUIRE(domain.Epoch() <= epoch + 1);
+        REQUIRE(Tracked::alive == alive + 1);
+
+        step = 2;
+        reader.join();
+        domain.Barrier();
+        REQUIRE(Tracked::alive == alive);
+    }
+
+    SECTION("Objects retired by exited threads") {
+        int alive = Tracked::alive;
+        std::thread([] { EpochDomain::Global().Retire(new Tracked(1)); }).join();
+        domain.Barrier();
+        REQUIRE(Tracked::alive == alive);
+    }
+}
+
+TEST_CASE("MakeEpochShared") {
+    auto& domain = EpochDomain::Global();
+    int alive = Tracked::alive;
+    {
+        auto ptr = MakeEpochShared<Tracked>(1);
+        WeakPtr<Tracked> weak(ptr);
+        ptr.Reset();
+        // Destruction is deferred, but the object is already unreachable for new owners
+        REQUIRE(Tracked::alive == alive + 1);
+        REQUIRE(weak.Expired());
+        REQUIRE(weak.Lock().Get() == nullptr);
+    }
+    domain.Barrier();
+    REQUIRE(Tracked::alive == alive);
+}
+
+TEST_CASE("LockFreeSortedList") {
+    auto& domain = EpochDomain::Global();
+    int alive = Tracked::alive;
+
+    SECTION("Single thread") {
+        {
+            LockFreeSortedList<int, Tracked> list;
+            REQUIRE(list.Insert(3, 30));
+            REQUIRE(list.Insert(1, 10));
+            REQUIRE(list.Insert(2, 20));
+            REQUIRE(!list.Insert(2, 21));
+            REQUIRE(list.Size() == 3);
+
+            std::vector<int> keys;
+            list.ForEach([&keys](int key, const Tracked&) { keys.push_back(key); });
+            REQUIRE(keys == std::vector<int>{1, 2, 3});
+
+            REQUIRE(list.Find(2)->value == 20);
+            REQUIRE(list.Find(4).Get() == nullptr);
+
+            auto found = list.Find(1);
+            REQUIRE(list.Remove(1));
+            REQUIRE(!list.Remove(1));
+            REQUIRE(!list.Contains(1));
+            REQUIRE(list.Size() == 2);
+            domain.Barrier();
+            // Still owned by `found`
+            REQUIRE(found->value == 10);
+        }
+        domain.Barrier();
+        REQUIRE(Tracked::alive == alive);
+    }
+
+    SECTION("Concurrent inserts and removes") {
+        constexpr int kThreads = 4;
+        constexpr int kKeys = 2000;
+        {
+            LockFreeSortedList<int, Tracked> list;
+            std::atomic<int> errors = 0;
+            std::vector<std::thread> threads;
+            for (int t = 0; t < kThreads; ++t) {
+                threads.emplace_back([&, t] {
+                    // Every thread owns the keys equal to `t` modulo kThreads
+                    for (int key = t; key < kKeys; key += kThreads) {
+                        if (!list.Insert(key, key)) {
+                            ++errors;
+                        }
+                    }
+                    for (int key = t; key < kKeys; key += 2 * kThreads) {
+                        if (!list.Remove(key)) {
+                            ++errors;
+                        }
+                    }
+                    // Readers of everybody's keys
+                    for (int key = 0; key < kKeys; ++key) {
+                        if (auto value = list.Find(key); value && value->value != key) {
+                            ++errors;
+                        }
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+
+            REQUIRE(errors == 0);
+            REQUIRE(list.Size() == kKeys / 2);
+            int prev = -1;
+            list.ForEach([&](int key, const Tracked& value) {
+                REQUIRE(key > prev);
+                REQUIRE(value.value == key);
+                REQUIRE(key % (2 * kThreads) >= kThreads);
+                prev = key;
+            });
+        }
+        domain.Barrier();
+        REQUIRE(Tracked::alive == alive);
+    }
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <common/type_name.h>
+
+#include <unistd.h>  // getpid
+
+#include <algorithm>
+#include <atomic>
+#include <bit>      // std::bit_ceil
+#include <chrono>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t, uint64_t
+#include <cstdio>   // std::snprintf
+#include <cstdlib>  // std::atexit, std::getenv
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+// Timeline of smart pointer lifecycle events in the Chrome trace format, which chrome://tracing
+// and ui.perfetto.dev open.
+//
+// Compiled in with `SMART_PTR_EVENT_TRACER` defined: then `MakeShared`, `MakeIntrusive`, the last
+// `ControlBlockBasic::DecreaseStrong` and `RefCounted::DecRef`, and `UniquePtr::Delete` record
+// spans, so the destruction of a graph shows up as nested spans. Own code can add its spans with
+// `EventTracer::Span`. Recording is off until `Enable()`; while it's off, a span costs a relaxed
+// load.
+//
+// Every thread writes into its own ring buffer of `BufferSize()` events, overwriting the oldest
+// ones; writes take no locks. Buffers of finished threads are handed to new ones. `WriteJson` may
+// run concurrently with the writers and skips the events that were overwritten while it read them.
+//
+// With the `SMART_PTR_TRACE_FILE` environment variable set, recording starts with the program and
+// the trace is written to that file at exit.
+class EventTracer {
+public:
+    struct Event {
+        const char* name = nullptr;
+        // Null for the spans of own code that didn't pass one
+        const std::type_info* type = nullptr;
+        uint32_t thread = 0;
+        // Nanoseconds of `steady_clock`
+        uint64_t begin = 0;
+        uint64_t duration = 0;
+    };
+
+    // Records the time from its construction to its destruction, if the tracer was enabled at
+    // construction.
+    class Span {
+    public:
+        Span(const char* name, const std::type_info& type) : Span(name, &type) {
+        }
+        explicit Span(const char* name, const std::type_info* type = nullptr) {
+            if (Enabled()) {
+                name_ = name, type_ = type, begin_ = Now();
+            }
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+        ~Span() {
+            if (name_ != nullptr) {
+                Global().Local().Push(name_, type_, begin_, Now() - begin_);
+            }
+        }
+
+    private:
+        const char* name_ = nullptr;
+        const std::type_info* type_ = nullptr;
+        uint64_t begin_ = 0;
+    };
+
+    static EventTracer& Global() {
+        static EventTracer* tracer = new EventTracer();
+        return *tracer;
+    }
+
+    EventTracer(const EventTracer&) = delete;
+    EventTracer& operator=(const EventTracer&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Settings
+
+    static bool Enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    void Enable() {
+        enabled_.store(true, std::memory_order_relaxed);
+    }
+    void Disable() {
+        enabled_.store(false, std::memory_order_relaxed);
+    }
+
+    // Capacity of the buffers of the threads that haven't recorded anything yet, in events;
+    // rounded up to a power of two.
+    void SetBufferSize(size_t events) {
+        buffer_size_.store(std::bit_ceil(std::max<size_t>(events, 1)), std::memory_order_relaxed);
+    }
+    size_t BufferSize() const {
+        return buffer_size_.load(std::memory_order_relaxed);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Export
+
+    // The events in the buffers, ordered by start.
+    std::vector<Event> Events() const {
+        std::vector<Event> res;
+        std::lock_guard lock(mutex_);
+        for (auto& buffer : buffers_) {
+            buffer->Read(res);
+        }
+        std::sort(res.begin(), res.end(), [](const Event& left, const Event& right) {
+            return left.begin < right.begin;
+        });
+        return res;
+    }
+
+    void WriteJson(std::ostream& out) const {
+        auto events = Events();
+        int pid = getpid();
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        for (size_t i = 0; i < events.size(); ++i) {
+            const Event& event = events[i];
+            out << (i == 0 ? "" : ",") << "\n{\"name\":\"" << Escape(event.name)
+                << "\",\"cat\":\"smart_ptr\",\"ph\":\"X\",";
+            // Only numbers go through the buffer; names of own spans can be of any length
+            char numbers[96];
+            std::snprintf(numbers, sizeof(numbers),
+                          "\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", pid, event.thread,
+                          event.begin / 1e3, event.duration / 1e3);
+            out << numbers;
+            if (event.type != nullptr) {
+                out << ",\"args\":{\"type\":\"" << Escape(TypeName(*event.type)) << "\"}";
+            }
+            out << "}";
+        }
+        out << "\n]}\n";
+    }
+
+    // Whether the file was written.
+    bool WriteJson(const std::string& path) const {
+        std::ofstream out(path);
+        WriteJson(out);
+        return static_cast<bool>(out);
+    }
+
+    // Drops the events recorded so far.
+    void Clear() {
+        std::lock_guard lock(mutex_);
+        for (auto& buffer : buffers_) {
+            buffer->Clear();
+        }
+    }
+
+private:
+    // Single writer: the owner claims a slot in `begun`, fills it and publishes it in
+    // `committed`. A reader that copied a slot checks `begun` afterwards to see whether the slot
+    // was being overwritten meanwhile.
+    class Buffer {
+    public:
+        Buffer(uint32_t thread, size_t size) : thread_(thread), mask_(size - 1), slots_(size) {
+        }
+
+        void Push(const char* name, const std::type_info* type, uint64_t begin,
+                  uint64_t duration) {
+            uint64_t index = begun_.load(std::memory_order_relaxed);
+            begun_.store(index + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            Slot& slot = slots_[index & mask_];
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.type.store(type, std::memory_order_relaxed);
+            slot.begin.store(begin, std::memory_order_relaxed);
+            slot.duration.store(duration, std::memory_order_relaxed);
+            committed_.store(index + 1, std::memory_order_release);
+        }
+
+        void Read(std::vector<Event>& out) const {
+            uint64_t end = committed_.load(std::memory_order_acquire);
+            uint64_t begin = std::max(start_.load(std::memory_order_relaxed),
+                                      end > slots_.size() ? end - slots_.size() : 0);
+            size_t first = out.size();
+            for (uint64_t i = begin; i < end; ++i) {
+                const Slot& slot = slots_[i & mask_];
+                out.push_back({slot.name.load(std::memory_order_relaxed),
+                               slot.type.load(std::memory_order_relaxed), thread_,
+                               slot.begin.load(std::memory_order_relaxed),
+                               slot.duration.load(std::memory_order_relaxed)});
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Slots below `begun - size` may have been overwritten
+            uint64_t begun = begun_.load(std::memory_order_relaxed);
+            if (begun > begin + slots_.size()) {
+                size_t torn = std::min<uint64_t>(begun - slots_.size() - begin, end - begin);
+                out.erase(out.begin() + first, out.begin() + first + torn);
+            }
+        }
+
+        size_t Size() const {
+            return slots_.size();
+        }
+
+        void Clear() {
+            start_.store(committed_.load(std::memory_order_acquire), std::memory_order_relaxed);
+        }
+
+    private:
+        struct Slot {
+            std::atomic<const char*> name = nullptr;
+            std::atomic<const std::type_info*> type = nullptr;
+            std::atomic<uint64_t> begin = 0;
+            std::atomic<uint64_t> duration = 0;
+        };
+
+        const uint32_t thread_;
+        const uint64_t mask_;
+        std::vector<Slot> slots_;
+        std::atomic<uint64_t> begun_ = 0;
+        std::atomic<uint64_t> committed_ = 0;
+        std::atomic<uint64_t> start_ = 0;
+    };
+
+    EventTracer() {
+        const char* path = std::getenv("SMART_PTR_TRACE_FILE");
+        if (path != nullptr && *path != '\0') {
+            Enable();
+            std::atexit([] {
+                Global().WriteJson(std::string(std::getenv("SMART_PTR_TRACE_FILE")));
+            });
+        }
+    }
+
+    // A finished thread leaves its buffer, with the events, to the next new thread.
+    Buffer& Local() {
+        struct Owner {
+            ~Owner() {
+                if (buffer != nullptr) {
+                    EventTracer& tracer = Global();
+                    std::lock_guard lock(tracer.mutex_);
+                    tracer.free_.push_back(buffer);
+                }
+            }
+            Buffer* buffer = nullptr;
+        };
+        thread_local Owner owner;
+        if (owner.buffer == nullptr) {
+            std::lock_guard lock(mutex_);
+            // Buffers of an old size stay only for their events
+            while (!free_.empty() && free_.back()->Size() != BufferSize()) {
+                free_.pop_back();
+            }
+            if (!free_.empty()) {
+                owner.buffer = free_.back();
+                free_.pop_back();
+            } else {
+                buffers_.push_back(std::make_unique<Buffer>(buffers_.size() + 1, BufferSize()));
+                owner.buffer = buffers_.back().get();
+            }
+        }
+        return *owner.buffer;
+    }
+
+    static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // JSON string contents: quotes and backslashes are escaped, control characters are written
+    // as `\u00XX`.
+    static std::string Escape(const std::string& text) {
+        std::string res;
+        for (char c : text) {
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", c);
+                res += code;
+                continue;
+            }
+            if (c == '"' || c == '\\') {
+                res += '\\';
+            }
+            res += c;
+        }
+        return res;
+    }
+
+    static inline std::atomic<bool> enabled_ = false;
+
+    std::atomic<size_t> buffer_size_ = 1 << 16;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+    std::vector<Buffer*> free_;
+};
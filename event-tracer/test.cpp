@@ -0,0 +1,179 @@
+#include <shared-from-this/shared.h>
+#include <intrusive/intrusive.h>
+#include <unique/unique.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef SMART_PTR_EVENT_TRACER
+#error "The test is built with the tracer compiled in"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node {
+    SharedPtr<Node> next;
+};
+
+struct Intrusive : SimpleRefCounted<Intrusive> {
+    int value = 0;
+};
+
+std::vector<EventTracer::Event> Record(auto&& body) {
+    auto& tracer = EventTracer::Global();
+    tracer.Clear();
+    tracer.Enable();
+    body();
+    tracer.Disable();
+    return tracer.Events();
+}
+
+size_t Count(const std::vector<EventTracer::Event>& events, const std::string& name) {
+    size_t res = 0;
+    for (auto& event : events) {
+        res += event.name == name;
+    }
+    return res;
+}
+
+}  // namespace
+
+TEST_CASE("Lifecycle events") {
+    auto events = Record([] {
+        auto shared = MakeShared<Node>();
+        auto intrusive = MakeIntrusive<Intrusive>();
+        UniquePtr<int> unique(new int(1));
+        UniquePtr<int[]> array(new int[4]);
+        UniquePtr<int> empty;
+    });
+    REQUIRE(Count(events, "MakeShared") == 1);
+    REQUIRE(Count(events, "MakeIntrusive") == 1);
+    REQUIRE(Count(events, "UniquePtr::Delete") == 2);
+    REQUIRE(Count(events, "Release") == 2);
+    REQUIRE(events.size() == 6);
+    REQUIRE(*events[0].type == typeid(Node));
+    REQUIRE(*events[1].type == typeid(Intrusive));
+}
+
+TEST_CASE("Cascades nest") {
+    auto head = MakeShared<Node>();
+    head->next = MakeShared<Node>();
+    head->next->next = MakeShared<Node>();
+
+    auto events = Record([&head] { head.Reset(); });
+    REQUIRE(events.size() == 3);
+    for (size_t i = 1; i < events.size(); ++i) {
+        auto& outer = events[i - 1];
+        auto& inner = events[i];
+        REQUIRE(std::string(inner.name) == "Release");
+        REQUIRE(*inner.type == typeid(ControlBlockRawMemory<Node>));
+        REQUIRE(outer.begin <= inner.begin);
+        REQUIRE(inner.begin + inner.duration <= outer.begin + outer.duration);
+    }
+}
+
+TEST_CASE("Off by default") {
+    REQUIRE(!EventTracer::Enabled());
+    EventTracer::Global().Clear();
+    auto ptr = MakeShared<Node>();
+    ptr.Reset();
+    REQUIRE(EventTracer::Global().Events().empty());
+}
+
+TEST_CASE("Own spans") {
+    auto events = Record([] {
+        EventTracer::Span span("Request");
+        MakeShared<Node>();
+    });
+    REQUIRE(events.size() == 3);
+    REQUIRE(std::string(events[0].name) == "Request");
+    REQUIRE(events[0].type == nullptr);
+    REQUIRE(events[0].duration >= events[1].duration + events[2].duration);
+}
+
+TEST_CASE("Threads and JSON") {
+    auto events = Record([] {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 3; ++i) {
+            threads.emplace_back([] {
+                for (int j = 0; j < 100; ++j) {
+                    MakeShared<Node>();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    });
+    REQUIRE(events.size() == 600);
+
+    std::ostringstream json;
+    EventTracer::Global().WriteJson(json);
+    const std::string text = json.str();
+    REQUIRE(text.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+    REQUIRE(text.find("\"name\":\"MakeShared\",\"cat\":\"smart_ptr\",\"ph\":\"X\"") !=
+            std::string::npos);
+    const std::string type = "ControlBlockRawMemory<(anonymous namespace)::Node>";
+    REQUIRE(text.find("\"args\":{\"type\":\"" + type + "\"}") != std::string::npos);
+    REQUIRE(text.rfind("]}\n") == text.size() - 3);
+}
+
+TEST_CASE("Span names are escaped") {
+    const std::string name = std::string(200, 'x') + "\"quoted\"\\\n";
+    Record([&name] { EventTracer::Span span(name.c_str()); });
+
+    std::ostringstream json;
+    EventTracer::Global().WriteJson(json);
+    const std::string text = json.str();
+    const std::string escaped = std::string(200, 'x') + "\\\"quoted\\\"\\\\\\u000a";
+    const std::string event =
+        "\"name\":\"" + escaped + "\",\"cat\":\"smart_ptr\",\"ph\":\"X\",\"pid\":";
+    REQUIRE(text.find(event) != std::string::npos);
+}
+
+TEST_CASE("Buffers keep the latest events") {
+    auto& tracer = EventTracer::Global();
+    tracer.SetBufferSize(100);
+    REQUIRE(tracer.BufferSize() == 128);
+    std::vector<EventTracer::Event> events;
+    // The buffers left by the finished threads have the old size, so this one gets a new buffer
+    std::thread([&events] {
+        events = Record([] {
+            for (int i = 0; i < 1000; ++i) {
+                MakeShared<Node>();
+            }
+        });
+    }).join();
+    REQUIRE(events.size() == 128);
+    REQUIRE(Count(events, "MakeShared") == 64);
+    tracer.SetBufferSize(1 << 16);
+}
+
+TEST_CASE("Export while recording") {
+    auto& tracer = EventTracer::Global();
+    tracer.SetBufferSize(64);
+    tracer.Enable();
+    std::atomic<bool> stop = false;
+    std::thread writer([&stop] {
+        while (!stop.load()) {
+            MakeShared<Node>();
+        }
+    });
+    for (int i = 0; i < 100; ++i) {
+        for (auto& event : tracer.Events()) {
+            REQUIRE(event.name != nullptr);
+        }
+        std::this_thread::yield();
+    }
+    stop = true;
+    writer.join();
+    tracer.Disable();
+    tracer.SetBufferSize(1 << 16);
+}
@@ -0,0 +1,503 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+#include <common/type_name.h>
+
+#include <algorithm>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t
+#include <cstdio>   // std::snprintf
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>  // std::forward
+#include <vector>
+
+// Heap snapshots of `SharedPtr` graphs, for finding out what keeps memory alive.
+//
+// Objects created with `MakeRegistered<T>` are kept in a registry of live control blocks. Their
+// type registers a trace function, a member `void Trace(HeapVisitor& visit) const` calling
+// `visit(ptr)` for every `SharedPtr` it holds, and may report the memory it owns besides itself
+// with `size_t HeapSize() const`.
+//
+// `HeapRegistry::Global().Snapshot()` records the graph of registered objects. An object whose
+// strong count is larger than the number of edges to it from registered objects is referenced
+// from outside (the stack, globals, unregistered objects) and is a root. The snapshot computes the
+// dominator tree of the graph reachable from the roots and the retained size of every object:
+// the memory that would be freed if the object went away. Objects unreachable from the roots are
+// kept alive by reference cycles alone and are reported as leaked.
+//
+// The registry is on in debug builds; define `HEAP_REGISTRY` to 0 or 1 to override. When it's
+// off, `MakeRegistered` is `MakeShared`. Snapshots don't stop the other threads: the graph
+// should not change while one is taken.
+
+#ifndef HEAP_REGISTRY
+#ifdef NDEBUG
+#define HEAP_REGISTRY 0
+#else
+#define HEAP_REGISTRY 1
+#endif
+#endif
+
+class HeapNode;
+
+// Passed to `Trace`.
+class HeapVisitor {
+public:
+    template <typename U>
+    void operator()(const SharedPtr<U>& ptr) {
+        if (auto node = dynamic_cast<HeapNode*>(ptr.buffer)) {
+            visit_(context_, node);
+        }
+    }
+    template <typename P>
+    void operator()(const std::vector<P>& ptrs) {
+        for (auto& ptr : ptrs) {
+            (*this)(ptr);
+        }
+    }
+
+private:
+    friend class HeapRegistry;
+
+    HeapVisitor(void (*visit)(void*, HeapNode*), void* context)
+        : visit_(visit), context_(context) {
+    }
+
+    void (*visit_)(void*, HeapNode*);
+    void* context_;
+};
+
+class HeapNode {
+public:
+    virtual ~HeapNode() = default;
+
+private:
+    friend class HeapRegistry;
+
+    virtual const void* HeapAddress() const = 0;
+    virtual const std::type_info& HeapType() const = 0;
+    virtual size_t HeapSelfSize() const = 0;
+    virtual size_t HeapStrongCount() const = 0;
+    virtual void HeapTrace(HeapVisitor& visit) const = 0;
+
+    // Guarded by the registry mutex
+    HeapNode* prev_ = nullptr;
+    HeapNode* next_ = nullptr;
+    // Position in the snapshot being taken
+    uint32_t index_ = 0;
+};
+
+class HeapSnapshot {
+public:
+    static constexpr uint32_t kNoDominator = -1;
+
+    struct Object {
+        const void* address = nullptr;
+        uint32_t type = 0;
+        // Immediate dominator, `kNoDominator` for the roots and the entries of leaked cycles
+        uint32_t dominator = kNoDominator;
+        bool root = false;
+        bool leaked = false;
+        size_t strong_count = 0;
+        size_t self_size = 0;
+        size_t retained_size = 0;
+        // Objects in the dominator subtree, this one included
+        size_t retained_count = 0;
+    };
+
+    size_t NumObjects() const {
+        return objects_.size();
+    }
+    const Object& operator[](size_t index) const {
+        return objects_[index];
+    }
+    // The index of the object at `address`, `NumObjects()` if it isn't in the snapshot.
+    size_t Find(const void* address) const {
+        for (size_t i = 0; i < objects_.size(); ++i) {
+            if (objects_[i].address == address) {
+                return i;
+            }
+        }
+        return objects_.size();
+    }
+    std::string TypeName(size_t index) const {
+        return ::TypeName(*types_[objects_[index].type]);
+    }
+
+    size_t TotalSize() const {
+        size_t total = 0;
+        for (auto& object : objects_) {
+            total += object.self_size;
+        }
+        return total;
+    }
+
+    // Indices of the `count` objects with the largest retained sizes, largest first.
+    std::vector<size_t> TopRetainers(size_t count) const {
+        std::vector<size_t> order(objects_.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        count = std::min(count, order.size());
+        std::partial_sort(order.begin(), order.begin() + count, order.end(),
+                          [&](size_t left, size_t right) {
+                              return objects_[left].retained_size > objects_[right].retained_size;
+                          });
+        order.resize(count);
+        return order;
+    }
+
+    // A table of the top retainers with the chains of dominators holding them (the first
+    // `kMaxPath` links).
+    void WriteText(std::ostream& out, size_t top = 20) const {
+        size_t roots = 0, leaked = 0;
+        for (auto& object : objects_) {
+            roots += object.root;
+            leaked += object.leaked;
+        }
+        out << objects_.size() << " objects, " << TotalSize() << " bytes, " << roots
+            << " roots, " << leaked << " leaked in cycles\n";
+        out << "   retained        self   objects  object\n";
+        for (size_t index : TopRetainers(top)) {
+            const Object& object = objects_[index];
+            char line[64];
+            std::snprintf(line, sizeof(line), "%11zu %11zu %9zu  ", object.retained_size,
+                          object.self_size, object.retained_count);
+            out << line << Label(index);
+            size_t hops = 0;
+            for (uint32_t up = object.dominator; up != kNoDominator;
+                 up = objects_[up].dominator) {
+                if (++hops > kMaxPath) {
+                    out << " <- ...";
+                    break;
+                }
+                out << " <- " << Label(up);
+            }
+            out << (object.leaked ? " (leaked)" : "") << "\n";
+        }
+    }
+
+    // The dominator tree restricted to the top retainers and their dominators.
+    void WriteDot(std::ostream& out, size_t top = 20) const {
+        std::vector<char> shown(objects_.size());
+        for (size_t index : TopRetainers(top)) {
+            for (uint32_t up = index; up != kNoDominator && !shown[up];
+                 up = objects_[up].dominator) {
+                shown[up] = true;
+            }
+        }
+        out << "digraph heap {\n    node [shape=box];\n    roots [shape=ellipse];\n";
+        for (size_t index = 0; index < objects_.size(); ++index) {
+            if (!shown[index]) {
+                continue;
+            }
+            const Object& object = objects_[index];
+            out << "    n" << index << " [label=\"" << Label(index) << "\\nretained "
+                << object.retained_size << " bytes, " << object.retained_count << " objects\""
+                << (object.leaked ? ", color=red" : "") << "];\n";
+            if (object.dominator == kNoDominator) {
+                out << "    roots -> n" << index << ";\n";
+            } else {
+                out << "    n" << object.dominator << " -> n" << index << ";\n";
+            }
+        }
+        out << "}\n";
+    }
+
+private:
+    friend class HeapRegistry;
+
+    static constexpr size_t kMaxPath = 8;
+
+    std::string Label(size_t index) const {
+        std::string name = TypeName(index);
+        for (auto& c : name) {
+            if (c == '"') {
+                c = '\'';
+            }
+        }
+        return name + "#" + std::to_string(index);
+    }
+
+    std::vector<Object> objects_;
+    std::vector<const std::type_info*> types_;
+};
+
+class HeapRegistry {
+public:
+    static HeapRegistry& Global() {
+        static HeapRegistry* registry = new HeapRegistry();
+        return *registry;
+    }
+
+    size_t NumLive() const {
+        std::lock_guard lock(mutex_);
+        return size_;
+    }
+
+    HeapSnapshot Snapshot() {
+        HeapSnapshot snapshot;
+        // Edges in compressed rows: the children of `i` are `edges[offsets[i]..offsets[i + 1])`
+        std::vector<uint32_t> offsets, edges;
+        {
+            std::lock_guard lock(mutex_);
+            Record(snapshot, offsets, edges);
+        }
+        Dominators(snapshot, offsets, edges);
+        return snapshot;
+    }
+
+private:
+    template <typename T>
+    friend class ControlBlockRegistered;
+
+    HeapRegistry() = default;
+
+    void Register(HeapNode* node) {
+        std::lock_guard lock(mutex_);
+        node->next_ = head_;
+        if (head_ != nullptr) {
+            head_->prev_ = node;
+        }
+        head_ = node;
+        ++size_;
+    }
+
+    void Unregister(HeapNode* node) {
+        std::lock_guard lock(mutex_);
+        (node->prev_ != nullptr ? node->prev_->next_ : head_) = node->next_;
+        if (node->next_ != nullptr) {
+            node->next_->prev_ = node->prev_;
+        }
+        --size_;
+    }
+
+    void Record(HeapSnapshot& snapshot, std::vector<uint32_t>& offsets,
+                std::vector<uint32_t>& edges) {
+        auto& objects = snapshot.objects_;
+        objects.reserve(size_);
+        std::unordered_map<const std::type_info*, uint32_t> types;
+        uint32_t index = 0;
+        for (HeapNode* node = head_; node != nullptr; node = node->next_) {
+            node->index_ = index++;
+            auto [it, inserted] = types.try_emplace(&node->HeapType(), types.size());
+            if (inserted) {
+                snapshot.types_.push_back(it->first);
+            }
+            HeapSnapshot::Object object;
+            object.address = node->HeapAddress();
+            object.type = it->second;
+            object.strong_count = node->HeapStrongCount();
+            object.self_size = node->HeapSelfSize();
+            objects.push_back(object);
+        }
+
+        offsets.reserve(objects.size() + 1);
+        auto visit = [](void* edges, HeapNode* child) {
+            static_cast<std::vector<uint32_t>*>(edges)->push_back(child->index_);
+        };
+        HeapVisitor visitor(visit, &edges);
+        for (HeapNode* node = head_; node != nullptr; node = node->next_) {
+            offsets.push_back(edges.size());
+            node->HeapTrace(visitor);
+        }
+        offsets.push_back(edges.size());
+    }
+
+    // Finds the roots and the leaked objects, then the dominators (Cooper, Harvey and Kennedy)
+    // and the retained sizes.
+    static void Dominators(HeapSnapshot& snapshot, const std::vector<uint32_t>& offsets,
+                           const std::vector<uint32_t>& edges) {
+        auto& objects = snapshot.objects_;
+        const uint32_t size = objects.size();
+        // Index `size` is a virtual root above the real ones
+        const uint32_t top = size;
+        constexpr uint32_t kNone = HeapSnapshot::kNoDominator;
+
+        std::vector<uint32_t> internal(size);
+        for (uint32_t child : edges) {
+            ++internal[child];
+        }
+        for (uint32_t i = 0; i < size; ++i) {
+            objects[i].root = objects[i].strong_count > internal[i];
+        }
+
+        // Depth-first search from the roots, then from whatever is left (leaked cycles)
+        std::vector<uint32_t> postorder(size + 1, kNone);
+        std::vector<uint32_t> order;  // Postorder
+        order.reserve(size + 1);
+        std::vector<uint32_t> starts;
+        std::vector<std::pair<uint32_t, uint32_t>> stack;  // Object, next edge
+        auto search = [&](uint32_t start) {
+            postorder[start] = 0;
+            stack.emplace_back(start, offsets[start]);
+            while (!stack.empty()) {
+                auto& [node, edge] = stack.back();
+                if (edge < offsets[node + 1]) {
+                    uint32_t child = edges[edge++];
+                    if (postorder[child] == kNone) {
+                        postorder[child] = 0;
+                        stack.emplace_back(child, offsets[child]);
+                    }
+                } else {
+                    postorder[node] = order.size();
+                    order.push_back(node);
+                    stack.pop_back();
+                }
+            }
+        };
+        for (uint32_t i = 0; i < size; ++i) {
+            if (objects[i].root && postorder[i] == kNone) {
+                starts.push_back(i);
+                search(i);
+            }
+        }
+        for (uint32_t i = 0; i < size; ++i) {
+            if (postorder[i] == kNone) {
+                starts.push_back(i);
+                size_t before = order.size();
+                search(i);
+                for (size_t j = before; j < order.size(); ++j) {
+                    objects[order[j]].leaked = true;
+                }
+            }
+        }
+        postorder[top] = order.size();
+        order.push_back(top);
+
+        // Predecessors in compressed rows, the virtual root precedes the search starts
+        std::vector<uint32_t> pred_offsets(size + 2), preds(edges.size() + starts.size());
+        for (uint32_t child : edges) {
+            ++pred_offsets[child + 1];
+        }
+        for (uint32_t start : starts) {
+            ++pred_offsets[start + 1];
+        }
+        for (uint32_t i = 0; i <= size; ++i) {
+            pred_offsets[i + 1] += pred_offsets[i];
+        }
+        {
+            std::vector<uint32_t> fill(pred_offsets.begin(), pred_offsets.end() - 1);
+            for (uint32_t i = 0; i < size; ++i) {
+                for (uint32_t edge = offsets[i]; edge < offsets[i + 1]; ++edge) {
+                    preds[fill[edges[edge]]++] = i;
+                }
+            }
+            for (uint32_t start : starts) {
+                preds[fill[start]++] = top;
+            }
+        }
+
+        std::vector<uint32_t> dominator(size + 1, kNone);
+        dominator[top] = top;
+        auto intersect = [&](uint32_t left, uint32_t right) {
+            while (left != right) {
+                while (postorder[left] < postorder[right]) {
+                    left = dominator[left];
+                }
+                while (postorder[right] < postorder[left]) {
+                    right = dominator[right];
+                }
+            }
+            return left;
+        };
+        for (bool changed = true; changed;) {
+            changed = false;
+            // Reverse postorder, skipping the virtual root
+            for (size_t i = order.size() - 1; i-- > 0;) {
+                uint32_t node = order[i];
+                uint32_t idom = kNone;
+                for (uint32_t j = pred_offsets[node]; j < pred_offsets[node + 1]; ++j) {
+                    uint32_t pred = preds[j];
+                    if (dominator[pred] != kNone) {
+                        idom = idom == kNone ? pred : intersect(pred, idom);
+                    }
+                }
+                if (dominator[node] != idom) {
+                    dominator[node] = idom;
+                    changed = true;
+                }
+            }
+        }
+
+        // Children come before their dominators in postorder
+        for (uint32_t node : order) {
+            if (node == top) {
+                continue;
+            }
+            auto& object = objects[node];
+            object.retained_size += object.self_size;
+            object.retained_count += 1;
+            if (dominator[node] != top) {
+                object.dominator = dominator[node];
+                objects[dominator[node]].retained_size += object.retained_size;
+                objects[dominator[node]].retained_count += object.retained_count;
+            }
+        }
+    }
+
+    mutable std::mutex mutex_;
+    HeapNode* head_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Control block of `MakeRegistered`: registered from construction until the object dies.
+template <typename T>
+class ControlBlockRegistered : public ControlBlockBasic, public HeapNode {
+public:
+    template <typename... Args>
+    ControlBlockRegistered(Args&&... args) {
+        new (&x) T(std::forward<Args>(args)...);
+        ++strong_cnt;
+        HeapRegistry::Global().Register(this);
+    }
+    void DestroyObject() override {
+        HeapRegistry::Global().Unregister(this);
+        Get()->~T();
+    }
+    T* Get() {
+        return reinterpret_cast<T*>(&x);
+    }
+
+    alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
+
+private:
+    const T* Get() const {
+        return reinterpret_cast<const T*>(&x);
+    }
+
+    const void* HeapAddress() const override {
+        return Get();
+    }
+    const std::type_info& HeapType() const override {
+        return typeid(T);
+    }
+    size_t HeapSelfSize() const override {
+        if constexpr (requires(const T& object) { object.HeapSize(); }) {
+            return sizeof(*this) + Get()->HeapSize();
+        } else {
+            return sizeof(*this);
+        }
+    }
+    size_t HeapStrongCount() const override {
+        return strong_cnt.load(std::memory_order_acquire);
+    }
+    void HeapTrace(HeapVisitor& visit) const override {
+        if constexpr (requires(const T& object) { object.Trace(visit); }) {
+            Get()->Trace(visit);
+        }
+    }
+};
+
+template <typename T, typename... Args>
+SharedPtr<T> MakeRegistered(Args&&... args) {
+#if HEAP_REGISTRY
+    auto block = new ControlBlockRegistered<T>(std::forward<Args>(args)...);
+    return SharedPtr<T>(block, block->Get());
+#else
+    return MakeShared<T>(std::forward<Args>(args)...);
+#endif
+}
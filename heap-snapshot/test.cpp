@@ -0,0 +1,171 @@
+#include "heap_snapshot.h"
+
+#include <catch.hpp>
+
+#include <sstream>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node {
+    void Trace(HeapVisitor& visit) const {
+        visit(children);
+    }
+
+    std::vector<SharedPtr<Node>> children;
+};
+
+struct Blob {
+    Blob(size_t size) : data(size) {
+    }
+
+    size_t HeapSize() const {
+        return data.capacity();
+    }
+
+    std::vector<char> data;
+};
+
+struct Holder {
+    void Trace(HeapVisitor& visit) const {
+        visit(blob);
+        visit(unregistered);
+    }
+
+    SharedPtr<Blob> blob;
+    SharedPtr<Node> unregistered;
+};
+
+constexpr size_t kNodeSize = sizeof(ControlBlockRegistered<Node>);
+
+}  // namespace
+
+TEST_CASE("Registry") {
+    auto& registry = HeapRegistry::Global();
+    size_t before = registry.NumLive();
+    {
+        auto a = MakeRegistered<Node>();
+        auto b = MakeRegistered<Blob>(10);
+        auto c = MakeShared<Node>();
+        REQUIRE(registry.NumLive() == before + 2);
+    }
+    REQUIRE(registry.NumLive() == before);
+}
+
+TEST_CASE("Dominators") {
+    // root -> a -> c, root -> b -> c, c -> d
+    auto root = MakeRegistered<Node>();
+    auto a = MakeRegistered<Node>();
+    auto b = MakeRegistered<Node>();
+    auto c = MakeRegistered<Node>();
+    auto d = MakeRegistered<Node>();
+    root->children = {a, b};
+    a->children = {c};
+    b->children = {c};
+    c->children = {d};
+    auto root_address = root.Get();
+    a.Reset(), b.Reset(), c.Reset();
+    Node* d_address = d.Get();
+    d.Reset();
+
+    auto snapshot = HeapRegistry::Global().Snapshot();
+    REQUIRE(snapshot.NumObjects() == 5);
+    size_t r = snapshot.Find(root_address);
+    size_t ia = snapshot.Find(root->children[0].Get());
+    size_t ib = snapshot.Find(root->children[1].Get());
+    size_t ic = snapshot.Find(root->children[0]->children[0].Get());
+    size_t id = snapshot.Find(d_address);
+
+    REQUIRE(snapshot[r].root);
+    REQUIRE(snapshot[r].dominator == HeapSnapshot::kNoDominator);
+    REQUIRE(snapshot[r].retained_size == 5 * kNodeSize);
+    REQUIRE(snapshot[r].retained_count == 5);
+    REQUIRE(!snapshot[ia].root);
+    REQUIRE(snapshot[ia].dominator == r);
+    REQUIRE(snapshot[ib].dominator == r);
+    REQUIRE(snapshot[ia].retained_count == 1);
+    // Reachable through both a and b
+    REQUIRE(snapshot[ic].dominator == r);
+    REQUIRE(snapshot[ic].retained_size == 2 * kNodeSize);
+    REQUIRE(snapshot[id].dominator == ic);
+    REQUIRE(snapshot.TypeName(id).find("Node") != std::string::npos);
+
+    REQUIRE(snapshot.TopRetainers(2) == std::vector<size_t>{r, ic});
+}
+
+TEST_CASE("Outside references make roots") {
+    auto root = MakeRegistered<Node>();
+    auto child = MakeRegistered<Node>();
+    root->children.push_back(child);
+
+    auto snapshot = HeapRegistry::Global().Snapshot();
+    size_t ic = snapshot.Find(child.Get());
+    REQUIRE(snapshot[ic].root);
+    REQUIRE(snapshot[ic].dominator == HeapSnapshot::kNoDominator);
+    REQUIRE(snapshot[snapshot.Find(root.Get())].retained_count == 1);
+}
+
+TEST_CASE("Sizes") {
+    auto holder = MakeRegistered<Holder>();
+    holder->blob = MakeRegistered<Blob>(1000);
+    holder->unregistered = MakeShared<Node>();
+
+    auto snapshot = HeapRegistry::Global().Snapshot();
+    REQUIRE(snapshot.NumObjects() == 2);
+    auto& blob = snapshot[snapshot.Find(holder->blob.Get())];
+    REQUIRE(blob.self_size == sizeof(ControlBlockRegistered<Blob>) + 1000);
+    REQUIRE(snapshot[snapshot.Find(holder.Get())].retained_size ==
+            sizeof(ControlBlockRegistered<Holder>) + blob.self_size);
+}
+
+TEST_CASE("Leaked cycles") {
+    auto a = MakeRegistered<Node>();
+    auto b = MakeRegistered<Node>();
+    a->children.push_back(b);
+    b->children.push_back(a);
+    auto live = MakeRegistered<Node>();
+    Node* a_address = a.Get();
+    a.Reset(), b.Reset();
+
+    auto snapshot = HeapRegistry::Global().Snapshot();
+    REQUIRE(snapshot.NumObjects() == 3);
+    auto& leaked = snapshot[snapshot.Find(a_address)];
+    REQUIRE(leaked.leaked);
+    REQUIRE(!leaked.root);
+    REQUIRE(!snapshot[snapshot.Find(live.Get())].leaked);
+
+    std::ostringstream text;
+    snapshot.WriteText(text);
+    REQUIRE(text.str().find("3 objects") == 0);
+    REQUIRE(text.str().find("(leaked)") != std::string::npos);
+
+    // Break the cycle
+    auto& children = const_cast<Node*>(a_address)->children;
+    auto keep = children[0];
+    children.clear();
+    keep->children.clear();
+}
+
+TEST_CASE("DOT") {
+    auto root = MakeRegistered<Node>();
+    for (int i = 0; i < 100; ++i) {
+        root->children.push_back(MakeRegistered<Node>());
+        root->children.back()->children.push_back(MakeRegistered<Node>());
+    }
+
+    auto snapshot = HeapRegistry::Global().Snapshot();
+    std::ostringstream dot;
+    snapshot.WriteDot(dot, 5);
+    const std::string res = dot.str();
+    REQUIRE(res.find("digraph heap {") == 0);
+    // The root and four of its children, with their dominator edges
+    size_t r = snapshot.Find(root.Get());
+    REQUIRE(res.find("roots -> n" + std::to_string(r) + ";") != std::string::npos);
+    size_t nodes = 0;
+    for (size_t pos = 0; (pos = res.find("[label=", pos)) != std::string::npos; ++pos) {
+        ++nodes;
+    }
+    REQUIRE(nodes == 5);
+}
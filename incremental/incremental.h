@@ -0,0 +1,155 @@
+#pragma once
+
+#include <parallel-release/parallel_release.h>
+
+#include <chrono>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint64_t
+#include <utility>  // std::forward
+#include <vector>
+
+// Destruction spread over the ticks of an event loop.
+//
+// Dropping the last reference to an object created with `MakeSharedIncremental<T>`, or deleting
+// one through `IncrementalDelete`, only queues it on the reclaimer of the current thread. The
+// loop calls `Reclaim(budget_us)` every tick, which destroys queued nodes until the budget runs
+// out. Nodes are expanded lazily: a type with `ReleaseChildren` (see `ParallelRelease`) has its
+// exclusively owned children moved into the queue, so a node costs the same however large the
+// structure under it is. Types without it are destroyed in one go.
+//
+// The queue is per thread and needs no synchronization; whatever is left in it is destroyed when
+// the thread exits.
+class IncrementalReclaimer {
+public:
+    static IncrementalReclaimer& Local() {
+        thread_local IncrementalReclaimer reclaimer;
+        return reclaimer;
+    }
+
+    IncrementalReclaimer(const IncrementalReclaimer&) = delete;
+    IncrementalReclaimer& operator=(const IncrementalReclaimer&) = delete;
+
+    ~IncrementalReclaimer() {
+        ReclaimAll();
+    }
+
+    void Push(ReleaseTask task) {
+        tasks_.push_back(task);
+    }
+
+    // Destroys queued nodes for about `budget_us` microseconds (at least one node if any is
+    // queued). Returns the number of nodes destroyed.
+    size_t Reclaim(uint64_t budget_us) {
+        using Clock = std::chrono::steady_clock;
+
+        auto deadline = Clock::now() + std::chrono::microseconds(budget_us);
+        size_t reclaimed = 0;
+        while (!tasks_.empty()) {
+            RunOne();
+            // Nodes are cheap, the clock is checked after the first one and then once in a while
+            if ((++reclaimed == 1 || reclaimed % kCheckEvery == 0) && Clock::now() >= deadline) {
+                break;
+            }
+        }
+        return reclaimed;
+    }
+
+    size_t ReclaimAll() {
+        size_t reclaimed = 0;
+        while (!tasks_.empty()) {
+            RunOne();
+            ++reclaimed;
+        }
+        return reclaimed;
+    }
+
+    // Queued nodes, not counting the children of the nodes that aren't expanded yet.
+    size_t Pending() const {
+        return tasks_.size();
+    }
+
+private:
+    static constexpr size_t kCheckEvery = 16;
+
+    IncrementalReclaimer() = default;
+
+    static void PushTo(void* reclaimer, ReleaseTask task) {
+        static_cast<IncrementalReclaimer*>(reclaimer)->Push(task);
+    }
+
+    // Last in, first out: the queue stays as small as the structure is deep.
+    void RunOne() {
+        ReleaseTask task = tasks_.back();
+        tasks_.pop_back();
+        ReleaseVisitor release(&IncrementalReclaimer::PushTo, this);
+        task.run(release, task.object, task.block);
+    }
+
+    std::vector<ReleaseTask> tasks_;
+};
+
+// Control block of `MakeSharedIncremental`: the last `DecreaseStrong` queues the block itself.
+template <typename T>
+class ControlBlockIncremental : public ControlBlockBasic {
+public:
+    template <typename... Args>
+    ControlBlockIncremental(Args&&... args) {
+        new (&x) T(std::forward<Args>(args)...);
+        ++strong_cnt;
+    }
+    void DecreaseStrong() override {
+        if (strong_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            IncrementalReclaimer::Local().Push({&Run, nullptr, this});
+        }
+    }
+    void DestroyObject() override {
+        Get()->~T();
+    }
+    T* Get() {
+        return reinterpret_cast<T*>(&x);
+    }
+
+    alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
+
+private:
+    static void Run(ReleaseVisitor& release, void*, ControlBlockBasic* block) {
+        auto self = static_cast<ControlBlockIncremental*>(block);
+        if constexpr (HasReleaseChildren<T>) {
+            self->Get()->ReleaseChildren(release);
+        }
+        self->DestroyObject();
+        self->DecreaseWeak();
+    }
+};
+
+template <typename T, typename... Args>
+SharedPtr<T> MakeSharedIncremental(Args&&... args) {
+    auto block = new ControlBlockIncremental<T>(std::forward<Args>(args)...);
+    return SharedPtr<T>(block, block->Get());
+}
+
+// Deleter queueing the object on the reclaimer of the current thread: `Destroy` for `RefCounted`,
+// `operator()` for `UniquePtr`.
+struct IncrementalDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        IncrementalReclaimer::Local().Push({&Run<T>, object, nullptr});
+    }
+
+    template <typename T>
+    void operator()(T* object) const {
+        if (object != nullptr) {
+            Destroy(object);
+        }
+    }
+
+private:
+    template <typename T>
+    static void Run(ReleaseVisitor& release, void* object, ControlBlockBasic*) {
+        auto self = static_cast<T*>(object);
+        if constexpr (HasReleaseChildren<T>) {
+            self->ReleaseChildren(release);
+        }
+        SizedDelete(self);
+    }
+};
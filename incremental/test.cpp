@@ -0,0 +1,149 @@
+#include "incremental.h"
+
+#include <common/tracked.h>
+#include <shared-from-this/weak.h>
+
+#include <catch.hpp>
+
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node : Tracked {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(children);
+        release(unique);
+    }
+
+    std::vector<SharedPtr<Node>> children;
+    UniquePtr<Node> unique;
+};
+
+struct Intrusive : Tracked, SimpleRefCounted<Intrusive, IncrementalDelete> {};
+
+void Grow(Node& node, int depth, int fanout) {
+    if (depth == 0) {
+        return;
+    }
+    for (int i = 0; i < fanout; ++i) {
+        node.children.push_back(MakeShared<Node>());
+        Grow(*node.children.back(), depth - 1, fanout);
+    }
+}
+
+}  // namespace
+
+TEST_CASE("MakeSharedIncremental") {
+    auto& reclaimer = IncrementalReclaimer::Local();
+
+    auto root = MakeSharedIncremental<Node>();
+    Grow(*root, 3, 4);
+    REQUIRE(Tracked::alive == 1 + 4 + 16 + 64);
+    WeakPtr<Node> weak = root;
+
+    root.Reset();
+    REQUIRE(weak.Expired());
+    REQUIRE(Tracked::alive == 85);
+    REQUIRE(reclaimer.Pending() == 1);
+
+    // An expired budget still destroys one node
+    REQUIRE(reclaimer.Reclaim(0) == 1);
+    REQUIRE(Tracked::alive == 85 - 1);
+    REQUIRE(reclaimer.Pending() == 4);
+
+    size_t total = 1;
+    while (reclaimer.Pending() != 0) {
+        total += reclaimer.Reclaim(0);
+    }
+    REQUIRE(total == 85);
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Shared children are only dereferenced") {
+    auto& reclaimer = IncrementalReclaimer::Local();
+
+    auto root = MakeSharedIncremental<Node>();
+    Grow(*root, 2, 3);
+    auto kept = root->children[0];
+    root.Reset();
+    REQUIRE(reclaimer.ReclaimAll() == 1 + 2 + 2 * 3);
+    REQUIRE(kept.UseCount() == 1);
+    REQUIRE(Tracked::alive == 4);
+}
+
+TEST_CASE("Children promoted between ticks stay alive") {
+    auto& reclaimer = IncrementalReclaimer::Local();
+
+    auto root = MakeSharedIncremental<Node>();
+    Grow(*root, 1, 41);
+    root->children[0]->children.push_back(MakeShared<Node>());
+    WeakPtr<Node> observer = root->children[0];
+
+    root.Reset();
+    REQUIRE(reclaimer.Reclaim(0) == 1);
+    REQUIRE(reclaimer.Pending() == 41);
+
+    auto child = observer.Lock();
+    REQUIRE(child);
+    reclaimer.ReclaimAll();
+    REQUIRE(child.UseCount() == 1);
+    REQUIRE(child->children.size() == 1);
+    REQUIRE(Tracked::alive == 2);
+
+    child.Reset();
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("IncrementalDelete") {
+    auto& reclaimer = IncrementalReclaimer::Local();
+
+    SECTION("UniquePtr") {
+        {
+            UniquePtr<Node, IncrementalDelete> ptr(new Node());
+            ptr->unique.Reset(new Node());
+            ptr->unique->children.push_back(MakeSharedIncremental<Node>());
+        }
+        REQUIRE(Tracked::alive == 3);
+        reclaimer.ReclaimAll();
+        REQUIRE(Tracked::alive == 0);
+    }
+
+    SECTION("RefCounted") {
+        auto ptr = MakeIntrusive<Intrusive>();
+        ptr.Reset();
+        REQUIRE(Tracked::alive == 1);
+        REQUIRE(reclaimer.Reclaim(1000) == 1);
+        REQUIRE(Tracked::alive == 0);
+    }
+}
+
+TEST_CASE("Long chains") {
+    auto& reclaimer = IncrementalReclaimer::Local();
+
+    auto head = MakeSharedIncremental<Node>();
+    Node* tail = head.Get();
+    for (int i = 1; i < 1'000'000; ++i) {
+        if (i % 2 == 0) {
+            tail->children.push_back(MakeShared<Node>());
+            tail = tail->children.back().Get();
+        } else {
+            tail->unique.Reset(new Node());
+            tail = tail->unique.Get();
+        }
+    }
+    head.Reset();
+    REQUIRE(reclaimer.ReclaimAll() == 1'000'000);
+    REQUIRE(reclaimer.Pending() == 0);
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Thread exit reclaims the rest") {
+    std::thread([] {
+        auto root = MakeSharedIncremental<Node>();
+        Grow(*root, 2, 2);
+    }).join();
+    REQUIRE(Tracked::alive == 0);
+}
@@ -0,0 +1,522 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>  // size_t, std::max_align_t
+#include <cstdint>  // uint64_t, intptr_t
+#include <new>        // std::bad_alloc
+#include <stdexcept>  // std::runtime_error
+#include <string>
+#include <system_error>
+#include <utility>  // std::exchange, std::forward
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Pointer stored as the distance from itself to the target, so it stays valid wherever the
+// memory holding both of them is mapped. Use it for links between objects in a `SharedSegment`.
+template <typename T>
+class OffsetPtr {
+public:
+    OffsetPtr() {
+    }
+    OffsetPtr(T* ptr) {
+        Set(ptr);
+    }
+    OffsetPtr(const OffsetPtr& other) {
+        Set(other.Get());
+    }
+    OffsetPtr& operator=(const OffsetPtr& other) {
+        Set(other.Get());
+        return *this;
+    }
+    OffsetPtr& operator=(T* ptr) {
+        Set(ptr);
+        return *this;
+    }
+
+    T* Get() const {
+        // Zero would point to itself, so it means null
+        return offset_ == 0 ? nullptr
+                            : reinterpret_cast<T*>(reinterpret_cast<intptr_t>(this) + offset_);
+    }
+    T& operator*() const {
+        return *Get();
+    }
+    T* operator->() const {
+        return Get();
+    }
+    explicit operator bool() const {
+        return offset_ != 0;
+    }
+
+private:
+    void Set(T* ptr) {
+        offset_ = ptr == nullptr ? 0
+                                 : reinterpret_cast<intptr_t>(ptr) - reinterpret_cast<intptr_t>(this);
+    }
+
+    intptr_t offset_ = 0;
+};
+
+template <typename T>
+class InterprocessSharedPtr;
+
+// Memory shared between processes: an anonymous `memfd_create` file (or a `shm_open` one that is
+// unlinked right away) mapped with `MAP_SHARED`. Child processes inherit the mapping with `fork`;
+// any process that gets the descriptor can map it with `Open`, possibly at another address.
+// Everything inside the segment refers to other parts of it by offsets.
+//
+// The segment starts with the state of its allocator: power-of-two size classes with free lists,
+// guarded by a robust process-shared mutex in the segment itself. When a process dies holding it,
+// the next one to lock it takes over; an allocator operation cut short only leaks its chunk.
+class SharedSegment {
+public:
+    static SharedSegment Create(size_t size) {
+        if (size < HeaderSize()) {
+            throw std::invalid_argument("Shared segment is too small");
+        }
+        int fd = CreateFile();
+        if (ftruncate(fd, size) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "ftruncate");
+        }
+        SharedSegment segment(fd, size);
+        ::new (segment.base_) Header();
+        return segment;
+    }
+
+    // Maps the segment behind `fd` (which is duplicated, the caller keeps its own).
+    static SharedSegment Open(int fd) {
+        int own = dup(fd);
+        if (own < 0) {
+            throw std::system_error(errno, std::generic_category(), "dup");
+        }
+        // Not `lseek`: the duplicate shares the file offset with the caller's descriptor
+        off_t size = FileSize(own);
+        if (size < 0) {
+            int error = errno;
+            close(own);
+            throw std::system_error(error, std::generic_category(), "fstat");
+        }
+        if (static_cast<size_t>(size) < HeaderSize()) {
+            close(own);
+            throw std::runtime_error("Not a shared segment");
+        }
+        SharedSegment segment(own, size);
+        if (segment.GetHeader().magic != kMagic) {
+            throw std::runtime_error("Not a shared segment");
+        }
+        return segment;
+    }
+
+    // Maps the file at `path`, which keeps the segment between runs. A new file is created with
+    // `size` bytes; an existing one is mapped as is. Only one process may have the file open: its
+    // allocator lock is reset, since the run that wrote it may have crashed holding it.
+    static SharedSegment OpenFile(const std::string& path, size_t size) {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+        off_t existing = FileSize(fd);
+        if (existing < 0) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "fstat " + path);
+        }
+        if (existing != 0 && static_cast<size_t>(existing) < HeaderSize()) {
+            close(fd);
+            throw std::runtime_error("Not a shared segment: " + path);
+        }
+        if (existing == 0 && size < HeaderSize()) {
+            close(fd);
+            throw std::invalid_argument("Shared segment is too small");
+        }
+        if (existing == 0 && ftruncate(fd, size) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "ftruncate " + path);
+        }
+        SharedSegment segment(fd, existing == 0 ? size : existing);
+        if (existing == 0) {
+            ::new (segment.base_) Header();
+        } else if (segment.GetHeader().magic != kMagic) {
+            throw std::runtime_error("Not a shared segment: " + path);
+        } else {
+            InitLock(segment.GetHeader().lock);
+        }
+        return segment;
+    }
+
+    SharedSegment(SharedSegment&& other)
+        : fd_(std::exchange(other.fd_, -1)),
+          base_(std::exchange(other.base_, nullptr)),
+          size_(other.size_) {
+    }
+    SharedSegment(const SharedSegment&) = delete;
+    SharedSegment& operator=(const SharedSegment&) = delete;
+    SharedSegment& operator=(SharedSegment&&) = delete;
+
+    ~SharedSegment() {
+        if (base_ != nullptr) {
+            munmap(base_, size_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Allocator
+
+    // Aligned to `alignof(std::max_align_t)`. Throws `std::bad_alloc` when the segment is full.
+    void* Allocate(size_t size) {
+        if (size > (size_t{1} << (kNumClasses - 1)) - sizeof(Chunk)) {
+            throw std::bad_alloc();
+        }
+        size_t size_class = kMinClass;
+        while ((size_t{1} << size_class) < size + sizeof(Chunk)) {
+            ++size_class;
+        }
+        Header& header = GetHeader();
+        Lock lock(header.lock);
+        Chunk* chunk;
+        if (header.free[size_class] != 0) {
+            chunk = static_cast<Chunk*>(AtOffset(header.free[size_class]));
+            header.free[size_class] = chunk->next_free;
+        } else {
+            size_t chunk_size = size_t{1} << size_class;
+            if (chunk_size > size_ - header.used) {
+                throw std::bad_alloc();
+            }
+            chunk = static_cast<Chunk*>(AtOffset(header.used));
+            header.used += chunk_size;
+        }
+        chunk->size_class = size_class;
+        header.in_use += size_t{1} << size_class;
+        return chunk + 1;
+    }
+
+    void Deallocate(void* ptr) {
+        Deallocate(base_, ptr);
+    }
+
+    // Bytes taken by live allocations, rounded up to their size classes
+    size_t BytesInUse() const {
+        Header& header = GetHeader();
+        Lock lock(header.lock);
+        return header.in_use;
+    }
+
+    template <typename T, typename... Args>
+    InterprocessSharedPtr<T> MakeShared(Args&&... args);
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Addressing
+
+    uint64_t OffsetOf(const void* ptr) const {
+        return static_cast<const char*>(ptr) - static_cast<const char*>(base_);
+    }
+    void* AtOffset(uint64_t offset) const {
+        return static_cast<char*>(base_) + offset;
+    }
+    bool Contains(const void* ptr) const {
+        return ptr >= base_ && ptr < AtOffset(size_);
+    }
+
+    // Slot for the offset of whatever the users of the segment agree to start from
+    uint64_t Root() const {
+        return GetHeader().root.load(std::memory_order_acquire);
+    }
+    void SetRoot(uint64_t offset) {
+        GetHeader().root.store(offset, std::memory_order_release);
+    }
+
+    // Writes the mapping back to its file.
+    void Sync() {
+        if (msync(base_, size_, MS_SYNC) != 0) {
+            throw std::system_error(errno, std::generic_category(), "msync");
+        }
+    }
+
+    int Fd() const {
+        return fd_;
+    }
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    template <typename T>
+    friend class InterprocessSharedPtr;
+
+    static constexpr uint64_t kMagic = 0x53484d5345474d32;  // "SHMSEGM2"
+    static constexpr size_t kMinClass = 5;
+    static constexpr size_t kNumClasses = 48;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+    struct alignas(std::max_align_t) Chunk {
+        union {
+            size_t size_class;
+            uint64_t next_free;
+        };
+    };
+
+    struct Header {
+        Header() : used(Align(sizeof(Header))) {
+            InitLock(lock);
+        }
+
+        static size_t Align(size_t size) {
+            return (size + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) *
+                   alignof(std::max_align_t);
+        }
+
+        uint64_t magic = kMagic;
+        pthread_mutex_t lock;
+        std::atomic<uint64_t> root = 0;
+        // Offset of the untouched part
+        uint64_t used;
+        uint64_t in_use = 0;
+        // Offsets of the first free chunks of each class
+        uint64_t free[kNumClasses] = {};
+    };
+
+    // A segment must at least hold its header
+    static size_t HeaderSize() {
+        return Header::Align(sizeof(Header));
+    }
+
+    static void InitLock(pthread_mutex_t& lock) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        int error = pthread_mutex_init(&lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        if (error != 0) {
+            throw std::system_error(error, std::generic_category(), "pthread_mutex_init");
+        }
+    }
+
+    class Lock {
+    public:
+        explicit Lock(pthread_mutex_t& lock) : lock_(lock) {
+            int error = pthread_mutex_lock(&lock_);
+            if (error == EOWNERDEAD) {
+                // Every update of the lists is a single store, so they are whole; at worst, the
+                // chunk the dead process was taking or giving back is lost
+                pthread_mutex_consistent(&lock_);
+            } else if (error != 0) {
+                throw std::system_error(error, std::generic_category(), "pthread_mutex_lock");
+            }
+        }
+        ~Lock() {
+            pthread_mutex_unlock(&lock_);
+        }
+
+    private:
+        pthread_mutex_t& lock_;
+    };
+
+    // Frees `ptr` in the segment mapped at `base`.
+    static void Deallocate(void* base, void* ptr) {
+        auto chunk = static_cast<Chunk*>(ptr) - 1;
+        Header& header = *static_cast<Header*>(base);
+        Lock lock(header.lock);
+        size_t size_class = chunk->size_class;
+        header.in_use -= size_t{1} << size_class;
+        chunk->next_free = header.free[size_class];
+        header.free[size_class] = reinterpret_cast<char*>(chunk) - static_cast<char*>(base);
+    }
+
+    static off_t FileSize(int fd) {
+        struct stat st;
+        return fstat(fd, &st) == 0 ? st.st_size : -1;
+    }
+
+    SharedSegment(int fd, size_t size) : fd_(fd), size_(size) {
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            fd_ = -1;
+            throw std::system_error(error, std::generic_category(), "mmap");
+        }
+        base_ = base;
+    }
+
+    static int CreateFile() {
+        int fd = memfd_create("shared-segment", MFD_CLOEXEC);
+        if (fd >= 0 || errno != ENOSYS) {
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "memfd_create");
+            }
+            return fd;
+        }
+        // Kernels without memfd: a POSIX shared memory object that only the descriptor refers to
+        static std::atomic<int> counter = 0;
+        std::string name = "/shared-segment-" + std::to_string(getpid()) + "-" +
+                           std::to_string(counter.fetch_add(1));
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_open");
+        }
+        shm_unlink(name.c_str());
+        return fd;
+    }
+
+    Header& GetHeader() const {
+        return *static_cast<Header*>(base_);
+    }
+
+    int fd_;
+    void* base_ = nullptr;
+    size_t size_;
+};
+
+// Counterpart of `SharedPtr` for objects in a `SharedSegment`: the counter lives next to the object
+// in the segment, so references held by different processes are counted together, and the
+// process that drops the last one destroys the object and frees its memory.
+// `T` must not point outside the segment (use `OffsetPtr` for links inside it).
+// The handle keeps the block as a self-relative offset, like `OffsetPtr`, and the block knows its
+// own place in the segment, so a handle stored in the segment is an owning link that works in any
+// process mapping it. To pass a reference held outside the segment to another process, send the
+// offset from `Share` or `Release` (a pipe, a slot in the segment) and take it with `Adopt`.
+// The segment must outlive the handles into it.
+template <typename T>
+class InterprocessSharedPtr {
+    struct Block {
+        template <typename... Args>
+        Block(uint64_t offset, Args&&... args)
+            : offset(offset), value(std::forward<Args>(args)...) {
+        }
+
+        std::atomic<uint64_t> strong_cnt = 1;
+        // Offset in the segment, which leads to its allocator
+        uint64_t offset;
+        T value;
+    };
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    InterprocessSharedPtr() {
+    }
+    InterprocessSharedPtr(const InterprocessSharedPtr& other) : block_(other.block_) {
+        if (block_) {
+            block_->strong_cnt.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    InterprocessSharedPtr(InterprocessSharedPtr&& other) : block_(other.block_) {
+        other.block_ = nullptr;
+    }
+
+    // Takes over a reference given away with `Share` or `Release`, possibly by another process.
+    static InterprocessSharedPtr Adopt(SharedSegment& segment, uint64_t offset) {
+        InterprocessSharedPtr res;
+        if (offset != 0) {
+            res.block_ = static_cast<Block*>(segment.AtOffset(offset));
+        }
+        return res;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    InterprocessSharedPtr& operator=(const InterprocessSharedPtr& other) {
+        InterprocessSharedPtr(other).Swap(*this);
+        return *this;
+    }
+    InterprocessSharedPtr& operator=(InterprocessSharedPtr&& other) {
+        InterprocessSharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~InterprocessSharedPtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        Block* block = block_.Get();
+        block_ = nullptr;
+        if (block != nullptr && block->strong_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            void* base = reinterpret_cast<char*>(block) - block->offset;
+            block->~Block();
+            SharedSegment::Deallocate(base, block);
+        }
+    }
+    void Swap(InterprocessSharedPtr& other) {
+        Block* block = block_.Get();
+        block_ = other.block_;
+        other.block_ = block;
+    }
+
+    // Gives up the reference without dropping it; returns the offset for `Adopt` (0 if empty).
+    uint64_t Release() {
+        uint64_t offset = Offset();
+        block_ = nullptr;
+        return offset;
+    }
+    // Same for a new reference, this one is kept.
+    uint64_t Share() const {
+        if (block_) {
+            block_->strong_cnt.fetch_add(1, std::memory_order_relaxed);
+        }
+        return Offset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return block_ ? &block_->value : nullptr;
+    }
+    T& operator*() const {
+        return block_->value;
+    }
+    T* operator->() const {
+        return Get();
+    }
+    size_t UseCount() const {
+        return block_ ? block_->strong_cnt.load(std::memory_order_acquire) : 0;
+    }
+    explicit operator bool() const {
+        return static_cast<bool>(block_);
+    }
+    uint64_t Offset() const {
+        return block_ ? block_->offset : 0;
+    }
+
+private:
+    friend class SharedSegment;
+
+    OffsetPtr<Block> block_;
+};
+
+template <typename T, typename... Args>
+InterprocessSharedPtr<T> SharedSegment::MakeShared(Args&&... args) {
+    using Block = typename InterprocessSharedPtr<T>::Block;
+    static_assert(alignof(Block) <= alignof(std::max_align_t));
+    void* memory = Allocate(sizeof(Block));
+    InterprocessSharedPtr<T> res;
+    try {
+        res.block_ = ::new (memory) Block(OffsetOf(memory), std::forward<Args>(args)...);
+    } catch (...) {
+        Deallocate(memory);
+        throw;
+    }
+    return res;
+}
@@ -0,0 +1,242 @@
+#include "interprocess.h"
+
+#include <catch.hpp>
+
+#include <array>
+#include <cstdint>
+#include <new>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Runs `body` in a child process and returns its exit code.
+template <typename F>
+int InChild(F&& body) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int code = 1;
+        try {
+            code = body();
+        } catch (...) {
+        }
+        _exit(code);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+struct ListNode {
+    ListNode(int value, ListNode* next) : value(value), next(next) {
+    }
+
+    int value;
+    OffsetPtr<ListNode> next;
+};
+
+struct Counter {
+    std::atomic<int> value = 0;
+};
+
+// Owns its child through a handle stored in the segment
+struct TreeNode {
+    int value = 0;
+    InterprocessSharedPtr<TreeNode> child;
+};
+
+}  // namespace
+
+TEST_CASE("OffsetPtr") {
+    int values[2] = {1, 2};
+    OffsetPtr<int> ptr;
+    REQUIRE(!ptr);
+    REQUIRE(ptr.Get() == nullptr);
+    ptr = &values[1];
+    REQUIRE(*ptr == 2);
+    OffsetPtr<int> copy = ptr;
+    REQUIRE(copy.Get() == &values[1]);
+}
+
+TEST_CASE("Segment allocator") {
+    auto segment = SharedSegment::Create(1 << 16);
+    REQUIRE(segment.BytesInUse() == 0);
+
+    void* a = segment.Allocate(10);
+    void* b = segment.Allocate(100);
+    REQUIRE(a != b);
+    REQUIRE(reinterpret_cast<uintptr_t>(b) % alignof(std::max_align_t) == 0);
+    REQUIRE(segment.Contains(a));
+    REQUIRE(segment.AtOffset(segment.OffsetOf(b)) == b);
+    REQUIRE(segment.BytesInUse() == 32 + 128);
+
+    segment.Deallocate(a);
+    REQUIRE(segment.Allocate(8) == a);
+    REQUIRE_THROWS_AS(segment.Allocate(1 << 16), std::bad_alloc);
+    REQUIRE_THROWS_AS(segment.Allocate(SIZE_MAX), std::bad_alloc);
+    REQUIRE_THROWS_AS(segment.Allocate(SIZE_MAX / 2), std::bad_alloc);
+}
+
+TEST_CASE("Segment size is validated") {
+    REQUIRE_THROWS_AS(SharedSegment::Create(16), std::invalid_argument);
+
+    int fd = memfd_create("too-small", MFD_CLOEXEC);
+    REQUIRE(fd >= 0);
+    REQUIRE(ftruncate(fd, 16) == 0);
+    REQUIRE_THROWS_AS(SharedSegment::Open(fd), std::runtime_error);
+    close(fd);
+
+    REQUIRE_THROWS_AS(SharedSegment::Open(-1), std::system_error);
+
+    // The descriptor of the caller keeps its offset
+    auto segment = SharedSegment::Create(1 << 16);
+    REQUIRE(lseek(segment.Fd(), 100, SEEK_SET) == 100);
+    auto opened = SharedSegment::Open(segment.Fd());
+    REQUIRE(opened.Size() == segment.Size());
+    REQUIRE(lseek(segment.Fd(), 0, SEEK_CUR) == 100);
+}
+
+TEST_CASE("A process killed in the allocator doesn't block the others") {
+    auto segment = SharedSegment::Create(1 << 20);
+    for (int i = 0; i < 5; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            while (true) {
+                segment.Deallocate(segment.Allocate(64));
+            }
+        }
+        usleep(10'000);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+
+        void* ptr = segment.Allocate(64);
+        REQUIRE(segment.Contains(ptr));
+        segment.Deallocate(ptr);
+    }
+}
+
+TEST_CASE("InterprocessSharedPtr in one process") {
+    auto segment = SharedSegment::Create(1 << 16);
+    {
+        auto ptr = segment.MakeShared<std::array<int, 4>>(std::array<int, 4>{1, 2, 3, 4});
+        REQUIRE(segment.Contains(ptr.Get()));
+        REQUIRE((*ptr)[3] == 4);
+        REQUIRE(ptr.UseCount() == 1);
+
+        auto copy = ptr;
+        REQUIRE(ptr.UseCount() == 2);
+        auto moved = std::move(copy);
+        REQUIRE(!copy);
+        REQUIRE(ptr.UseCount() == 2);
+
+        auto adopted = InterprocessSharedPtr<std::array<int, 4>>::Adopt(segment, moved.Release());
+        REQUIRE(adopted.Get() == ptr.Get());
+        REQUIRE(ptr.UseCount() == 2);
+
+        auto shared = InterprocessSharedPtr<std::array<int, 4>>::Adopt(segment, ptr.Share());
+        REQUIRE(ptr.UseCount() == 3);
+    }
+    REQUIRE(segment.BytesInUse() == 0);
+}
+
+TEST_CASE("Child processes share objects") {
+    auto segment = SharedSegment::Create(1 << 20);
+    auto counter = segment.MakeShared<Counter>();
+
+    SECTION("Inherited mapping") {
+        const int children = 4;
+        for (int i = 0; i < children; ++i) {
+            uint64_t offset = counter.Share();
+            REQUIRE(InChild([&] {
+                        auto mine = InterprocessSharedPtr<Counter>::Adopt(segment, offset);
+                        for (int j = 0; j < 1000; ++j) {
+                            mine->value.fetch_add(1);
+                        }
+                        return 0;
+                    }) == 0);
+        }
+        REQUIRE(counter->value == children * 1000);
+        // Every child dropped its reference
+        REQUIRE(counter.UseCount() == 1);
+    }
+
+    SECTION("Mapped at another address") {
+        ListNode* head = nullptr;
+        for (int i = 0; i < 10; ++i) {
+            head = ::new (segment.Allocate(sizeof(ListNode))) ListNode(i, head);
+        }
+        uint64_t head_offset = segment.OffsetOf(head);
+        uint64_t counter_offset = counter.Share();
+        REQUIRE(InChild([&] {
+                    auto remapped = SharedSegment::Open(segment.Fd());
+                    auto node = static_cast<ListNode*>(remapped.AtOffset(head_offset));
+                    if (remapped.Contains(counter.Get()) || !remapped.Contains(node)) {
+                        return 2;
+                    }
+                    int sum = 0;
+                    for (; node != nullptr; node = node->next.Get()) {
+                        sum += node->value;
+                    }
+                    auto mine = InterprocessSharedPtr<Counter>::Adopt(remapped, counter_offset);
+                    mine->value = sum;
+                    return 0;
+                }) == 0);
+        REQUIRE(counter->value == 45);
+        REQUIRE(counter.UseCount() == 1);
+    }
+
+    SECTION("Owning links inside the segment") {
+        auto root = segment.MakeShared<TreeNode>();
+        root->value = 1;
+        root->child = segment.MakeShared<TreeNode>();
+        root->child->value = 2;
+        root->child->child = segment.MakeShared<TreeNode>();
+        root->child->child->value = 3;
+        size_t in_use = segment.BytesInUse();
+        segment.SetRoot(root.Release());
+
+        // The child maps the segment elsewhere, walks the links and frees the whole chain
+        REQUIRE(InChild([&] {
+                    auto remapped = SharedSegment::Open(segment.Fd());
+                    auto mine = InterprocessSharedPtr<TreeNode>::Adopt(remapped, remapped.Root());
+                    int sum = 0;
+                    for (auto* node = mine.Get(); node != nullptr; node = node->child.Get()) {
+                        sum += node->value;
+                    }
+                    if (sum != 6 || mine->child.UseCount() != 1) {
+                        return 2;
+                    }
+                    remapped.SetRoot(0);
+                    mine.Reset();
+                    return 0;
+                }) == 0);
+        REQUIRE(segment.BytesInUse() == in_use - 3 * 64);
+    }
+
+    SECTION("Ownership handed to the parent") {
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        size_t in_use = segment.BytesInUse();
+        REQUIRE(InChild([&] {
+                    auto made = segment.MakeShared<Counter>();
+                    made->value = 42;
+                    uint64_t offset = made.Release();
+                    return write(fds[1], &offset, sizeof(offset)) == sizeof(offset) ? 0 : 1;
+                }) == 0);
+        uint64_t offset = 0;
+        REQUIRE(read(fds[0], &offset, sizeof(offset)) == sizeof(offset));
+        close(fds[0]);
+        close(fds[1]);
+
+        auto adopted = InterprocessSharedPtr<Counter>::Adopt(segment, offset);
+        REQUIRE(adopted->value == 42);
+        REQUIRE(adopted.UseCount() == 1);
+        REQUIRE(segment.BytesInUse() > in_use);
+        adopted.Reset();
+        REQUIRE(segment.BytesInUse() == in_use);
+    }
+}
@@ -1,7 +1,19 @@
 #pragma once
 
-#include <cstddef>  // for std::nullptr_t
-#include <utility>  // for std::exchange / std::swap
+#include <cstddef>     // for std::nullptr_t
+#include <functional>  // for std::hash
+#include <utility>     // for std::exchange / std::swap
+
+#include <common/sized_delete.h>
+
+#ifdef SMART_PTR_EVENT_TRACER
+#include <event-tracer/event_tracer.h>
+#endif
+
+#ifdef SHARED_PTR_LEAK_TRACKER
+#include <leak-tracker/leak_tracker_core.h>
+#include <typeinfo>
+#endif
 
 class SimpleCounter {
 public:
@@ -26,13 +38,33 @@ private:
 struct DefaultDelete {
     template <typename T>
     static void Destroy(T* object) {
-        delete object;
+        SizedDelete(object);
     }
 };
 
 template <typename Derived, typename Counter, typename Deleter>
 class RefCounted {
 public:
+#ifdef SHARED_PTR_LEAK_TRACKER
+    // Every object may be sampled by `LeakTracker`
+    RefCounted() {
+        LeakTrackerCreated();
+    }
+    RefCounted(const RefCounted& other) : counter_(other.counter_) {
+        LeakTrackerCreated();
+    }
+    // Whether the object is sampled doesn't change
+    RefCounted& operator=(const RefCounted& other) {
+        counter_ = other.counter_;
+        return *this;
+    }
+    ~RefCounted() {
+        if (leak_sampled_) {
+            LeakTracker::Global().Forget(this);
+        }
+    }
+#endif
+
     // Increase reference counter.
     void IncRef() {
         counter_.IncRef();
@@ -42,6 +74,9 @@ public:
     // Destroy object using Deleter when the last instance dies.
     void DecRef() {
         if (counter_.DecRef() == 0) {
+#ifdef SMART_PTR_EVENT_TRACER
+            EventTracer::Span span("Release", typeid(Derived));
+#endif
             Deleter::Destroy(static_cast<Derived*>(this));
         }
     }
@@ -52,6 +87,16 @@ public:
     }
 
 private:
+#ifdef SHARED_PTR_LEAK_TRACKER
+    void LeakTrackerCreated() {
+        if (LeakTracker::Global().ShouldSample()) {
+            leak_sampled_ = true;
+            LeakTracker::Global().Record(this, sizeof(Derived), typeid(Derived));
+        }
+    }
+
+    bool leak_sampled_ = false;
+#endif
     Counter counter_;
 };
 
@@ -166,7 +211,17 @@ public:
     T* object = nullptr;
 };
 
+template <typename T>
+struct std::hash<IntrusivePtr<T>> {
+    size_t operator()(const IntrusivePtr<T>& ptr) const {
+        return std::hash<T*>()(ptr.Get());
+    }
+};
+
 template <typename T, typename... Args>
 IntrusivePtr<T> MakeIntrusive(Args&&... args) {
+#ifdef SMART_PTR_EVENT_TRACER
+    EventTracer::Span span("MakeIntrusive", typeid(T));
+#endif
     return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
 }
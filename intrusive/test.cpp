@@ -386,3 +386,10 @@ TEST_CASE("Object pool") {
         REQUIRE(strs.NumInUse() == 1);
     }
 }
+
+TEST_CASE("Hash") {
+    auto a = MakeIntrusive<MyString>("a");
+    IntrusivePtr<MyString> b(a);
+    REQUIRE(std::hash<IntrusivePtr<MyString>>()(a) == std::hash<MyString*>()(a.Get()));
+    REQUIRE(std::hash<IntrusivePtr<MyString>>()(a) == std::hash<IntrusivePtr<MyString>>()(b));
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <parallel-release/parallel_release.h>
+
+#include <utility>  // std::forward
+#include <vector>
+
+// Destruction of long chains without recursion.
+//
+// Nodes opt in through the `ReleaseChildren` member of `ParallelRelease` and are created with
+// `MakeSharedIterative<T>` or deleted through `IterativeDelete` (`UniquePtr`, `RefCounted`).
+// When such a node dies, the children it owns exclusively are first moved to a worklist of the
+// current thread, so destroying the node itself cascades into nothing. The outermost release then
+// takes the children off the worklist one by one, and so on, until it's empty: the stack stays
+// flat however long the chain is.
+//
+// `ReleaseChildren` may be called more than once for the same node; the pointers it visits are
+// empty the second time.
+class IterativeRelease {
+    struct Worklist {
+        static void Push(void* worklist, ReleaseTask task) {
+            static_cast<Worklist*>(worklist)->tasks.push_back(task);
+        }
+
+        std::vector<ReleaseTask> tasks;
+        // Some release up the stack is taking tasks off the worklist
+        bool draining = false;
+    };
+
+public:
+    // Detaches the children of `object`, then calls `destroy()` and, unless this is a nested
+    // release, releases the detached children.
+    template <typename T, typename F>
+    static void Release(T* object, F&& destroy) {
+        Worklist& worklist = Local();
+        ReleaseVisitor release(&Worklist::Push, &worklist);
+        if constexpr (HasReleaseChildren<T>) {
+            object->ReleaseChildren(release);
+        }
+        destroy();
+        if (worklist.draining) {
+            return;
+        }
+        worklist.draining = true;
+        while (!worklist.tasks.empty()) {
+            ReleaseTask task = worklist.tasks.back();
+            worklist.tasks.pop_back();
+            task.run(release, task.object, task.block);
+        }
+        worklist.draining = false;
+    }
+
+private:
+    static Worklist& Local() {
+        thread_local Worklist worklist;
+        return worklist;
+    }
+};
+
+// Control block of `MakeSharedIterative`.
+template <typename T>
+class ControlBlockIterative : public ControlBlockBasic {
+public:
+    template <typename... Args>
+    ControlBlockIterative(Args&&... args) {
+        new (&x) T(std::forward<Args>(args)...);
+        ++strong_cnt;
+    }
+    void DecreaseStrong() override {
+        if (strong_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            IterativeRelease::Release(Get(), [this] {
+                DestroyObject();
+                DecreaseWeak();
+            });
+        }
+    }
+    void DestroyObject() override {
+        Get()->~T();
+    }
+    T* Get() {
+        return reinterpret_cast<T*>(&x);
+    }
+
+    alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
+};
+
+template <typename T, typename... Args>
+SharedPtr<T> MakeSharedIterative(Args&&... args) {
+    auto block = new ControlBlockIterative<T>(std::forward<Args>(args)...);
+    return SharedPtr<T>(block, block->Get());
+}
+
+// Deleter releasing the object through `IterativeRelease`: `Destroy` for `RefCounted`,
+// `operator()` for `UniquePtr`.
+struct IterativeDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        IterativeRelease::Release(object, [object] { SizedDelete(object); });
+    }
+
+    template <typename T>
+    void operator()(T* object) const {
+        if (object != nullptr) {
+            Destroy(object);
+        }
+    }
+};
@@ -0,0 +1,114 @@
+#include "iterative.h"
+
+#include <common/tracked.h>
+#include <shared-from-this/weak.h>
+
+#include <catch.hpp>
+
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+constexpr int kLength = 10'000'000;
+
+struct SharedNode : Tracked {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(next);
+    }
+
+    SharedPtr<SharedNode> next;
+};
+
+struct UniqueNode : Tracked {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(next);
+    }
+
+    UniquePtr<UniqueNode, IterativeDelete> next;
+};
+
+struct IntrusiveNode : Tracked, SimpleRefCounted<IntrusiveNode, IterativeDelete> {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(next);
+    }
+
+    IntrusivePtr<IntrusiveNode> next;
+};
+
+struct TreeNode : Tracked {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(children);
+    }
+
+    std::vector<SharedPtr<TreeNode>> children;
+};
+
+}  // namespace
+
+TEST_CASE("SharedPtr chain") {
+    auto head = MakeSharedIterative<SharedNode>();
+    SharedNode* tail = head.Get();
+    for (int i = 1; i < kLength; ++i) {
+        tail->next = MakeSharedIterative<SharedNode>();
+        tail = tail->next.Get();
+    }
+    REQUIRE(Tracked::alive == kLength);
+    head.Reset();
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Only the head is iterative") {
+    // The children are detached by the visitor, whatever created them
+    auto head = MakeSharedIterative<SharedNode>();
+    SharedNode* tail = head.Get();
+    for (int i = 1; i < kLength; ++i) {
+        tail->next = MakeShared<SharedNode>();
+        tail = tail->next.Get();
+    }
+    head.Reset();
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("UniquePtr chain") {
+    UniquePtr<UniqueNode, IterativeDelete> head(new UniqueNode());
+    UniqueNode* tail = head.Get();
+    for (int i = 1; i < kLength; ++i) {
+        tail->next.Reset(new UniqueNode());
+        tail = tail->next.Get();
+    }
+    REQUIRE(Tracked::alive == kLength);
+    head = nullptr;
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("IntrusivePtr chain") {
+    auto head = MakeIntrusive<IntrusiveNode>();
+    IntrusiveNode* tail = head.Get();
+    for (int i = 1; i < kLength; ++i) {
+        tail->next = MakeIntrusive<IntrusiveNode>();
+        tail = tail->next.Get();
+    }
+    REQUIRE(Tracked::alive == kLength);
+    head.Reset();
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Shared nodes survive") {
+    auto root = MakeSharedIterative<TreeNode>();
+    for (int i = 0; i < 3; ++i) {
+        root->children.push_back(MakeSharedIterative<TreeNode>());
+        root->children.back()->children.push_back(MakeShared<TreeNode>());
+    }
+    WeakPtr<TreeNode> weak = root;
+    auto kept = root->children[1];
+
+    root.Reset();
+    REQUIRE(weak.Expired());
+    REQUIRE(Tracked::alive == 2);
+    REQUIRE(kept.UseCount() == 1);
+    REQUIRE(kept->children.size() == 1);
+    kept.Reset();
+    REQUIRE(Tracked::alive == 0);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+#include <intrusive/intrusive.h>
+#include <leak-tracker/leak_tracker_core.h>
+
+#include <typeinfo>
+#include <utility>  // std::forward
+
+// Control block of `MakeTracked`.
+template <typename T>
+class ControlBlockTracked : public ControlBlockBasic {
+public:
+    template <typename... Args>
+    ControlBlockTracked(Args&&... args) {
+        new (&x) T(std::forward<Args>(args)...);
+        ++strong_cnt;
+        if (LeakTracker::Global().ShouldSample()) {
+            sampled_ = true;
+            LeakTracker::Global().Record(this, sizeof(*this), typeid(T));
+        }
+    }
+    void DestroyObject() override {
+        if (sampled_) {
+            LeakTracker::Global().Forget(this);
+        }
+        Get()->~T();
+    }
+    T* Get() {
+        return reinterpret_cast<T*>(&x);
+    }
+
+    alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
+
+private:
+    bool sampled_ = false;
+};
+
+template <typename T, typename... Args>
+SharedPtr<T> MakeTracked(Args&&... args) {
+    auto block = new ControlBlockTracked<T>(std::forward<Args>(args)...);
+    return SharedPtr<T>(block, block->Get());
+}
+
+// `RefCounted` whose objects may be sampled.
+template <typename Derived, typename Counter = SimpleCounter, typename Deleter = DefaultDelete>
+class TrackedRefCounted : public RefCounted<Derived, Counter, Deleter> {
+public:
+    TrackedRefCounted() {
+        Sample();
+    }
+    TrackedRefCounted(const TrackedRefCounted&) {
+        Sample();
+    }
+    TrackedRefCounted& operator=(const TrackedRefCounted&) {
+        return *this;
+    }
+    ~TrackedRefCounted() {
+        if (sampled_) {
+            LeakTracker::Global().Forget(this);
+        }
+    }
+
+private:
+    void Sample() {
+        // With `SHARED_PTR_LEAK_TRACKER`, `RefCounted` samples every object itself
+#ifndef SHARED_PTR_LEAK_TRACKER
+        if (LeakTracker::Global().ShouldSample()) {
+            sampled_ = true;
+            LeakTracker::Global().Record(this, sizeof(Derived), typeid(Derived));
+        }
+#endif
+    }
+
+    bool sampled_ = false;
+};
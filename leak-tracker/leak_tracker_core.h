@@ -0,0 +1,191 @@
+#pragma once
+
+#include <common/backtrace.h>
+#include <common/type_name.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint32_t, uint64_t
+#include <cstdio>   // std::snprintf
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+// Sampled tracking of live objects by allocation site, for finding leaks in production builds.
+//
+// Objects created with `MakeTracked<T>` (for `SharedPtr`) or derived from `TrackedRefCounted<T>`
+// (for `IntrusivePtr`) may be sampled at creation: one in `SampleRate()` of them, counted per
+// thread, records the backtrace of its creation. Backtraces are deduplicated, so a sampled object
+// costs a table entry with a stack id. The sample is dropped when the object dies.
+//
+// With `SHARED_PTR_LEAK_TRACKER` defined for the whole program, the objects of `MakeShared` and
+// `SharedPtr(new T)` (by their control blocks) and every `RefCounted` object are sampled the same
+// way, so a leak of an ordinary object shows up without changing the code that creates it.
+// Without the macro, the hooks in `ControlBlockBasic` and `RefCounted` are empty.
+//
+// `DumpLive()` groups the sampled objects that are still alive by allocation site and type. Every
+// sample stands for `rate` objects, where `rate` is the rate at the time it was taken, so the
+// estimated counts and bytes stay right when the rate changes.
+//
+// Tracking is off until `SetSampleRate` is called with a nonzero rate; then, an object that isn't
+// sampled costs a thread-local countdown.
+class LeakTracker {
+public:
+    static constexpr size_t kMaxFrames = 24;
+
+    struct LiveGroup {
+        const std::type_info* type = nullptr;
+        // Return addresses, innermost first
+        std::vector<void*> frames;
+        // Sampled objects and their bytes
+        size_t count = 0;
+        size_t bytes = 0;
+        // Scaled by the sampling rates
+        size_t estimated_count = 0;
+        size_t estimated_bytes = 0;
+    };
+
+    static LeakTracker& Global() {
+        static LeakTracker* tracker = new LeakTracker();
+        return *tracker;
+    }
+
+    LeakTracker(const LeakTracker&) = delete;
+    LeakTracker& operator=(const LeakTracker&) = delete;
+
+    // Sample one object in `rate`; 0 stops sampling (live samples are kept).
+    void SetSampleRate(uint64_t rate) {
+        rate_.store(rate, std::memory_order_relaxed);
+        // Restarts the countdowns
+        generation_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t SampleRate() const {
+        return rate_.load(std::memory_order_relaxed);
+    }
+
+    // Whether the object being created should be sampled. If so, the caller reports it with
+    // `Record` and must `Forget` it when it dies.
+    bool ShouldSample() {
+        uint64_t rate = rate_.load(std::memory_order_relaxed);
+        if (rate == 0) {
+            return false;
+        }
+        thread_local Countdown countdown;
+        uint64_t generation = generation_.load(std::memory_order_relaxed);
+        if (countdown.generation != generation) {
+            countdown.generation = generation;
+            countdown.left = rate;
+        }
+        if (--countdown.left != 0) {
+            return false;
+        }
+        countdown.left = rate;
+        return true;
+    }
+
+    // Never inlined, so the backtrace starts at a known frame: this one is skipped.
+    [[gnu::noinline]] void Record(const void* object, size_t bytes, const std::type_info& type) {
+        std::array<void*, kMaxFrames + 1> frames;
+        int depth = backtrace(frames.data(), frames.size());
+        uint32_t stack_id = stacks_.Intern(frames.data() + 1, std::max(depth - 1, 0));
+
+        Shard& shard = ShardOf(object);
+        std::lock_guard lock(shard.mutex);
+        shard.live[object] = {&type, stack_id, bytes, std::max<uint64_t>(SampleRate(), 1)};
+    }
+
+    void Forget(const void* object) {
+        Shard& shard = ShardOf(object);
+        std::lock_guard lock(shard.mutex);
+        shard.live.erase(object);
+    }
+
+    // Sampled live objects
+    size_t NumSampled() const {
+        size_t res = 0;
+        for (auto& shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            res += shard.live.size();
+        }
+        return res;
+    }
+
+    // Groups of live samples, the most bytes first.
+    std::vector<LiveGroup> DumpLive() const {
+        std::map<std::pair<uint32_t, const std::type_info*>, LiveGroup> groups;
+        for (auto& shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            for (auto& [object, sample] : shard.live) {
+                LiveGroup& group = groups[{sample.stack, sample.type}];
+                group.type = sample.type;
+                group.count += 1;
+                group.bytes += sample.bytes;
+                group.estimated_count += sample.weight;
+                group.estimated_bytes += sample.bytes * sample.weight;
+            }
+        }
+
+        std::vector<LiveGroup> res;
+        for (auto& [key, group] : groups) {
+            group.frames = stacks_.Frames(key.first);
+            res.push_back(std::move(group));
+        }
+        std::sort(res.begin(), res.end(), [](const LiveGroup& left, const LiveGroup& right) {
+            return left.estimated_bytes > right.estimated_bytes;
+        });
+        return res;
+    }
+
+    // `DumpLive` as text, with the frames symbolized (see `WriteFrames`).
+    void WriteLive(std::ostream& out, size_t top = 20) const {
+        auto groups = DumpLive();
+        out << groups.size() << " allocation sites\n";
+        for (size_t i = 0; i < std::min(top, groups.size()); ++i) {
+            const LiveGroup& group = groups[i];
+            char line[128];
+            std::snprintf(line, sizeof(line), "~%zu objects, ~%zu bytes (%zu sampled): ",
+                          group.estimated_count, group.estimated_bytes, group.count);
+            out << line << TypeName(*group.type) << "\n";
+            WriteFrames(out, group.frames);
+        }
+    }
+
+private:
+    struct Countdown {
+        uint64_t generation = -1;
+        uint64_t left = 0;
+    };
+
+    struct Sample {
+        const std::type_info* type;
+        uint32_t stack;
+        size_t bytes;
+        // Objects this sample stands for
+        uint64_t weight;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<const void*, Sample> live;
+    };
+
+    static constexpr size_t kShards = 16;
+
+    LeakTracker() = default;
+
+    Shard& ShardOf(const void* object) {
+        return shards_[(reinterpret_cast<uintptr_t>(object) >> 4) % kShards];
+    }
+
+    std::atomic<uint64_t> rate_ = 0;
+    std::atomic<uint64_t> generation_ = 0;
+    Shard shards_[kShards];
+    StackTable<kMaxFrames> stacks_;
+};
@@ -0,0 +1,141 @@
+#include "leak_tracker.h"
+
+#include <catch.hpp>
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Payload {
+    char data[100];
+};
+
+struct Intrusive : TrackedRefCounted<Intrusive> {
+    int value = 0;
+};
+
+[[gnu::noinline]] SharedPtr<Payload> FirstSite() {
+    return MakeTracked<Payload>();
+}
+
+[[gnu::noinline]] SharedPtr<Payload> SecondSite() {
+    return MakeTracked<Payload>();
+}
+
+constexpr size_t kBlockSize = sizeof(ControlBlockTracked<Payload>);
+
+}  // namespace
+
+TEST_CASE("Groups by site") {
+    auto& tracker = LeakTracker::Global();
+    tracker.SetSampleRate(1);
+
+    std::vector<SharedPtr<Payload>> live;
+    for (int i = 0; i < 3; ++i) {
+        live.push_back(FirstSite());
+    }
+    live.push_back(SecondSite());
+    auto copy = live[0];
+    REQUIRE(tracker.NumSampled() == 4);
+
+    auto groups = tracker.DumpLive();
+    REQUIRE(groups.size() == 2);
+    REQUIRE(groups[0].count == 3);
+    REQUIRE(groups[0].bytes == 3 * kBlockSize);
+    REQUIRE(groups[0].estimated_bytes == 3 * kBlockSize);
+    REQUIRE(groups[1].count == 1);
+    REQUIRE(*groups[0].type == typeid(Payload));
+    REQUIRE(!groups[0].frames.empty());
+    REQUIRE(groups[0].frames != groups[1].frames);
+
+    std::ostringstream text;
+    tracker.WriteLive(text);
+    REQUIRE(text.str().find("2 allocation sites") == 0);
+    REQUIRE(text.str().find("Payload") != std::string::npos);
+
+    live.clear();
+    REQUIRE(tracker.NumSampled() == 1);
+    copy.Reset();
+    REQUIRE(tracker.NumSampled() == 0);
+    REQUIRE(tracker.DumpLive().empty());
+    tracker.SetSampleRate(0);
+}
+
+TEST_CASE("Sampling") {
+    auto& tracker = LeakTracker::Global();
+
+    std::vector<SharedPtr<Payload>> live;
+    for (int i = 0; i < 1000; ++i) {
+        live.push_back(FirstSite());
+    }
+    REQUIRE(tracker.NumSampled() == 0);
+
+    tracker.SetSampleRate(100);
+    for (int i = 0; i < 1000; ++i) {
+        live.push_back(FirstSite());
+    }
+    REQUIRE(tracker.NumSampled() == 10);
+    auto groups = tracker.DumpLive();
+    REQUIRE(groups.size() == 1);
+    REQUIRE(groups[0].estimated_count == 1000);
+    REQUIRE(groups[0].estimated_bytes == 1000 * kBlockSize);
+
+    // Samples keep the rate they were taken with
+    tracker.SetSampleRate(10);
+    for (int i = 0; i < 100; ++i) {
+        live.push_back(SecondSite());
+    }
+    REQUIRE(tracker.NumSampled() == 20);
+    size_t estimated = 0;
+    for (auto& group : tracker.DumpLive()) {
+        estimated += group.estimated_count;
+    }
+    REQUIRE(estimated == 1100);
+
+    tracker.SetSampleRate(0);
+    live.clear();
+    REQUIRE(tracker.NumSampled() == 0);
+}
+
+TEST_CASE("TrackedRefCounted") {
+    auto& tracker = LeakTracker::Global();
+    tracker.SetSampleRate(1);
+
+    auto ptr = MakeIntrusive<Intrusive>();
+    auto groups = tracker.DumpLive();
+    REQUIRE(groups.size() == 1);
+    REQUIRE(*groups[0].type == typeid(Intrusive));
+    REQUIRE(groups[0].bytes == sizeof(Intrusive));
+
+    ptr.Reset();
+    REQUIRE(tracker.NumSampled() == 0);
+    tracker.SetSampleRate(0);
+}
+
+TEST_CASE("Threads") {
+    auto& tracker = LeakTracker::Global();
+    tracker.SetSampleRate(2);
+
+    std::vector<std::vector<SharedPtr<Payload>>> live(4);
+    std::vector<std::thread> threads;
+    for (auto& objects : live) {
+        threads.emplace_back([&objects] {
+            for (int i = 0; i < 1000; ++i) {
+                objects.push_back(FirstSite());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(tracker.NumSampled() == 2000);
+    REQUIRE(tracker.DumpLive()[0].estimated_count == 4000);
+
+    live.clear();
+    REQUIRE(tracker.NumSampled() == 0);
+    tracker.SetSampleRate(0);
+}
@@ -0,0 +1,78 @@
+// Built with `SHARED_PTR_LEAK_TRACKER`: ordinary objects are sampled as well.
+
+#include "leak_tracker.h"
+
+#include <shared-from-this/weak.h>
+
+#include <catch.hpp>
+
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Payload {
+    char data[100];
+};
+
+struct Intrusive : SimpleRefCounted<Intrusive> {
+    int value = 0;
+};
+
+struct Tracked : TrackedRefCounted<Tracked> {
+    int value = 0;
+};
+
+[[gnu::noinline]] SharedPtr<Payload> Site() {
+    return MakeShared<Payload>();
+}
+
+}  // namespace
+
+TEST_CASE("Stray copies of ordinary objects") {
+    auto& tracker = LeakTracker::Global();
+    tracker.SetSampleRate(1);
+
+    std::vector<SharedPtr<Payload>> live;
+    for (int i = 0; i < 3; ++i) {
+        live.push_back(Site());
+    }
+    auto stray = live[1];
+    live.clear();
+
+    auto groups = tracker.DumpLive();
+    REQUIRE(groups.size() == 1);
+    REQUIRE(groups[0].count == 1);
+    REQUIRE(*groups[0].type == typeid(Payload));
+    REQUIRE(groups[0].bytes == sizeof(ControlBlockRawMemory<Payload>));
+    REQUIRE(!groups[0].frames.empty());
+
+    stray.Reset();
+    REQUIRE(tracker.NumSampled() == 0);
+    tracker.SetSampleRate(0);
+}
+
+TEST_CASE("Every kind of object is sampled once") {
+    auto& tracker = LeakTracker::Global();
+    tracker.SetSampleRate(1);
+
+    SharedPtr<Payload> owned(new Payload());
+    auto made = MakeShared<Payload>();
+    auto tracked = MakeTracked<Payload>();
+    auto intrusive = MakeIntrusive<Intrusive>();
+    auto tracked_intrusive = MakeIntrusive<Tracked>();
+    REQUIRE(tracker.NumSampled() == 5);
+
+    // The control block outlives the object while a `WeakPtr` holds it
+    WeakPtr<Payload> weak = made;
+    made.Reset();
+    REQUIRE(tracker.NumSampled() == 4);
+
+    owned.Reset();
+    tracked.Reset();
+    intrusive.Reset();
+    tracked_intrusive.Reset();
+    REQUIRE(tracker.NumSampled() == 0);
+    tracker.SetSampleRate(0);
+}
@@ -0,0 +1,172 @@
+#include "versioned.h"
+
+#include <common/tracked.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Snapshot reads") {
+    MvccDomain domain;
+    auto record = domain.MakeRecord<std::string>();
+
+    auto empty = domain.BeginSnapshot();
+    REQUIRE(!record->Read(empty));
+
+    auto t1 = domain.Commit([&](auto& tx) { record->Write(tx, "one"); });
+    auto s1 = domain.BeginSnapshot();
+    REQUIRE(s1.Time() == t1);
+
+    auto t2 = domain.Commit([&](auto& tx) { record->Write(tx, "two"); });
+    REQUIRE(t2 == t1 + 1);
+    auto s2 = domain.BeginSnapshot();
+
+    domain.Commit([&](auto& tx) { record->Remove(tx); });
+    auto s3 = domain.BeginSnapshot();
+
+    REQUIRE(!record->Read(empty));
+    REQUIRE(*record->Read(s1) == "one");
+    REQUIRE(*record->Read(s2) == "two");
+    REQUIRE(!record->Read(s3));
+    {
+        EpochDomain::Guard guard;
+        REQUIRE(*record->Borrow(guard, s2) == "two");
+        REQUIRE(record->Borrow(guard, s3) == nullptr);
+    }
+    REQUIRE(record->NumVersions() == 3);
+}
+
+TEST_CASE("Transactions are atomic") {
+    MvccDomain domain;
+    auto a = domain.MakeRecord<int>();
+    auto b = domain.MakeRecord<int>();
+    domain.Commit([&](auto& tx) {
+        a->Write(tx, 1);
+        b->Write(tx, 1);
+    });
+    auto before = domain.BeginSnapshot();
+    domain.Commit([&](auto& tx) {
+        a->Write(tx, 2);
+        b->Write(tx, 2);
+    });
+    auto after = domain.BeginSnapshot();
+    REQUIRE(*a->Read(before) + *b->Read(before) == 2);
+    REQUIRE(*a->Read(after) + *b->Read(after) == 4);
+}
+
+TEST_CASE("Prune") {
+    auto& epochs = EpochDomain::Global();
+    epochs.Barrier();
+    int alive = Tracked::alive;
+    {
+        MvccDomain domain;
+        auto record = domain.MakeRecord<Tracked>();
+        for (int i = 0; i < 5; ++i) {
+            domain.Commit([&](auto& tx) { record->Write(tx, i); });
+        }
+
+        SECTION("Keeps the versions live snapshots see") {
+            domain.Commit([&](auto& tx) { record->Write(tx, 5); });
+            auto old = domain.BeginSnapshot();
+            domain.Commit([&](auto& tx) { record->Write(tx, 6); });
+            domain.Commit([&](auto& tx) { record->Write(tx, 7); });
+
+            auto stats = domain.Prune();
+            REQUIRE(stats.records == 1);
+            REQUIRE(stats.dropped == 5);
+            REQUIRE(stats.held == 0);
+            epochs.Barrier();
+            REQUIRE(record->NumVersions() == 3);
+            REQUIRE(Tracked::alive == alive + 3);
+            REQUIRE(record->Read(old)->value == 5);
+
+            old = Snapshot();
+            REQUIRE(domain.Prune().dropped == 2);
+            REQUIRE(record->NumVersions() == 1);
+            REQUIRE(record->Read(domain.BeginSnapshot())->value == 7);
+        }
+
+        SECTION("Read values outlive pruning") {
+            auto value = record->Read(domain.BeginSnapshot());
+            auto first = domain.BeginSnapshot();
+            domain.Commit([&](auto& tx) { record->Write(tx, 5); });
+            auto held = record->Read(first);
+            first = Snapshot();
+
+            auto stats = domain.Prune();
+            REQUIRE(stats.dropped == 5);
+            REQUIRE(stats.held == 1);
+            epochs.Barrier();
+            REQUIRE(held->value == 4);
+            REQUIRE(Tracked::alive == alive + 2);
+        }
+
+        SECTION("Dead records are unregistered") {
+            record = SharedPtr<Versioned<Tracked>>();
+            REQUIRE(domain.Prune().records == 0);
+        }
+    }
+    epochs.Barrier();
+    REQUIRE(Tracked::alive == alive);
+}
+
+TEST_CASE("Readers and writers with a background pruner") {
+    MvccDomain domain;
+    const int n = 16;
+    std::vector<SharedPtr<Versioned<int>>> records;
+    for (int i = 0; i < n; ++i) {
+        records.push_back(domain.MakeRecord<int>());
+    }
+    // Invariant: all records hold the same value
+    domain.Commit([&](auto& tx) {
+        for (auto& record : records) {
+            record->Write(tx, 0);
+        }
+    });
+
+    std::atomic<bool> stop = false;
+    std::atomic<int> bad = 0;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&] {
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto snapshot = domain.BeginSnapshot();
+                int expected = *records[0]->Read(snapshot);
+                for (int round = 0; round < 10; ++round) {
+                    EpochDomain::Guard guard;
+                    for (auto& record : records) {
+                        if (*record->Borrow(guard, snapshot) != expected) {
+                            ++bad;
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    {
+        BackgroundPruner pruner(domain, std::chrono::milliseconds(1));
+        for (int i = 1; i <= 2000; ++i) {
+            domain.Commit([&](auto& tx) {
+                for (auto& record : records) {
+                    record->Write(tx, i);
+                }
+            });
+        }
+        stop = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+    }
+    REQUIRE(bad == 0);
+
+    domain.Prune();
+    for (auto& record : records) {
+        REQUIRE(record->NumVersions() == 1);
+    }
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <epoch/epoch.h>
+#include <shared-from-this/weak.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint64_t
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>  // std::in_place
+#include <vector>
+
+// Multi-version records with snapshot reads.
+// Every commit gets the next timestamp of its `MvccDomain` and prepends a version stamped with it
+// to each record it writes. A snapshot taken at time `t` sees, in every record, the newest version
+// with a timestamp not greater than `t`; later commits do not change what it reads.
+// Versions are `MakeEpochShared`-style blocks: a record owns a strong reference to its newest
+// version and every version owns one to the previous. Readers walk the chain with raw pointers
+// inside an `EpochDomain::Guard` and take no locks.
+
+using Timestamp = uint64_t;
+
+class MvccDomain;
+
+struct PruneStats {
+    size_t records = 0;
+    // Versions unlinked from their chains
+    size_t dropped = 0;
+    // ... of which are still held by readers through `SharedPtr`s from `Read`
+    size_t held = 0;
+
+    PruneStats& operator+=(const PruneStats& other) {
+        records += other.records;
+        dropped += other.dropped;
+        held += other.held;
+        return *this;
+    }
+};
+
+// Point in time for reading. Versions visible to a snapshot are kept while any copy of it exists.
+class Snapshot {
+public:
+    Snapshot() {
+    }
+
+    Timestamp Time() const {
+        return *time_;
+    }
+    explicit operator bool() const {
+        return static_cast<bool>(time_);
+    }
+
+private:
+    friend class MvccDomain;
+
+    explicit Snapshot(SharedPtr<const Timestamp> time) : time_(std::move(time)) {
+    }
+
+    SharedPtr<const Timestamp> time_;
+};
+
+// Handed to the body of `MvccDomain::Commit`; all writes through it get the same timestamp.
+class Transaction {
+public:
+    Timestamp Time() const {
+        return time_;
+    }
+
+private:
+    friend class MvccDomain;
+
+    explicit Transaction(Timestamp time) : time_(time) {
+    }
+
+    Timestamp time_;
+};
+
+class VersionedBase {
+public:
+    virtual ~VersionedBase() = default;
+
+private:
+    friend class MvccDomain;
+
+    // Unlinks the versions that no snapshot at or after `horizon` can see.
+    virtual PruneStats Prune(Timestamp horizon) = 0;
+};
+
+template <typename T>
+class Versioned : public VersionedBase {
+    struct Version;
+    using Block = ControlBlockEpoch<Version>;
+
+    struct Version {
+        template <typename... Args>
+        Version(Timestamp commit, Args&&... args)
+            : commit(commit), value(std::forward<Args>(args)...) {
+        }
+        ~Version() {
+            if (Block* block = prev.load(std::memory_order_relaxed)) {
+                block->DecreaseStrong();
+            }
+        }
+
+        const Timestamp commit;
+        // Empty for a removal
+        const std::optional<T> value;
+        // Owns a strong reference
+        std::atomic<Block*> prev = nullptr;
+    };
+
+public:
+    Versioned() {
+    }
+    Versioned(const Versioned&) = delete;
+    Versioned& operator=(const Versioned&) = delete;
+
+    ~Versioned() override {
+        Release(head_.load(std::memory_order_relaxed));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Readers
+
+    // Value visible to `snapshot`, or null if the record didn't exist or was removed at that time.
+    SharedPtr<const T> Read(const Snapshot& snapshot) const {
+        EpochDomain::Guard guard;
+        Block* block = Visible(snapshot.Time());
+        if (block == nullptr || !block->Get()->value || !block->TryIncreaseStrong()) {
+            return SharedPtr<const T>();
+        }
+        return SharedPtr<const T>(block, &*block->Get()->value);
+    }
+
+    // Borrowed view of the visible value, valid while `guard` is alive.
+    const T* Borrow([[maybe_unused]] const EpochDomain::Guard& guard,
+                    const Snapshot& snapshot) const {
+        Block* block = Visible(snapshot.Time());
+        return block == nullptr || !block->Get()->value ? nullptr : &*block->Get()->value;
+    }
+
+    // Number of versions in the chain, for tests and monitoring.
+    size_t NumVersions() const {
+        EpochDomain::Guard guard;
+        size_t res = 0;
+        for (Block* block = head_.load(std::memory_order_acquire); block != nullptr;
+             block = block->Get()->prev.load(std::memory_order_acquire)) {
+            ++res;
+        }
+        return res;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Writers, only inside `MvccDomain::Commit`
+
+    template <typename... Args>
+    void Write(const Transaction& tx, Args&&... args) {
+        Push(new Block(tx.Time(), std::in_place, std::forward<Args>(args)...));
+    }
+
+    void Remove(const Transaction& tx) {
+        Push(new Block(tx.Time()));
+    }
+
+private:
+    // Must be called inside a guard.
+    Block* Visible(Timestamp time) const {
+        Block* block = head_.load(std::memory_order_acquire);
+        while (block != nullptr && block->Get()->commit > time) {
+            block = block->Get()->prev.load(std::memory_order_acquire);
+        }
+        return block;
+    }
+
+    // Commits are serialized by the domain, so there is a single writer of `head_`.
+    void Push(Block* block) {
+        block->Get()->prev.store(head_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        head_.store(block, std::memory_order_release);
+    }
+
+    PruneStats Prune(Timestamp horizon) override {
+        PruneStats stats;
+        stats.records = 1;
+        EpochDomain::Guard guard;
+        Block* visible = Visible(horizon);
+        if (visible == nullptr) {
+            return stats;
+        }
+        stats += Release(visible->Get()->prev.exchange(nullptr, std::memory_order_acq_rel));
+        return stats;
+    }
+
+    // Drops the chain starting at `block` (whose reference the caller owns). Links are cut one by
+    // one, so that a version held by a reader doesn't keep the older ones alive and the rest is
+    // freed in one grace period instead of one per version.
+    static PruneStats Release(Block* block) {
+        PruneStats stats;
+        while (block != nullptr) {
+            Block* prev = block->Get()->prev.exchange(nullptr, std::memory_order_acq_rel);
+            ++stats.dropped;
+            // One reference is the chain's own
+            if (block->strong_cnt.load(std::memory_order_relaxed) > 1) {
+                ++stats.held;
+            }
+            block->DecreaseStrong();
+            block = prev;
+        }
+        return stats;
+    }
+
+    std::atomic<Block*> head_ = nullptr;
+};
+
+class MvccDomain {
+public:
+    MvccDomain() {
+    }
+    MvccDomain(const MvccDomain&) = delete;
+    MvccDomain& operator=(const MvccDomain&) = delete;
+
+    // Records are registered weakly: the domain prunes them while somebody else owns them.
+    template <typename T>
+    SharedPtr<Versioned<T>> MakeRecord() {
+        auto record = MakeShared<Versioned<T>>();
+        SharedPtr<VersionedBase> base(record);
+        std::lock_guard lock(registry_mutex_);
+        records_.emplace_back(base);
+        return record;
+    }
+
+    // Latest committed time
+    Timestamp Now() const {
+        return clock_.load(std::memory_order_acquire);
+    }
+
+    Snapshot BeginSnapshot() {
+        std::lock_guard lock(registry_mutex_);
+        // Read under the registry lock, so that a concurrent `Prune` either sees this snapshot
+        // or computes its horizon from a time not later than it
+        auto time = MakeShared<const Timestamp>(clock_.load(std::memory_order_acquire));
+        if (snapshots_.size() >= cleanup_at_) {
+            std::erase_if(snapshots_, [](const auto& weak) { return weak.Expired(); });
+            cleanup_at_ = std::max<size_t>(kMinCleanup, snapshots_.size() * 2);
+        }
+        snapshots_.emplace_back(time);
+        return Snapshot(std::move(time));
+    }
+
+    // Runs `writes(tx)` and makes all of its writes visible at once. Commits are serialized.
+    template <typename F>
+    Timestamp Commit(F&& writes) {
+        std::lock_guard lock(commit_mutex_);
+        Transaction tx(clock_.load(std::memory_order_relaxed) + 1);
+        writes(tx);
+        clock_.store(tx.Time(), std::memory_order_release);
+        return tx.Time();
+    }
+
+    // Drops every version that no live snapshot (and no future one) can see.
+    PruneStats Prune() {
+        std::lock_guard prune_lock(prune_mutex_);
+        Timestamp horizon;
+        std::vector<SharedPtr<VersionedBase>> records;
+        {
+            std::lock_guard lock(registry_mutex_);
+            horizon = clock_.load(std::memory_order_acquire);
+            std::erase_if(snapshots_, [&](const auto& weak) {
+                auto time = weak.Lock();
+                if (!time) {
+                    return true;
+                }
+                horizon = std::min(horizon, *time);
+                return false;
+            });
+            std::erase_if(records_, [&](const auto& weak) {
+                if (auto record = weak.Lock()) {
+                    records.push_back(std::move(record));
+                    return false;
+                }
+                return true;
+            });
+        }
+
+        PruneStats stats;
+        for (auto& record : records) {
+            stats += record->Prune(horizon);
+        }
+        return stats;
+    }
+
+private:
+    static constexpr size_t kMinCleanup = 16;
+
+    std::mutex commit_mutex_;
+    std::atomic<Timestamp> clock_ = 0;
+
+    std::mutex registry_mutex_;
+    std::vector<WeakPtr<const Timestamp>> snapshots_;
+    size_t cleanup_at_ = kMinCleanup;
+    std::vector<WeakPtr<VersionedBase>> records_;
+
+    std::mutex prune_mutex_;
+};
+
+// Calls `domain.Prune()` every `interval` on its own thread until destroyed.
+class BackgroundPruner {
+public:
+    BackgroundPruner(MvccDomain& domain, std::chrono::milliseconds interval)
+        : domain_(domain), interval_(interval), thread_([this] { Run(); }) {
+    }
+    BackgroundPruner(const BackgroundPruner&) = delete;
+    BackgroundPruner& operator=(const BackgroundPruner&) = delete;
+
+    ~BackgroundPruner() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        wakeup_.notify_one();
+        thread_.join();
+    }
+
+    // Sum over all passes so far
+    PruneStats Totals() const {
+        std::lock_guard lock(mutex_);
+        return totals_;
+    }
+
+private:
+    void Run() {
+        std::unique_lock lock(mutex_);
+        while (!wakeup_.wait_for(lock, interval_, [this] { return stop_; })) {
+            lock.unlock();
+            PruneStats stats = domain_.Prune();
+            lock.lock();
+            totals_ += stats;
+        }
+    }
+
+    MvccDomain& domain_;
+    std::chrono::milliseconds interval_;
+    mutable std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stop_ = false;
+    PruneStats totals_;
+    std::thread thread_;
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+#include <intrusive/intrusive.h>
+#include <unique/unique.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint64_t
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Tears large pointer graphs down on a pool of threads.
+//
+// A type takes part by declaring a member `void ReleaseChildren(ReleaseVisitor& release)` that
+// calls `release(ptr)` for every owning pointer it holds (`SharedPtr`, `IntrusivePtr`,
+// `UniquePtr` or vectors of them). When a node is released, each child it owns exclusively is
+// taken out of it and becomes a separate task; children that are still shared are just
+// dereferenced. The node itself is destroyed after that, with nothing left to cascade into, so
+// the teardown never recurses however deep the graph is. Types without `ReleaseChildren` are
+// destroyed in place, as usual.
+//
+// Every worker has its own deque of tasks: it takes from the back of its own and steals from the
+// front of the others'. The thread calling `Release` works as well and returns once the whole
+// graph is gone.
+//
+// Exclusive ownership is checked when a node is queued and again when its task runs: a node that
+// got another owner in between (a copy made by a `ReleaseChildren`, a `WeakPtr` promoted by the
+// caller) is just dereferenced. Nothing may take a reference to a node while its task is running,
+// though.
+
+class ReleaseVisitor;
+
+// An exclusively owned node; `run` adopts the reference and releases the node.
+struct ReleaseTask {
+    void (*run)(ReleaseVisitor&, void* object, ControlBlockBasic* block);
+    void* object;
+    ControlBlockBasic* block;
+};
+
+// Passed to `ReleaseChildren`; leaves the visited pointers empty. Exclusively owned children are
+// handed to `push(context, task)` of the scheduler that runs the release.
+class ReleaseVisitor {
+public:
+    ReleaseVisitor(void (*push)(void* context, ReleaseTask), void* context)
+        : push_(push), context_(context) {
+    }
+
+    template <typename U>
+    void operator()(SharedPtr<U>& ptr);
+    template <typename U>
+    void operator()(IntrusivePtr<U>& ptr);
+    template <typename U, typename D>
+    void operator()(UniquePtr<U, D>& ptr);
+    template <typename P>
+    void operator()(std::vector<P>& ptrs) {
+        for (auto& ptr : ptrs) {
+            (*this)(ptr);
+        }
+    }
+
+private:
+    template <typename U>
+    static void RunShared(ReleaseVisitor& release, void* object, ControlBlockBasic* block) {
+        SharedPtr<U> owner(block, static_cast<U*>(object));
+        if (owner.UseCount() == 1) {
+            owner->ReleaseChildren(release);
+        }
+    }
+
+    template <typename U>
+    static void RunIntrusive(ReleaseVisitor& release, void* object, ControlBlockBasic*) {
+        IntrusivePtr<U> owner;
+        owner.object = static_cast<U*>(object);
+        if (owner.UseCount() == 1) {
+            owner->ReleaseChildren(release);
+        }
+    }
+
+    template <typename U, typename D>
+    static void RunUnique(ReleaseVisitor& release, void* object, ControlBlockBasic*) {
+        UniquePtr<U, D> owner(static_cast<U*>(object));
+        owner->ReleaseChildren(release);
+    }
+
+    void (*push_)(void*, ReleaseTask);
+    void* context_;
+};
+
+template <typename T>
+concept HasReleaseChildren = requires(T& object, ReleaseVisitor& release) {
+    object.ReleaseChildren(release);
+};
+
+class ParallelRelease {
+    struct alignas(64) Worker {
+        ParallelRelease* pool = nullptr;
+        size_t index = 0;
+        std::mutex mutex;
+        std::deque<ReleaseTask> tasks;
+        // Written by the owner only
+        size_t released = 0;
+    };
+
+public:
+    // `threads` includes the thread calling `Release`.
+    explicit ParallelRelease(size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+        : workers_(std::max<size_t>(threads, 1)) {
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            workers_[i].pool = this;
+            workers_[i].index = i;
+        }
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            threads_.emplace_back([this, i] { Loop(i); });
+        }
+    }
+
+    ParallelRelease(const ParallelRelease&) = delete;
+    ParallelRelease& operator=(const ParallelRelease&) = delete;
+
+    ~ParallelRelease() {
+        stop_.store(true, std::memory_order_release);
+        generation_.fetch_add(1, std::memory_order_release);
+        generation_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    // Releases `ptr` (a pointer or a vector of them) and waits until everything that was
+    // owned through it exclusively is destroyed. Leaves `ptr` empty. Returns the number of
+    // nodes released as separate tasks.
+    template <typename P>
+    size_t Release(P& ptr) {
+        std::lock_guard lock(release_mutex_);
+        for (auto& worker : workers_) {
+            worker.released = 0;
+        }
+        ReleaseVisitor release(&ParallelRelease::Push, &workers_[0]);
+        release(ptr);
+        if (pending_.load(std::memory_order_acquire) != 0) {
+            generation_.fetch_add(1, std::memory_order_release);
+            generation_.notify_all();
+            Work(0);
+        }
+        size_t released = 0;
+        for (auto& worker : workers_) {
+            released += worker.released;
+        }
+        return released;
+    }
+
+    size_t NumThreads() const {
+        return workers_.size();
+    }
+
+private:
+    static void Push(void* context, ReleaseTask task) {
+        auto worker = static_cast<Worker*>(context);
+        worker->pool->Push(worker->index, task);
+    }
+
+    // Counted before it's visible, so the workers can't see zero while tasks remain.
+    void Push(size_t worker, ReleaseTask task) {
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard lock(workers_[worker].mutex);
+        workers_[worker].tasks.push_back(task);
+    }
+
+    bool Pop(size_t worker, ReleaseTask& task) {
+        {
+            std::lock_guard lock(workers_[worker].mutex);
+            if (!workers_[worker].tasks.empty()) {
+                task = workers_[worker].tasks.back();
+                workers_[worker].tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            Worker& victim = workers_[(worker + i) % workers_.size()];
+            std::lock_guard lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Runs tasks until the current graph is gone.
+    void Work(size_t worker) {
+        ReleaseVisitor release(&ParallelRelease::Push, &workers_[worker]);
+        ReleaseTask task;
+        while (pending_.load(std::memory_order_acquire) != 0) {
+            if (Pop(worker, task)) {
+                task.run(release, task.object, task.block);
+                ++workers_[worker].released;
+                // Its children are pushed by now
+                pending_.fetch_sub(1, std::memory_order_acq_rel);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void Loop(size_t worker) {
+        uint64_t seen = 0;
+        while (true) {
+            generation_.wait(seen, std::memory_order_acquire);
+            seen = generation_.load(std::memory_order_acquire);
+            if (stop_.load(std::memory_order_acquire)) {
+                return;
+            }
+            Work(worker);
+        }
+    }
+
+    std::vector<Worker> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex release_mutex_;
+    std::atomic<size_t> pending_ = 0;
+    // Bumped to wake the workers up for a new graph
+    std::atomic<uint64_t> generation_ = 0;
+    std::atomic<bool> stop_ = false;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// ReleaseVisitor
+
+template <typename U>
+void ReleaseVisitor::operator()(SharedPtr<U>& ptr) {
+    if constexpr (HasReleaseChildren<U>) {
+        if (ptr.UseCount() == 1) {
+            push_(context_, {&RunShared<U>, ptr.x, ptr.buffer});
+            ptr.buffer = nullptr, ptr.x = nullptr;
+            return;
+        }
+    }
+    ptr.Reset();
+}
+
+template <typename U>
+void ReleaseVisitor::operator()(IntrusivePtr<U>& ptr) {
+    if constexpr (HasReleaseChildren<U>) {
+        if (ptr.UseCount() == 1) {
+            push_(context_, {&RunIntrusive<U>, ptr.object, nullptr});
+            ptr.object = nullptr;
+            return;
+        }
+    }
+    ptr.Reset();
+}
+
+template <typename U, typename D>
+void ReleaseVisitor::operator()(UniquePtr<U, D>& ptr) {
+    // The task recreates the pointer, so the deleter must have no state
+    if constexpr (HasReleaseChildren<U> && std::is_empty_v<D> &&
+                  std::is_default_constructible_v<D>) {
+        if (ptr) {
+            push_(context_, {&RunUnique<U, D>, ptr.Release(), nullptr});
+            return;
+        }
+    }
+    ptr = nullptr;
+}
@@ -0,0 +1,178 @@
+#include "parallel_release.h"
+
+#include <common/tracked.h>
+#include <shared-from-this/weak.h>
+
+#include <catch.hpp>
+
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Leaf : Tracked {};
+
+struct Node : Tracked {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(children);
+        release(leaves);
+    }
+
+    std::vector<SharedPtr<Node>> children;
+    std::vector<UniquePtr<Leaf>> leaves;
+};
+
+struct IntrusiveNode : Tracked, SimpleRefCounted<IntrusiveNode> {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(next);
+        release(unique);
+    }
+
+    IntrusivePtr<IntrusiveNode> next;
+    UniquePtr<IntrusiveNode> unique;
+};
+
+// Takes a reference to its child after queueing it as exclusively owned.
+struct Grabbing : Tracked {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(child);
+        grabbed = observer.Lock();
+    }
+
+    SharedPtr<Node> child;
+    WeakPtr<Node> observer;
+    inline static SharedPtr<Node> grabbed;
+};
+
+// Has state, so a task can't recreate it
+struct CountingDeleter {
+    void operator()(Node* node) const {
+        if (node != nullptr && count != nullptr) {
+            ++*count;
+        }
+        delete node;
+    }
+
+    int* count = nullptr;
+};
+
+struct Owner : Tracked {
+    void ReleaseChildren(ReleaseVisitor& release) {
+        release(child);
+    }
+
+    UniquePtr<Node, CountingDeleter> child;
+};
+
+// Returns the root of a complete tree and the number of its nodes.
+SharedPtr<Node> MakeTree(int depth, int fanout, size_t& size) {
+    auto node = MakeShared<Node>();
+    ++size;
+    node->leaves.emplace_back(new Leaf());
+    if (depth > 0) {
+        for (int i = 0; i < fanout; ++i) {
+            node->children.push_back(MakeTree(depth - 1, fanout, size));
+        }
+    }
+    return node;
+}
+
+}  // namespace
+
+TEST_CASE("Tree") {
+    ParallelRelease pool(4);
+    REQUIRE(pool.NumThreads() == 4);
+
+    size_t size = 0;
+    auto root = MakeTree(6, 4, size);
+    REQUIRE(Tracked::alive == int(size * 2));
+
+    // Every node is a task, the leaves have no `ReleaseChildren` and are destroyed in place
+    REQUIRE(pool.Release(root) == size);
+    REQUIRE(!root);
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Shared children stay alive") {
+    ParallelRelease pool(2);
+
+    size_t size = 0;
+    auto root = MakeTree(3, 3, size);
+    auto kept = root->children[1];
+    auto twice = root->children[2];
+    root->children.push_back(twice);
+
+    pool.Release(root);
+    REQUIRE(kept.UseCount() == 1);
+    REQUIRE(twice.UseCount() == 1);
+    // Two subtrees of 13 nodes with a leaf each
+    REQUIRE(Tracked::alive == 2 * 13 * 2);
+
+    std::vector<SharedPtr<Node>> rest{kept, twice};
+    kept.Reset(), twice.Reset();
+    REQUIRE(pool.Release(rest) == 2 * 13);
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Nodes shared after queueing stay alive") {
+    // One thread, so the child runs after the root has finished
+    ParallelRelease pool(1);
+
+    size_t size = 0;
+    auto root = MakeShared<Grabbing>();
+    root->child = MakeTree(2, 2, size);
+    root->observer = root->child;
+
+    REQUIRE(pool.Release(root) == 2);
+    REQUIRE(Grabbing::grabbed.UseCount() == 1);
+    REQUIRE(Grabbing::grabbed->children.size() == 2);
+    REQUIRE(Tracked::alive == int(size * 2));
+
+    REQUIRE(pool.Release(Grabbing::grabbed) == size);
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Long chains don't recurse") {
+    ParallelRelease pool(1);
+
+    // Intrusive links, unique links every other node
+    auto head = MakeIntrusive<IntrusiveNode>();
+    IntrusiveNode* tail = head.Get();
+    const size_t size = 1'000'000;
+    for (size_t i = 1; i < size; ++i) {
+        if (i % 2 == 0) {
+            tail->next = MakeIntrusive<IntrusiveNode>();
+            tail = tail->next.Get();
+        } else {
+            tail->unique.Reset(new IntrusiveNode());
+            tail = tail->unique.Get();
+        }
+    }
+
+    REQUIRE(pool.Release(head) == size);
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Stateful deleters are called in place") {
+    ParallelRelease pool(2);
+    int deleted = 0;
+    auto owner = MakeShared<Owner>();
+    owner->child = UniquePtr<Node, CountingDeleter>(new Node(), CountingDeleter{&deleted});
+    pool.Release(owner);
+    REQUIRE(deleted == 1);
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Pool is reused") {
+    ParallelRelease pool(3);
+    for (int i = 0; i < 50; ++i) {
+        size_t size = 0;
+        auto root = MakeTree(3, 5, size);
+        REQUIRE(pool.Release(root) == size);
+        REQUIRE(Tracked::alive == 0);
+    }
+
+    SharedPtr<Node> empty;
+    REQUIRE(pool.Release(empty) == 0);
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <interprocess/interprocess.h>
+#include <intrusive/intrusive.h>
+
+#include <algorithm>
+#include <cstddef>  // std::max_align_t
+#include <mutex>
+#include <stdexcept>  // std::logic_error
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Heap in a file mapped with `mmap`: objects created in it and the links between them survive
+// the process and are usable right after the file is mapped again, with no deserialization.
+//
+// Objects derive from `PersistentRefCounted<T>`, so their counters are stored inside them, and link
+// to each other with `OffsetIntrusivePtr<T>`, which stores a self-relative offset instead of an
+// address. In the process they are handled with plain `IntrusivePtr<T>`. The heap keeps one root
+// reference; everything reachable from it outlives the process.
+//
+// Persistent types must not contain addresses: no raw pointers, no virtual functions (the vtable
+// moves between runs), no standard containers. Counters are not atomic, and nothing is crash-safe:
+// a process killed in the middle of an update leaves the heap as it was at that moment. The
+// counters also include the references held by the process (`IntrusivePtr`s), which are written
+// to the file like everything else; after a crash, nothing drops them, so the objects they kept
+// alive stay in the file for good.
+//
+// The heap must outlive the `IntrusivePtr`s to its objects: dropping one after the heap is
+// unmapped touches memory that is gone.
+struct PersistentDelete;
+
+namespace persistent_detail {
+
+template <typename Derived, typename Counter>
+std::true_type UsesPersistentDelete(const RefCounted<Derived, Counter, PersistentDelete>*);
+std::false_type UsesPersistentDelete(const void*);
+
+}  // namespace persistent_detail
+
+class PersistentHeap {
+public:
+    // Maps `path`, creating a heap of `size` bytes if the file doesn't exist.
+    PersistentHeap(const std::string& path, size_t size)
+        : segment_(SharedSegment::OpenFile(path, size)) {
+        std::lock_guard lock(RegistryMutex());
+        Registry().push_back(this);
+    }
+    PersistentHeap(const PersistentHeap&) = delete;
+    PersistentHeap& operator=(const PersistentHeap&) = delete;
+
+    // Every `IntrusivePtr` into the heap must be dropped by now; the objects reachable from the
+    // root stay in the file.
+    ~PersistentHeap() {
+        std::lock_guard lock(RegistryMutex());
+        std::erase(Registry(), this);
+    }
+
+    template <typename T, typename... Args>
+    IntrusivePtr<T> MakeIntrusive(Args&&... args) {
+        static_assert(!std::is_polymorphic_v<T>, "vtables don't survive a restart");
+        static_assert(decltype(persistent_detail::UsesPersistentDelete(
+                          static_cast<T*>(nullptr)))::value,
+                      "Persistent objects must derive from PersistentRefCounted");
+        static_assert(alignof(T) <= alignof(std::max_align_t),
+                      "The segment only aligns to std::max_align_t");
+        void* memory = segment_.Allocate(sizeof(T));
+        try {
+            return IntrusivePtr<T>(::new (memory) T(std::forward<Args>(args)...));
+        } catch (...) {
+            segment_.Deallocate(memory);
+            throw;
+        }
+    }
+
+    // Null if the heap is new.
+    template <typename T>
+    IntrusivePtr<T> Root() const {
+        uint64_t offset = segment_.Root();
+        return offset == 0 ? nullptr : IntrusivePtr<T>(static_cast<T*>(segment_.AtOffset(offset)));
+    }
+    template <typename T>
+    void SetRoot(const IntrusivePtr<T>& root) {
+        IntrusivePtr<T> old = Root<T>();
+        if (old) {
+            // The reference of the slot
+            old->DecRef();
+        }
+        if (root) {
+            root->IncRef();
+        }
+        segment_.SetRoot(root ? segment_.OffsetOf(root.Get()) : 0);
+    }
+
+    void Sync() {
+        segment_.Sync();
+    }
+    SharedSegment& Segment() {
+        return segment_;
+    }
+
+    // Open heap holding `ptr`.
+    static PersistentHeap& Containing(const void* ptr) {
+        std::lock_guard lock(RegistryMutex());
+        for (PersistentHeap* heap : Registry()) {
+            if (heap->segment_.Contains(ptr)) {
+                return *heap;
+            }
+        }
+        throw std::logic_error("Not in a persistent heap");
+    }
+
+private:
+    static std::vector<PersistentHeap*>& Registry() {
+        static std::vector<PersistentHeap*> heaps;
+        return heaps;
+    }
+    static std::mutex& RegistryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    SharedSegment segment_;
+};
+
+// `Deleter` for `RefCounted`: returns the memory to the heap the object lives in.
+struct PersistentDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        SharedSegment& segment = PersistentHeap::Containing(object).Segment();
+        object->~T();
+        segment.Deallocate(object);
+    }
+};
+
+template <typename Derived>
+using PersistentRefCounted = RefCounted<Derived, SimpleCounter, PersistentDelete>;
+
+// `IntrusivePtr` that can be stored in a persistent object: the target is kept as the distance
+// from the pointer itself, which doesn't depend on where the heap is mapped.
+template <typename T>
+class OffsetIntrusivePtr {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    OffsetIntrusivePtr() {
+    }
+    OffsetIntrusivePtr(std::nullptr_t) {
+    }
+    OffsetIntrusivePtr(T* ptr) {
+        Set(ptr);
+        IncRef();
+    }
+    OffsetIntrusivePtr(const IntrusivePtr<T>& ptr) : OffsetIntrusivePtr(ptr.Get()) {
+    }
+    OffsetIntrusivePtr(const OffsetIntrusivePtr& other) : OffsetIntrusivePtr(other.Get()) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    OffsetIntrusivePtr& operator=(const OffsetIntrusivePtr& other) {
+        Reset(other.Get());
+        return *this;
+    }
+    OffsetIntrusivePtr& operator=(const IntrusivePtr<T>& ptr) {
+        Reset(ptr.Get());
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~OffsetIntrusivePtr() {
+        DecRef();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        T* old = Get();
+        offset_ = 0;
+        if (old != nullptr) {
+            old->DecRef();
+        }
+    }
+    // `ptr` may be owned only through the old target (`p = p->next`), so it is referenced first.
+    void Reset(T* ptr) {
+        if (ptr == Get()) {
+            return;
+        }
+        if (ptr != nullptr) {
+            ptr->IncRef();
+        }
+        T* old = Get();
+        Set(ptr);
+        if (old != nullptr) {
+            old->DecRef();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return offset_ == 0 ? nullptr
+                            : reinterpret_cast<T*>(reinterpret_cast<intptr_t>(this) + offset_);
+    }
+    T& operator*() const {
+        return *Get();
+    }
+    T* operator->() const {
+        return Get();
+    }
+    size_t UseCount() const {
+        return offset_ == 0 ? 0 : Get()->RefCount();
+    }
+    explicit operator bool() const {
+        return offset_ != 0;
+    }
+
+    // Process-local handle sharing the ownership
+    IntrusivePtr<T> Local() const {
+        return IntrusivePtr<T>(Get());
+    }
+
+private:
+    void Set(T* ptr) {
+        offset_ = ptr == nullptr ? 0
+                                 : reinterpret_cast<intptr_t>(ptr) - reinterpret_cast<intptr_t>(this);
+    }
+    void IncRef() {
+        if (offset_ != 0) {
+            Get()->IncRef();
+        }
+    }
+    void DecRef() {
+        if (offset_ != 0) {
+            Get()->DecRef();
+        }
+    }
+
+    intptr_t offset_ = 0;
+};
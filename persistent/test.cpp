@@ -0,0 +1,143 @@
+#include "persistent.h"
+
+#include <catch.hpp>
+
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node : PersistentRefCounted<Node> {
+    Node(int value) : value(value) {
+        ++alive;
+    }
+    ~Node() {
+        --alive;
+    }
+
+    inline static int alive = 0;
+    int value;
+    OffsetIntrusivePtr<Node> left;
+    OffsetIntrusivePtr<Node> right;
+};
+
+// Complete tree of the given depth with values 1, 2, ... in heap order
+IntrusivePtr<Node> Build(PersistentHeap& heap, int depth, int value = 1) {
+    auto node = heap.MakeIntrusive<Node>(value);
+    if (depth > 1) {
+        node->left = Build(heap, depth - 1, value * 2);
+        node->right = Build(heap, depth - 1, value * 2 + 1);
+    }
+    return node;
+}
+
+int Sum(const Node* node) {
+    return node == nullptr ? 0 : node->value + Sum(node->left.Get()) + Sum(node->right.Get());
+}
+
+struct TempFile {
+    TempFile() : path("/tmp/persistent-heap-test-" + std::to_string(getpid())) {
+        std::remove(path.c_str());
+    }
+    ~TempFile() {
+        std::remove(path.c_str());
+    }
+
+    std::string path;
+};
+
+}  // namespace
+
+TEST_CASE("OffsetIntrusivePtr counts references") {
+    TempFile file;
+    PersistentHeap heap(file.path, 1 << 16);
+    {
+        auto a = heap.MakeIntrusive<Node>(1);
+        auto b = heap.MakeIntrusive<Node>(2);
+        REQUIRE(a.UseCount() == 1);
+
+        a->left = b;
+        REQUIRE(b.UseCount() == 2);
+        a->right = a->left;
+        REQUIRE(b.UseCount() == 3);
+        a->right.Reset();
+        REQUIRE(b.UseCount() == 2);
+        REQUIRE(a->left.Local().Get() == b.Get());
+
+        b.Reset();
+        REQUIRE(Node::alive == 2);
+        REQUIRE(a->left->value == 2);
+    }
+    REQUIRE(Node::alive == 0);
+    REQUIRE(heap.Segment().BytesInUse() == 0);
+}
+
+TEST_CASE("OffsetIntrusivePtr assigned from its own target") {
+    TempFile file;
+    PersistentHeap heap(file.path, 1 << 16);
+    {
+        auto holder = heap.MakeIntrusive<Node>(0);
+        holder->left = heap.MakeIntrusive<Node>(1);
+        holder->left->left = heap.MakeIntrusive<Node>(42);
+        REQUIRE(Node::alive == 3);
+
+        // The new target is owned only by the old one
+        holder->left = holder->left->left;
+        REQUIRE(Node::alive == 2);
+        REQUIRE(holder->left->value == 42);
+        REQUIRE(holder->left.UseCount() == 1);
+
+        // Its memory must not be handed out again
+        auto a = heap.MakeIntrusive<Node>(99);
+        auto b = heap.MakeIntrusive<Node>(99);
+        REQUIRE(holder->left->value == 42);
+
+        holder->left.Reset();
+        REQUIRE(Node::alive == 3);
+    }
+    REQUIRE(Node::alive == 0);
+    REQUIRE(heap.Segment().BytesInUse() == 0);
+}
+
+TEST_CASE("Graph survives remapping") {
+    TempFile file;
+    const int depth = 10;
+    const int sum = (1 << depth) * ((1 << depth) - 1) / 2;
+    {
+        PersistentHeap heap(file.path, 1 << 20);
+        REQUIRE(!heap.Root<Node>());
+        heap.SetRoot(Build(heap, depth));
+        heap.Sync();
+    }
+    int alive = Node::alive;
+
+    {
+        PersistentHeap heap(file.path, 0);
+        // The same file mapped twice, at different addresses
+        PersistentHeap other(file.path, 0);
+        auto root = heap.Root<Node>();
+        auto other_root = other.Root<Node>();
+        REQUIRE(root.Get() != other_root.Get());
+        REQUIRE(Sum(root.Get()) == sum);
+        REQUIRE(Sum(other_root.Get()) == sum);
+        REQUIRE(&PersistentHeap::Containing(other_root.Get()) == &other);
+
+        // Changes are seen through the other mapping
+        root->left->value = 0;
+        REQUIRE(Sum(other_root.Get()) == sum - 2);
+        root->left->value = 2;
+    }
+
+    {
+        PersistentHeap heap(file.path, 0);
+        REQUIRE(Sum(heap.Root<Node>().Get()) == sum);
+        REQUIRE(heap.Segment().BytesInUse() > 0);
+        heap.SetRoot(IntrusivePtr<Node>());
+        REQUIRE(Node::alive == alive - ((1 << depth) - 1));
+        REQUIRE(heap.Segment().BytesInUse() == 0);
+    }
+}
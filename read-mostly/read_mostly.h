@@ -0,0 +1,198 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+
+#include <atomic>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint64_t
+#include <mutex>
+#include <utility>  // std::forward
+#include <vector>
+
+// Publisher of a read-mostly value.
+// Every reader thread keeps its own cached `SharedPtr` to the last value it saw, tagged with the
+// version it was published under. `Read()` only loads the global version and returns the cached
+// snapshot if it is still current, so readers don't write to any shared counter. Writers publish
+// a new value under the lock and bump the version; readers pick it up on their next `Read()`,
+// releasing their old snapshot.
+//
+// The published `SharedPtr` itself isn't atomic, so it is only read and replaced under `mutex_`;
+// the values it replaces are released after the lock.
+//
+// A thread finds its slot by the publisher id. Ids of destroyed publishers are reused, so the
+// slots of a thread are as many as the publishers alive at once; a generation tells a slot left
+// by a destroyed publisher from one of the publisher now holding the id.
+template <typename T>
+class ReadMostlySharedPtr {
+    // Never published, so a new slot refreshes on its first `Read()`
+    static constexpr uint64_t kStale = static_cast<uint64_t>(-1);
+
+    struct Slot {
+        uint64_t version = kStale;
+        SharedPtr<T> snapshot;
+    };
+
+    struct LocalSlot {
+        // Freed by the publisher if it's gone
+        Slot* slot = nullptr;
+        uint64_t generation = 0;
+    };
+
+    // Slots of the current thread, indexed by publisher id.
+    struct LocalSlots {
+        ~LocalSlots() {
+            std::lock_guard guard(RegistryMutex());
+            auto& registry = Registry();
+            for (size_t id = 0; id < slots.size(); ++id) {
+                const Entry& entry = registry[id];
+                if (slots[id].slot != nullptr && entry.publisher != nullptr &&
+                    entry.generation == slots[id].generation) {
+                    entry.publisher->ReleaseSlot(slots[id].slot);
+                }
+            }
+        }
+
+        std::vector<LocalSlot> slots;
+    };
+
+    struct Entry {
+        ReadMostlySharedPtr* publisher;
+        // Bumped every time the id is taken again
+        uint64_t generation = 0;
+    };
+
+public:
+    explicit ReadMostlySharedPtr(SharedPtr<T> value) : current_(std::move(value)) {
+        std::lock_guard guard(RegistryMutex());
+        auto& registry = Registry();
+        auto& free_ids = FreeIds();
+        if (free_ids.empty()) {
+            id_ = registry.size();
+            registry.push_back({this});
+        } else {
+            id_ = free_ids.back();
+            free_ids.pop_back();
+            registry[id_].publisher = this;
+            ++registry[id_].generation;
+        }
+        generation_ = registry[id_].generation;
+    }
+
+    ReadMostlySharedPtr(const ReadMostlySharedPtr&) = delete;
+    ReadMostlySharedPtr& operator=(const ReadMostlySharedPtr&) = delete;
+
+    // All readers must be done with their snapshots.
+    ~ReadMostlySharedPtr() {
+        std::lock_guard registry_guard(RegistryMutex());
+        Registry()[id_].publisher = nullptr;
+        FreeIds().push_back(id_);
+        std::lock_guard guard(mutex_);
+        for (auto slot : slots_) {
+            delete slot;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Writers
+
+    void Publish(SharedPtr<T> value) {
+        {
+            std::lock_guard guard(mutex_);
+            current_.Swap(value);
+            version_.fetch_add(1, std::memory_order_release);
+        }
+        // The old value is released here, so its destructor doesn't hold up `Refresh`
+    }
+
+    template <typename... Args>
+    void Emplace(Args&&... args) {
+        Publish(MakeShared<T>(std::forward<Args>(args)...));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Readers
+
+    // Snapshot of the current thread. Stays valid until the next `Read()` of this thread;
+    // copy it to keep the value longer.
+    const SharedPtr<T>& Read() {
+        Slot* slot = LocalSlot();
+        if (slot->version != version_.load(std::memory_order_acquire)) {
+            Refresh(slot);
+        }
+        return slot->snapshot;
+    }
+
+    // Owning copy of the current value. Takes the lock.
+    SharedPtr<T> Load() const {
+        std::lock_guard guard(mutex_);
+        return current_;
+    }
+
+    uint64_t Version() const {
+        return version_.load(std::memory_order_acquire);
+    }
+
+private:
+    static std::mutex& RegistryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+    // Publishers by id, null for the free ids. A thread exiting checks the generation to see
+    // whether its slot's publisher is still there.
+    static std::vector<Entry>& Registry() {
+        static std::vector<Entry> registry;
+        return registry;
+    }
+    static std::vector<size_t>& FreeIds() {
+        static std::vector<size_t> free_ids;
+        return free_ids;
+    }
+
+    Slot* LocalSlot() {
+        thread_local LocalSlots local;
+        if (id_ < local.slots.size() && local.slots[id_].slot != nullptr &&
+            local.slots[id_].generation == generation_) {
+            return local.slots[id_].slot;
+        }
+        if (id_ >= local.slots.size()) {
+            local.slots.resize(id_ + 1);
+        }
+        auto slot = new Slot();
+        {
+            std::lock_guard guard(mutex_);
+            slots_.push_back(slot);
+        }
+        local.slots[id_] = {slot, generation_};
+        return slot;
+    }
+
+    void Refresh(Slot* slot) {
+        SharedPtr<T> old;
+        {
+            std::lock_guard guard(mutex_);
+            old.Swap(slot->snapshot);
+            slot->snapshot = current_;
+            slot->version = version_.load(std::memory_order_relaxed);
+        }
+        // Released after the lock, like in `Publish`
+    }
+
+    void ReleaseSlot(Slot* slot) {
+        std::lock_guard guard(mutex_);
+        for (auto& other : slots_) {
+            if (other == slot) {
+                other = slots_.back();
+                slots_.pop_back();
+                break;
+            }
+        }
+        delete slot;
+    }
+
+    mutable std::mutex mutex_;
+    SharedPtr<T> current_;
+    std::atomic<uint64_t> version_ = 0;
+    std::vector<Slot*> slots_;
+    size_t id_;
+    uint64_t generation_;
+};
@@ -0,0 +1,162 @@
+#include "read_mostly.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Config {
+    Config(int value) : value(value), check(value) {
+        ++alive;
+    }
+    ~Config() {
+        check = -1;
+        --alive;
+    }
+
+    inline static std::atomic<int> alive = 0;
+    int value;
+    int check;
+};
+
+TEST_CASE("ReadMostlySharedPtr") {
+    SECTION("Read and publish") {
+        ReadMostlySharedPtr<Config> config(MakeShared<Config>(1));
+        REQUIRE(config.Read()->value == 1);
+        REQUIRE(config.Version() == 0);
+
+        config.Emplace(2);
+        REQUIRE(config.Version() == 1);
+        REQUIRE(config.Read()->value == 2);
+        REQUIRE(config.Load()->value == 2);
+    }
+
+    SECTION("Cached snapshot") {
+        ReadMostlySharedPtr<Config> config(MakeShared<Config>(1));
+        const Config* first = config.Read().Get();
+        REQUIRE(config.Read().Get() == first);
+        // The publisher and this thread's snapshot
+        REQUIRE(config.Load().UseCount() == 3);
+    }
+
+    SECTION("Old snapshots are retired on refresh") {
+        int alive = Config::alive;
+        {
+            ReadMostlySharedPtr<Config> config(MakeShared<Config>(1));
+            auto& snapshot = config.Read();
+            config.Emplace(2);
+            // Still held by this thread's snapshot
+            REQUIRE(Config::alive == alive + 2);
+            REQUIRE(snapshot->value == 1);
+
+            REQUIRE(config.Read()->value == 2);
+            REQUIRE(Config::alive == alive + 1);
+        }
+        REQUIRE(Config::alive == alive);
+    }
+
+    SECTION("Several publishers") {
+        ReadMostlySharedPtr<Config> a(MakeShared<Config>(1));
+        ReadMostlySharedPtr<Config> b(MakeShared<Config>(2));
+        REQUIRE(a.Read()->value == 1);
+        REQUIRE(b.Read()->value == 2);
+        b.Emplace(3);
+        REQUIRE(a.Read()->value == 1);
+        REQUIRE(b.Read()->value == 3);
+    }
+}
+
+TEST_CASE("ReadMostlySharedPtr with threads") {
+    int alive = Config::alive;
+
+    SECTION("Readers see consistent values") {
+        ReadMostlySharedPtr<Config> config(MakeShared<Config>(0));
+        std::atomic<bool> done = false;
+        std::atomic<int> errors = 0;
+
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&] {
+                int last = 0;
+                while (!done.load()) {
+                    auto& snapshot = config.Read();
+                    if (snapshot->check != snapshot->value || snapshot->value < last) {
+                        ++errors;
+                    }
+                    last = snapshot->value;
+                }
+            });
+        }
+        for (int version = 1; version <= 1000; ++version) {
+            config.Emplace(version);
+        }
+        done = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        REQUIRE(errors == 0);
+        REQUIRE(config.Read()->value == 1000);
+        // Exited readers released their snapshots
+        REQUIRE(Config::alive == alive + 1);
+    }
+
+    SECTION("Reader outlives publisher") {
+        std::atomic<int> step = 0;
+        int value = 0;
+        std::thread reader;
+        {
+            ReadMostlySharedPtr<Config> config(MakeShared<Config>(1));
+            reader = std::thread([&] {
+                value = config.Read()->value;
+                step = 1;
+                while (step != 2) {
+                }
+            });
+            while (step != 1) {
+            }
+        }
+        REQUIRE(value == 1);
+        REQUIRE(Config::alive == alive);
+        step = 2;
+        reader.join();
+    }
+
+    SECTION("Ids are reused") {
+        // The reader keeps the slot of the first publisher until it exits, after the second one
+        // has taken the same id
+        std::atomic<int> step = 0;
+        int values[2] = {};
+        auto first = std::make_unique<ReadMostlySharedPtr<Config>>(MakeShared<Config>(1));
+        std::unique_ptr<ReadMostlySharedPtr<Config>> second;
+        std::thread reader([&] {
+            values[0] = first->Read()->value;
+            step = 1;
+            while (step != 2) {
+            }
+            values[1] = second->Read()->value;
+        });
+        while (step != 1) {
+        }
+        first.reset();
+        second = std::make_unique<ReadMostlySharedPtr<Config>>(MakeShared<Config>(2));
+        step = 2;
+        reader.join();
+
+        REQUIRE(values[0] == 1);
+        REQUIRE(values[1] == 2);
+        REQUIRE(second->Read()->value == 2);
+        second.reset();
+        REQUIRE(Config::alive == alive);
+
+        for (int i = 0; i < 100; ++i) {
+            ReadMostlySharedPtr<Config> config(MakeShared<Config>(i));
+            REQUIRE(config.Read()->value == i);
+        }
+        REQUIRE(Config::alive == alive);
+    }
+}
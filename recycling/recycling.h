@@ -0,0 +1,177 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+
+#include <cstddef>      // size_t
+#include <type_traits>  // std::is_base_of_v
+#include <utility>      // std::forward
+
+// `T` may keep its internal buffers between uses by providing `void Recycle()`.
+// It is called instead of the destructor when the last `SharedPtr` dies.
+template <typename T, typename = void>
+inline constexpr bool kHasRecycleHook = false;
+
+template <typename T>
+inline constexpr bool kHasRecycleHook<T, std::void_t<decltype(std::declval<T&>().Recycle())>> =
+    true;
+
+template <typename T>
+class RecyclingPool;
+
+template <typename T>
+class ControlBlockRecycled : public ControlBlockBasic {
+public:
+    template <typename... Args>
+    ControlBlockRecycled(Args&&... args) {
+        Revive(std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    void Revive(Args&&... args) {
+        if (!constructed) {
+            new (&x) T(std::forward<Args>(args)...);
+            constructed = true;
+        }
+        weak_cnt.store(1, std::memory_order_relaxed);
+        strong_cnt.store(1, std::memory_order_relaxed);
+    }
+    void DestroyObject() override {
+        if constexpr (kHasRecycleHook<T>) {
+            Get()->Recycle();
+        } else {
+            Get()->~T();
+            constructed = false;
+        }
+    }
+    void DestroyBlock() override {
+        RecyclingPool<T>::Release(this);
+    }
+    ~ControlBlockRecycled() override {
+        if (constructed) {
+            Get()->~T();
+        }
+    }
+    T* Get() {
+        return reinterpret_cast<T*>(&x);
+    }
+
+    alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
+    bool constructed = false;
+    ControlBlockRecycled* next_free = nullptr;
+};
+
+// Per-type, per-thread free list of control blocks.
+// A block is returned to the pool of the thread that drops its last reference.
+// The pool keeps at most `Capacity()` blocks, so a thread that only consumes
+// objects made elsewhere doesn't accumulate them without bound.
+template <typename T>
+class RecyclingPool {
+public:
+    static constexpr size_t kDefaultCapacity = 256;
+
+    static RecyclingPool& Local() {
+        thread_local RecyclingPool pool;
+        return pool;
+    }
+
+    // Returns a block to the pool of the calling thread, or to the allocator if
+    // the pool is full or was already destroyed at thread exit.
+    static void Release(ControlBlockRecycled<T>* block) {
+        if (state == State::kDestroyed) {
+            delete block;
+        } else {
+            Local().Put(block);
+        }
+    }
+
+    ControlBlockRecycled<T>* Take() {
+        if (free_ == nullptr) {
+            return nullptr;
+        }
+        auto block = free_;
+        free_ = block->next_free;
+        block->next_free = nullptr;
+        --available_;
+        return block;
+    }
+    void Put(ControlBlockRecycled<T>* block) {
+        if (available_ >= capacity_) {
+            delete block;
+            return;
+        }
+        block->next_free = free_;
+        free_ = block;
+        ++available_;
+    }
+
+    size_t NumAvailable() const {
+        return available_;
+    }
+
+    size_t Capacity() const {
+        return capacity_;
+    }
+    void SetCapacity(size_t capacity) {
+        capacity_ = capacity;
+        while (available_ > capacity_) {
+            delete Take();
+        }
+    }
+
+    // Give all cached storage back to the allocator.
+    void Clear() {
+        while (auto block = Take()) {
+            delete block;
+        }
+    }
+
+    ~RecyclingPool() {
+        Clear();
+        state = State::kDestroyed;
+    }
+
+private:
+    enum class State { kAlive, kDestroyed };
+
+    RecyclingPool() = default;
+
+    // Trivially destructible, so it stays readable after `~RecyclingPool`.
+    static inline thread_local State state = State::kAlive;
+
+    ControlBlockRecycled<T>* free_ = nullptr;
+    size_t available_ = 0;
+    size_t capacity_ = kDefaultCapacity;
+};
+
+// Same as `MakeShared`, but control block and object storage is taken from
+// the thread-local pool and returned there instead of being deleted.
+template <typename T, typename... Args>
+SharedPtr<T> RecyclingMakeShared(Args&&... args) {
+    static_assert(!kHasRecycleHook<T> || sizeof...(Args) == 0,
+                  "Recyclable objects are reused as is and can't take constructor arguments");
+    static_assert(!kHasRecycleHook<T> || !std::is_base_of_v<EnableSharedFromThisBasic, T>,
+                  "Recyclable objects can't hold a weak reference to themselves");
+
+    auto block = RecyclingPool<T>::Local().Take();
+    if (block == nullptr) {
+        block = new ControlBlockRecycled<T>(std::forward<Args>(args)...);
+    } else {
+        try {
+            block->Revive(std::forward<Args>(args)...);
+        } catch (...) {
+            RecyclingPool<T>::Release(block);
+            throw;
+        }
+    }
+    SharedPtr<T> res;
+    res.buffer = block;
+    res.x = block->Get();
+
+    if constexpr (std::is_base_of_v<EnableSharedFromThisBasic, T>) {
+        res->x.buffer = res.buffer;
+        res->x.x = res.x;
+        res.buffer->IncreaseWeak();
+    }
+
+    return res;
+}
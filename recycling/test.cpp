@@ -0,0 +1,200 @@
+#include "recycling.h"
+
+#include <common/my_int.h>
+#include <common/tracked.h>
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Request {
+    Request() = default;
+    Request(int id) : id(id) {
+    }
+
+    int id = 0;
+    MyInt payload;
+};
+
+struct Buffer {
+    void Recycle() {
+        ++recycled;
+        data.clear();
+    }
+
+    std::string data;
+    int recycled = 0;
+};
+
+struct Throwing {
+    Throwing(bool fail) {
+        if (fail) {
+            throw 42;
+        }
+    }
+};
+
+struct Node : public EnableSharedFromThis<Node> {};
+
+// Constructed before the pool of its thread, so it is destroyed after it.
+struct LateHolder {
+    SharedPtr<Tracked> ptr;
+};
+
+thread_local LateHolder late_holder;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Recycling") {
+    auto& pool = RecyclingPool<Request>::Local();
+    pool.Clear();
+
+    SECTION("Storage is reused") {
+        Request* first;
+        {
+            auto p = RecyclingMakeShared<Request>(1);
+            first = p.Get();
+            REQUIRE(p->id == 1);
+            REQUIRE(p.UseCount() == 1);
+        }
+        REQUIRE(pool.NumAvailable() == 1);
+
+        auto q = RecyclingMakeShared<Request>(2);
+        REQUIRE(q.Get() == first);
+        REQUIRE(q->id == 2);
+        REQUIRE(pool.NumAvailable() == 0);
+    }
+
+    SECTION("Object is destroyed and reconstructed") {
+        int alive = MyInt::AliveCount();
+        {
+            auto p = RecyclingMakeShared<Request>();
+            REQUIRE(MyInt::AliveCount() == alive + 1);
+        }
+        REQUIRE(MyInt::AliveCount() == alive);
+        {
+            auto p = RecyclingMakeShared<Request>();
+            REQUIRE(MyInt::AliveCount() == alive + 1);
+        }
+        REQUIRE(MyInt::AliveCount() == alive);
+    }
+
+    SECTION("Weak references keep storage") {
+        WeakPtr<Request> weak;
+        {
+            auto p = RecyclingMakeShared<Request>(3);
+            weak = p;
+        }
+        REQUIRE(weak.Expired());
+        REQUIRE(pool.NumAvailable() == 0);
+        weak.Reset();
+        REQUIRE(pool.NumAvailable() == 1);
+    }
+
+    SECTION("Steady state does not allocate") {
+        { auto warm_up = RecyclingMakeShared<Request>(); }
+
+        EXPECT_ZERO_ALLOCATIONS(for (int i = 0; i < 1000; ++i) {
+            auto p = RecyclingMakeShared<Request>(i);
+            auto copy = p;
+            WeakPtr<Request> weak(copy);
+            REQUIRE(weak.Lock()->id == i);
+        });
+    }
+
+    SECTION("Clear") {
+        { auto p = RecyclingMakeShared<Request>(); }
+        REQUIRE(pool.NumAvailable() == 1);
+        pool.Clear();
+        REQUIRE(pool.NumAvailable() == 0);
+    }
+}
+
+TEST_CASE("Recycle hook") {
+    RecyclingPool<Buffer>::Local().Clear();
+
+    {
+        auto p = RecyclingMakeShared<Buffer>();
+        p->data.assign(1000, 'a');
+    }
+
+    EXPECT_ZERO_ALLOCATIONS(for (int i = 0; i < 100; ++i) {
+        auto p = RecyclingMakeShared<Buffer>();
+        REQUIRE(p->data.empty());
+        REQUIRE(p->recycled == i + 1);
+        p->data.assign(1000, 'b');
+    });
+}
+
+TEST_CASE("Recycling with faulty constructor") {
+    auto& pool = RecyclingPool<Throwing>::Local();
+    { auto p = RecyclingMakeShared<Throwing>(false); }
+    REQUIRE(pool.NumAvailable() == 1);
+
+    REQUIRE_THROWS(RecyclingMakeShared<Throwing>(true));
+    REQUIRE(pool.NumAvailable() == 1);
+}
+
+TEST_CASE("Recycling with SharedFromThis") {
+    RecyclingPool<Node>::Local().Clear();
+    for (int i = 0; i < 3; ++i) {
+        auto p = RecyclingMakeShared<Node>();
+        auto q = p->SharedFromThis();
+        REQUIRE(q.Get() == p.Get());
+        REQUIRE(p.UseCount() == 2);
+    }
+    REQUIRE(RecyclingPool<Node>::Local().NumAvailable() == 1);
+}
+
+TEST_CASE("Recycling pool is bounded") {
+    auto& pool = RecyclingPool<Request>::Local();
+    pool.Clear();
+    REQUIRE(pool.Capacity() == RecyclingPool<Request>::kDefaultCapacity);
+
+    pool.SetCapacity(4);
+    {
+        std::vector<SharedPtr<Request>> batch;
+        for (int i = 0; i < 10; ++i) {
+            batch.push_back(RecyclingMakeShared<Request>(i));
+        }
+    }
+    REQUIRE(pool.NumAvailable() == 4);
+
+    pool.SetCapacity(2);
+    REQUIRE(pool.NumAvailable() == 2);
+    pool.SetCapacity(RecyclingPool<Request>::kDefaultCapacity);
+    pool.Clear();
+}
+
+TEST_CASE("Recycling producer and consumer") {
+    constexpr int kCount = 10'000;
+
+    std::vector<SharedPtr<Request>> produced;
+    for (int i = 0; i < kCount; ++i) {
+        produced.push_back(RecyclingMakeShared<Request>(i));
+    }
+
+    size_t consumer_available = 0;
+    std::thread consumer([&] {
+        produced.clear();
+        consumer_available = RecyclingPool<Request>::Local().NumAvailable();
+    });
+    consumer.join();
+
+    REQUIRE(consumer_available == RecyclingPool<Request>::kDefaultCapacity);
+}
+
+TEST_CASE("Recycling after the pool is destroyed") {
+    std::thread worker([] {
+        late_holder.ptr = SharedPtr<Tracked>();
+        late_holder.ptr = RecyclingMakeShared<Tracked>();
+    });
+    worker.join();
+    REQUIRE(Tracked::alive == 0);
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+
+#include <cstddef>    // size_t
+#include <cstdio>     // std::FILE
+#include <cstring>    // std::memcpy
+#include <new>        // placement new
+#include <stdexcept>  // std::out_of_range
+#include <string>
+#include <string_view>
+#include <utility>  // std::pair
+#include <vector>
+
+// Control block followed by `size` bytes of storage in the same allocation.
+class ControlBlockBytes : public ControlBlockBasic {
+public:
+    static ControlBlockBytes* Create(size_t size) {
+        void* memory = ::operator new(sizeof(ControlBlockBytes) + size);
+        return ::new (memory) ControlBlockBytes(size);
+    }
+
+    void DestroyBlock() override {
+        size_t total = sizeof(ControlBlockBytes) + size_;
+        this->~ControlBlockBytes();
+        ::operator delete(this, total);
+    }
+
+    char* Data() {
+        return reinterpret_cast<char*>(this + 1);
+    }
+
+private:
+    explicit ControlBlockBytes(size_t size) : size_(size) {
+        ++strong_cnt;
+    }
+
+    size_t size_;
+};
+
+// Same as `MakeShared<char[]>(size)`: one allocation for the control block and the bytes.
+// The bytes are not initialized.
+inline SharedPtr<char> MakeSharedBytes(size_t size) {
+    auto block = ControlBlockBytes::Create(size);
+    return SharedPtr<char>(block, block->Data());
+}
+
+// Immutable view of a byte range that shares ownership of its backing block.
+// Slicing never copies: every slice keeps the whole block alive.
+class SharedBuffer {
+public:
+    SharedBuffer() {
+    }
+
+    // Uninitialized buffer of `size` bytes, to be filled through `MutableData()`.
+    explicit SharedBuffer(size_t size) : data_(MakeSharedBytes(size)), size_(size) {
+    }
+
+    SharedBuffer(SharedPtr<char> data, size_t size) : data_(std::move(data)), size_(size) {
+    }
+
+    static SharedBuffer Copy(std::string_view bytes) {
+        SharedBuffer res(bytes.size());
+        std::memcpy(res.MutableData(), bytes.data(), bytes.size());
+        return res;
+    }
+
+    SharedBuffer Slice(size_t offset, size_t len) const {
+        if (offset > size_ || len > size_ - offset) {
+            throw std::out_of_range("SharedBuffer::Slice");
+        }
+        return SharedBuffer(SharedPtr<char>(data_, data_.Get() + offset), len);
+    }
+    SharedBuffer Slice(size_t offset) const {
+        return Slice(offset, size_ - std::min(offset, size_));
+    }
+
+    // [0, offset) and [offset, Size())
+    std::pair<SharedBuffer, SharedBuffer> Split(size_t offset) const {
+        return {Slice(0, offset), Slice(offset)};
+    }
+
+    const char* Data() const {
+        return data_.Get();
+    }
+    // Writes are visible through every slice of the same block.
+    char* MutableData() {
+        return data_.Get();
+    }
+    size_t Size() const {
+        return size_;
+    }
+    bool Empty() const {
+        return size_ == 0;
+    }
+    std::string_view View() const {
+        return {data_.Get(), size_};
+    }
+    char operator[](size_t ind) const {
+        return data_.Get()[ind];
+    }
+    // Number of buffers sharing the backing block.
+    size_t UseCount() const {
+        return data_.UseCount();
+    }
+
+private:
+    SharedPtr<char> data_;
+    size_t size_ = 0;
+};
+
+// Sequence of `SharedBuffer`s. Concatenation builds a new node on top of both ropes,
+// so it is O(1) and neither the bytes nor the existing nodes are copied.
+class Rope {
+    struct Node {
+        Node(SharedBuffer leaf) : leaf(std::move(leaf)), size(this->leaf.Size()) {
+        }
+        Node(SharedPtr<const Node> left, SharedPtr<const Node> right)
+            : left(std::move(left)), right(std::move(right)) {
+            size = this->left->size + this->right->size;
+        }
+        // Ropes built by repeated appends are as deep as they are long, so the subtree
+        // is detached into an explicit stack instead of being released recursively.
+        ~Node() {
+            if (!left) {
+                return;
+            }
+            std::vector<SharedPtr<const Node>> stack;
+            stack.push_back(std::move(left));
+            stack.push_back(std::move(right));
+            while (!stack.empty()) {
+                SharedPtr<const Node> node = std::move(stack.back());
+                stack.pop_back();
+                if (node->left && node.UseCount() == 1) {
+                    // Nodes are created mutable and this is the last reference.
+                    auto& owned = const_cast<Node&>(*node);
+                    stack.push_back(std::move(owned.left));
+                    stack.push_back(std::move(owned.right));
+                }
+            }
+        }
+
+        SharedBuffer leaf;
+        SharedPtr<const Node> left;
+        SharedPtr<const Node> right;
+        size_t size = 0;
+    };
+
+public:
+    Rope() {
+    }
+    Rope(SharedBuffer buffer) {
+        if (!buffer.Empty()) {
+            root_ = MakeShared<Node>(std::move(buffer));
+        }
+    }
+
+    friend Rope operator+(const Rope& left, const Rope& right) {
+        if (!left.root_) {
+            return right;
+        }
+        if (!right.root_) {
+            return left;
+        }
+        Rope res;
+        res.root_ = MakeShared<Node>(left.root_, right.root_);
+        return res;
+    }
+    Rope& operator+=(const Rope& other) {
+        return *this = *this + other;
+    }
+
+    size_t Size() const {
+        return root_ ? root_->size : 0;
+    }
+    bool Empty() const {
+        return Size() == 0;
+    }
+
+    // Calls `callback(const SharedBuffer&)` for every chunk in order.
+    // Uses an explicit stack for the same reason as `~Node`.
+    template <typename F>
+    void ForEachChunk(F&& callback) const {
+        std::vector<const Node*> stack;
+        if (root_) {
+            stack.push_back(root_.Get());
+        }
+        while (!stack.empty()) {
+            const Node* node = stack.back();
+            stack.pop_back();
+            if (node->left) {
+                stack.push_back(node->right.Get());
+                stack.push_back(node->left.Get());
+            } else {
+                callback(node->leaf);
+            }
+        }
+    }
+
+    // Copies the rope into one contiguous buffer.
+    SharedBuffer Flatten() const {
+        SharedBuffer res(Size());
+        char* out = res.MutableData();
+        ForEachChunk([&out](const SharedBuffer& chunk) {
+            std::memcpy(out, chunk.Data(), chunk.Size());
+            out += chunk.Size();
+        });
+        return res;
+    }
+    std::string ToString() const {
+        std::string res;
+        res.reserve(Size());
+        ForEachChunk([&res](const SharedBuffer& chunk) { res.append(chunk.View()); });
+        return res;
+    }
+
+private:
+    SharedPtr<const Node> root_;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Files
+
+namespace shared_buffer_detail {
+
+struct FileCloser {
+    ~FileCloser() {
+        if (file != nullptr) {
+            std::fclose(file);
+        }
+    }
+    std::FILE* file;
+};
+
+inline std::FILE* OpenOrThrow(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        throw std::runtime_error("Can't open " + path);
+    }
+    return file;
+}
+
+// Reads the rest of `file` in `chunk_size` pieces; `path` is only for the error message.
+inline Rope ReadChunks(std::FILE* file, const std::string& path, size_t chunk_size) {
+    Rope res;
+    while (true) {
+        SharedBuffer chunk(chunk_size);
+        size_t read = std::fread(chunk.MutableData(), 1, chunk_size, file);
+        if (read > 0) {
+            res += chunk.Slice(0, read);
+        }
+        if (read < chunk_size) {
+            if (std::ferror(file)) {
+                throw std::runtime_error("Can't read " + path);
+            }
+            return res;
+        }
+    }
+}
+
+}  // namespace shared_buffer_detail
+
+// Reads the file in `chunk_size` pieces, every piece in its own block.
+// Works for pipes and other files of unknown size.
+inline Rope ReadFileChunks(const std::string& path, size_t chunk_size = 1 << 16) {
+    shared_buffer_detail::FileCloser closer{shared_buffer_detail::OpenOrThrow(path)};
+    return shared_buffer_detail::ReadChunks(closer.file, path, chunk_size);
+}
+
+// Reads the whole file into a single block, `chunk_size` bytes per read call.
+// A file that can't tell its size (a pipe) is read in chunks from the same handle, then flattened.
+inline SharedBuffer ReadFile(const std::string& path, size_t chunk_size = 1 << 16) {
+    shared_buffer_detail::FileCloser closer{shared_buffer_detail::OpenOrThrow(path)};
+    if (std::fseek(closer.file, 0, SEEK_END) != 0) {
+        return shared_buffer_detail::ReadChunks(closer.file, path, chunk_size).Flatten();
+    }
+    long size = std::ftell(closer.file);
+    std::rewind(closer.file);
+    if (size < 0) {
+        return shared_buffer_detail::ReadChunks(closer.file, path, chunk_size).Flatten();
+    }
+
+    SharedBuffer res(size);
+    size_t done = 0;
+    while (done < res.Size()) {
+        size_t read = std::fread(res.MutableData() + done, 1,
+                                 std::min(chunk_size, res.Size() - done), closer.file);
+        if (read == 0) {
+            if (std::ferror(closer.file)) {
+                throw std::runtime_error("Can't read " + path);
+            }
+            break;
+        }
+        done += read;
+    }
+    return res.Slice(0, done);
+}
@@ -0,0 +1,172 @@
+#include "shared_buffer.h"
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <sys/stat.h>  // mkfifo
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("MakeSharedBytes") {
+    SECTION("One allocation") {
+        EXPECT_ONE_ALLOCATION(auto bytes = MakeSharedBytes(100); bytes.Get()[99] = 'a';);
+    }
+
+    SECTION("Aliasing keeps the block alive") {
+        SharedPtr<char> tail;
+        {
+            auto bytes = MakeSharedBytes(10);
+            bytes.Get()[5] = 'x';
+            tail = SharedPtr<char>(bytes, bytes.Get() + 5);
+            REQUIRE(bytes.UseCount() == 2);
+        }
+        REQUIRE(tail.UseCount() == 1);
+        REQUIRE(*tail == 'x');
+    }
+}
+
+TEST_CASE("SharedBuffer") {
+    auto buffer = SharedBuffer::Copy("hello, world");
+
+    SECTION("Observers") {
+        REQUIRE(buffer.Size() == 12);
+        REQUIRE(buffer.View() == "hello, world");
+        REQUIRE(buffer[4] == 'o');
+        REQUIRE(SharedBuffer().Empty());
+    }
+
+    SECTION("Slices don't copy") {
+        SharedBuffer world;
+        EXPECT_ZERO_ALLOCATIONS(world = buffer.Slice(7, 5));
+        REQUIRE(world.View() == "world");
+        REQUIRE(world.Data() == buffer.Data() + 7);
+        REQUIRE(buffer.UseCount() == 2);
+
+        auto ld = world.Slice(3);
+        REQUIRE(ld.View() == "ld");
+        REQUIRE(buffer.UseCount() == 3);
+    }
+
+    SECTION("Slices outlive the original") {
+        SharedBuffer hello;
+        {
+            auto local = SharedBuffer::Copy("hello, world");
+            hello = local.Slice(0, 5);
+        }
+        REQUIRE(hello.View() == "hello");
+        REQUIRE(hello.UseCount() == 1);
+    }
+
+    SECTION("Split") {
+        auto [left, right] = buffer.Split(5);
+        REQUIRE(left.View() == "hello");
+        REQUIRE(right.View() == ", world");
+
+        auto [empty, all] = buffer.Split(0);
+        REQUIRE(empty.Empty());
+        REQUIRE(all.View() == buffer.View());
+    }
+
+    SECTION("Out of range") {
+        REQUIRE_THROWS_AS(buffer.Slice(13, 0), std::out_of_range);
+        REQUIRE_THROWS_AS(buffer.Slice(5, 8), std::out_of_range);
+        REQUIRE(buffer.Slice(12, 0).Empty());
+    }
+}
+
+TEST_CASE("Rope") {
+    auto buffer = SharedBuffer::Copy("abcdef");
+
+    SECTION("Concatenation") {
+        Rope rope = Rope(buffer.Slice(3)) + Rope(buffer.Slice(0, 3));
+        rope += SharedBuffer::Copy("!");
+        REQUIRE(rope.Size() == 7);
+        REQUIRE(rope.ToString() == "defabc!");
+        REQUIRE(rope.Flatten().View() == "defabc!");
+        REQUIRE(buffer.UseCount() == 3);
+    }
+
+    SECTION("Concatenation doesn't copy bytes") {
+        Rope left(buffer), right(buffer);
+        EXPECT_ONE_ALLOCATION(Rope both = left + right; REQUIRE(both.Size() == 12));
+        REQUIRE((Rope() + left).Size() == 6);
+        REQUIRE((left + Rope()).Size() == 6);
+    }
+
+    SECTION("Deep rope") {
+        constexpr size_t kLength = 1'000'000;
+        Rope rope;
+        for (size_t i = 0; i < kLength; ++i) {
+            rope += Rope(buffer.Slice(i % 6, 1));
+        }
+        REQUIRE(rope.Size() == kLength);
+        size_t chunks = 0;
+        bool all_single = true;
+        rope.ForEachChunk([&](const SharedBuffer& chunk) {
+            all_single &= chunk.Size() == 1;
+            ++chunks;
+        });
+        REQUIRE(all_single);
+        REQUIRE(chunks == kLength);
+        REQUIRE(rope.ToString().substr(0, 8) == "abcdefab");
+
+        Rope prefix = rope;
+        rope += Rope(buffer);
+        rope = Rope();
+        REQUIRE(prefix.Size() == kLength);
+        prefix = Rope();
+        REQUIRE(buffer.UseCount() == 1);
+    }
+}
+
+TEST_CASE("Read file") {
+    std::string path = "shared_buffer_test.txt";
+    std::string content;
+    for (int i = 0; i < 1000; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+    {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        REQUIRE(file != nullptr);
+        std::fwrite(content.data(), 1, content.size(), file);
+        std::fclose(file);
+    }
+
+    SECTION("Single block") {
+        auto buffer = ReadFile(path, 100);
+        REQUIRE(buffer.View() == content);
+    }
+
+    SECTION("Chunks") {
+        auto rope = ReadFileChunks(path, 100);
+        REQUIRE(rope.Size() == content.size());
+        REQUIRE(rope.ToString() == content);
+    }
+
+    SECTION("Missing file") {
+        REQUIRE_THROWS(ReadFile("no_such_file.txt"));
+    }
+
+    SECTION("Pipe") {
+        // Can't be reopened: a second open would wait for another writer
+        std::string fifo = "shared_buffer_test.fifo";
+        std::remove(fifo.c_str());
+        REQUIRE(mkfifo(fifo.c_str(), 0600) == 0);
+        std::thread writer([&] {
+            std::FILE* file = std::fopen(fifo.c_str(), "wb");
+            std::fwrite(content.data(), 1, content.size(), file);
+            std::fclose(file);
+        });
+        auto buffer = ReadFile(fifo, 100);
+        writer.join();
+        std::remove(fifo.c_str());
+        REQUIRE(buffer.View() == content);
+    }
+
+    std::remove(path.c_str());
+}
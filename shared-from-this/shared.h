@@ -1,29 +1,164 @@
 #pragma once
 
 #include "sw_fwd.h"  // Forward declaration
-#include <cstddef>   // std::nullptr_t
+#include <atomic>      // std::atomic
+#include <cstddef>     // std::nullptr_t
+#include <functional>  // std::hash, std::less
+#include <new>         // std::align_val_t
+#include <utility>     // std::swap
+
+#include <common/sized_delete.h>
 
 #include <iostream>
 
+#ifdef SHARED_PTR_CONTENTION_PROFILER
+#include <contention-profiler/contention_profiler.h>
+#endif
+
+#ifdef SMART_PTR_EVENT_TRACER
+#include <event-tracer/event_tracer.h>
+#endif
+
+#ifdef SHARED_PTR_LEAK_TRACKER
+#include <leak-tracker/leak_tracker_core.h>
+#endif
+
+// With `SHARED_PTR_CALL_SITES`, copies take the location of the caller, see `CallSites`
+#ifdef SHARED_PTR_CALL_SITES
+#include <call-sites/call_sites.h>
+#define SHARED_PTR_CALL_SITE std::source_location site = std::source_location::current()
+#define SHARED_PTR_RECORD_CALL_SITE(kind) CallSites::Record(CallSites::kind, site)
+#else
+#define SHARED_PTR_RECORD_CALL_SITE(kind)
+#endif
+
+// With `SHARED_PTR_STATS`, the counters of `SharedStats`
+#ifdef SHARED_PTR_STATS
+#include <shared-stats/shared_stats.h>
+#define SHARED_PTR_COUNT(counter) SharedStats::Count(SharedStats::counter)
+#define SHARED_PTR_COUNT_BLOCK(event, T, bytes) SharedStats::event(typeid(T), bytes)
+#else
+#define SHARED_PTR_COUNT(counter)
+#define SHARED_PTR_COUNT_BLOCK(event, T, bytes)
+#endif
+
+// Counters are atomic, so different threads can copy and drop pointers to the same object.
 class ControlBlockBasic {
 public:
+    void IncreaseStrong() {
+        Touch();
+        SHARED_PTR_COUNT(kStrongIncrements);
+        strong_cnt.fetch_add(1, std::memory_order_relaxed);
+    }
+    void IncreaseWeak() {
+        Touch();
+        SHARED_PTR_COUNT(kWeakIncrements);
+        weak_cnt.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Increases the strong counter unless it has already dropped to zero.
+    // Used to promote weak references: a plain increment could resurrect a dying object.
+    bool TryIncreaseStrong() {
+        Touch();
+        size_t cnt = strong_cnt.load(std::memory_order_relaxed);
+        while (cnt != 0) {
+            if (strong_cnt.compare_exchange_weak(cnt, cnt + 1, std::memory_order_relaxed)) {
+                SHARED_PTR_COUNT(kStrongIncrements);
+                return true;
+            }
+        }
+        return false;
+    }
     virtual void DecreaseStrong() {
+        if (strong_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+#ifdef SMART_PTR_EVENT_TRACER
+            EventTracer::Span span("Release", typeid(*this));
+#endif
+            DestroyObject();
+            DecreaseWeak();
+        }
     }
     virtual void DecreaseWeak() {
-    }
-    virtual void IncreaseStrong() {
-        ++strong_cnt;
-    }
-    virtual void IncreaseWeak() {
-        ++weak_cnt;
+        if (weak_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            DestroyBlock();
+        }
     }
     ControlBlockBasic() {
+#ifdef SHARED_PTR_CONTENTION_PROFILER
+        ContentionProfiler::Global().Created(this, profiled_);
+#endif
     }
     virtual ~ControlBlockBasic() {
+#ifdef SHARED_PTR_CONTENTION_PROFILER
+        if (profiled_.load(std::memory_order_relaxed)) {
+            ContentionProfiler::Global().Destroyed(this);
+        }
+#endif
+    }
+
+    // Reports counter traffic to the contention profiler; empty unless it's compiled in.
+    void Touch() {
+#ifdef SHARED_PTR_CONTENTION_PROFILER
+        if (ContentionProfiler::ShouldSample()) {
+            ContentionProfiler::Global().Record(this, typeid(*this), profiled_);
+        }
+#endif
+    }
+
+    // Report the object of the block to the leak tracker when it's made and when it's destroyed;
+    // empty unless it's compiled in.
+    void LeakTrackerCreated([[maybe_unused]] const std::type_info& type,
+                            [[maybe_unused]] size_t bytes) {
+#ifdef SHARED_PTR_LEAK_TRACKER
+        if (LeakTracker::Global().ShouldSample()) {
+            leak_sampled_ = true;
+            LeakTracker::Global().Record(this, bytes, type);
+        }
+#endif
+    }
+    void LeakTrackerDestroyed() {
+#ifdef SHARED_PTR_LEAK_TRACKER
+        if (leak_sampled_) {
+            leak_sampled_ = false;
+            LeakTracker::Global().Forget(this);
+        }
+#endif
+    }
+
+    // Called once, when the last strong reference is dropped.
+    virtual void DestroyObject() {
+    }
+    // Called once, when the last weak reference is dropped (after `DestroyObject`).
+    virtual void DestroyBlock() {
+        delete this;
+    }
+
+    // `delete this` in the control blocks goes through the sized deallocation functions
+    static void* operator new(size_t size) {
+        return ::operator new(size);
+    }
+    static void* operator new(size_t size, std::align_val_t align) {
+        return ::operator new(size, align);
+    }
+    static void operator delete(void* ptr, size_t size) {
+        ::operator delete(ptr, size);
     }
+    static void operator delete(void* ptr, size_t size, std::align_val_t align) {
+        ::operator delete(ptr, size, align);
+    }
+
+    std::atomic<size_t> strong_cnt = 0;
+    // Weak references plus one held by all the strong ones together, so the block survives
+    // the destruction of the object even if it drops the last `WeakPtr` on the way.
+    std::atomic<size_t> weak_cnt = 1;
 
-    size_t strong_cnt = 0;
-    size_t weak_cnt = 0;
+#ifdef SHARED_PTR_CONTENTION_PROFILER
+private:
+    std::atomic<bool> profiled_ = false;
+#endif
+#ifdef SHARED_PTR_LEAK_TRACKER
+private:
+    bool leak_sampled_ = false;
+#endif
 };
 
 template <typename T>
@@ -32,25 +167,15 @@ public:
     ControlBlockPointer(T* other) {
         x = other;
         ++strong_cnt;
+        SHARED_PTR_COUNT_BLOCK(BlockCreated, T, sizeof(*this) + sizeof(T));
+        LeakTrackerCreated(typeid(T), sizeof(*this) + sizeof(T));
     }
-    void DecreaseStrong() override {
-        --strong_cnt;
-        if (strong_cnt == 0) {
-            ++weak_cnt;
-            delete x;
-            --weak_cnt;
-        }
-        if (strong_cnt == 0 && weak_cnt == 0) {
-            delete this;
-        }
-    }
-    void DecreaseWeak() override {
-        --weak_cnt;
-        if (strong_cnt == 0 && weak_cnt == 0) {
-            delete this;
-        }
+    void DestroyObject() override {
+        LeakTrackerDestroyed();
+        SizedDelete(x);
     }
     ~ControlBlockPointer() override {
+        SHARED_PTR_COUNT_BLOCK(BlockDestroyed, T, sizeof(*this) + sizeof(T));
     }
     T* x;
 };
@@ -62,25 +187,15 @@ public:
     ControlBlockRawMemory(Args&&... args) {
         new (&x) T(std::forward<Args>(args)...);
         ++strong_cnt;
+        SHARED_PTR_COUNT_BLOCK(BlockCreated, T, sizeof(*this));
+        LeakTrackerCreated(typeid(T), sizeof(*this));
     }
-    void DecreaseStrong() override {
-        --strong_cnt;
-        if (strong_cnt == 0) {
-            ++weak_cnt;
-            reinterpret_cast<T*>(&x)->~T();
-            --weak_cnt;
-        }
-        if (strong_cnt == 0 && weak_cnt == 0) {
-            delete this;
-        }
-    }
-    void DecreaseWeak() override {
-        --weak_cnt;
-        if (strong_cnt == 0 && weak_cnt == 0) {
-            delete this;
-        }
+    void DestroyObject() override {
+        LeakTrackerDestroyed();
+        reinterpret_cast<T*>(&x)->~T();
     }
     ~ControlBlockRawMemory() override {
+        SHARED_PTR_COUNT_BLOCK(BlockDestroyed, T, sizeof(*this));
     }
     alignas(sizeof(T) > 1 ? alignof(T) : 8) char x[sizeof(T)];
 };
@@ -103,6 +218,7 @@ public:
 
     template <typename F>
     explicit SharedPtr(F* ptr) {
+        SHARED_PTR_COUNT(kRawConstructed);
         buffer = new ControlBlockPointer<F>(ptr);
         x = ptr;
         if constexpr (std::is_base_of_v<EnableSharedFromThisBasic, F>) {
@@ -113,14 +229,24 @@ public:
         }
     }
 
+#ifdef SHARED_PTR_CALL_SITES
+    SharedPtr(const SharedPtr& other, SHARED_PTR_CALL_SITE) {
+#else
     SharedPtr(const SharedPtr& other) {
+#endif
+        SHARED_PTR_RECORD_CALL_SITE(kCopy);
         buffer = other.buffer;
         x = other.x;
         IncreaseStrong();
     }
 
     template <typename TOther>
+#ifdef SHARED_PTR_CALL_SITES
+    SharedPtr(const SharedPtr<TOther>& other, SHARED_PTR_CALL_SITE) {
+#else
     SharedPtr(const SharedPtr<TOther>& other) {
+#endif
+        SHARED_PTR_RECORD_CALL_SITE(kConvert);
         buffer = other.buffer;
         x = other.x;
         IncreaseStrong();
@@ -142,7 +268,12 @@ public:
     // Aliasing constructor
     // #8 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
     template <typename Y>
+#ifdef SHARED_PTR_CALL_SITES
+    SharedPtr(const SharedPtr<Y>& other, T* ptr, SHARED_PTR_CALL_SITE) {
+#else
     SharedPtr(const SharedPtr<Y>& other, T* ptr) {
+#endif
+        SHARED_PTR_RECORD_CALL_SITE(kAlias);
         buffer = other.buffer;
         x = ptr;
         IncreaseStrong();
@@ -151,18 +282,26 @@ public:
     // Promote `WeakPtr`
     // #11 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
     explicit SharedPtr(const WeakPtr<T>& other) {
-        if (other.Expired()) {
+        if (other.buffer == nullptr || !other.buffer->TryIncreaseStrong()) {
+            SHARED_PTR_COUNT(kBadWeakPtr);
             throw BadWeakPtr();
-        } else {
-            buffer = other.buffer;
-            x = other.x;
-            IncreaseStrong();
         }
+        buffer = other.buffer;
+        x = other.x;
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // `operator=`-s
 
+#ifdef SHARED_PTR_CALL_SITES
+    // By value, so that the copy or converting constructor making `other` records the line of the
+    // assignment. Also takes the moves of the same type and `nullptr`.
+    SharedPtr& operator=(SharedPtr other) {
+        std::swap(buffer, other.buffer);
+        std::swap(x, other.x);
+        return *this;
+    }
+#else
     SharedPtr& operator=(const SharedPtr<T>& other) {
         DecreaseStrong();
         buffer = other.buffer;
@@ -179,6 +318,7 @@ public:
         IncreaseStrong();
         return *this;
     }
+#endif
 
     template <typename TOther>
     SharedPtr& operator=(SharedPtr<TOther>&& other) {
@@ -189,6 +329,7 @@ public:
         return *this;
     }
 
+#ifndef SHARED_PTR_CALL_SITES
     SharedPtr& operator=(SharedPtr&& other) {
         if (&other == this) {
             return *this;
@@ -199,6 +340,7 @@ public:
         other.buffer = nullptr, other.x = nullptr;
         return *this;
     }
+#endif
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Destructor
@@ -218,6 +360,7 @@ public:
     template <typename TOther>
     void Reset(TOther* ptr) {
         DecreaseStrong();
+        SHARED_PTR_COUNT(kRawConstructed);
         buffer = new ControlBlockPointer<TOther>(ptr);
         x = ptr;
     }
@@ -239,9 +382,11 @@ public:
     T* operator->() const {
         return x;
     }
+    // Acquire load: if it returns 1, whatever the other owners did before dropping their
+    // references happens before what this owner does next.
     size_t UseCount() const {
         if (buffer != nullptr) {
-            return buffer->strong_cnt;
+            return buffer->strong_cnt.load(std::memory_order_acquire);
         } else {
             return 0;
         }
@@ -250,6 +395,20 @@ public:
         return buffer != nullptr;
     }
 
+    // Owner-based comparison and hashing: pointers sharing a control block are equivalent,
+    // even when they point to different objects (aliasing) or have expired.
+    template <typename P>
+    bool OwnerBefore(const P& other) const {
+        return std::less<const ControlBlockBasic*>()(buffer, other.buffer);
+    }
+    template <typename P>
+    bool OwnerEqual(const P& other) const {
+        return buffer == other.buffer;
+    }
+    size_t OwnerHash() const {
+        return std::hash<const ControlBlockBasic*>()(buffer);
+    }
+
     void IncreaseStrong() {
         if (buffer != nullptr) {
             buffer->IncreaseStrong();
@@ -257,6 +416,8 @@ public:
     }
     void DecreaseStrong() {
         if (buffer != nullptr) {
+            buffer->Touch();
+            SHARED_PTR_COUNT(kStrongDecrements);
             buffer->DecreaseStrong();
         }
     }
@@ -270,9 +431,20 @@ inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right) {
            left.buffer == right.buffer;
 }
 
+template <typename T>
+struct std::hash<SharedPtr<T>> {
+    size_t operator()(const SharedPtr<T>& ptr) const {
+        return std::hash<T*>()(ptr.Get());
+    }
+};
+
 // Allocate memory only once
 template <typename T, typename... Args>
 SharedPtr<T> MakeShared(Args&&... args) {
+#ifdef SMART_PTR_EVENT_TRACER
+    EventTracer::Span span("MakeShared", typeid(T));
+#endif
+    SHARED_PTR_COUNT(kMakeShared);
     auto block = new ControlBlockRawMemory<T>(std::forward<Args>(args)...);
     SharedPtr<T> res;
     res.buffer = block;
@@ -0,0 +1,78 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+#include <map>
+#include <unordered_set>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Pair {
+    int first = 0;
+    int second = 0;
+};
+
+TEST_CASE("Owner-based comparison") {
+    auto pair = MakeShared<Pair>();
+    SharedPtr<int> first(pair, &pair->first);
+    SharedPtr<int> second(pair, &pair->second);
+    WeakPtr<int> weak(second);
+    auto other = MakeShared<Pair>();
+
+    SECTION("Aliases share an owner") {
+        REQUIRE(first.OwnerEqual(second));
+        REQUIRE(first.OwnerEqual(pair));
+        REQUIRE(weak.OwnerEqual(first));
+        REQUIRE(!first.OwnerEqual(other));
+        REQUIRE(first.OwnerHash() == second.OwnerHash());
+        REQUIRE(weak.OwnerHash() == pair.OwnerHash());
+    }
+
+    SECTION("Strict weak ordering") {
+        REQUIRE(!first.OwnerBefore(second));
+        REQUIRE(!second.OwnerBefore(first));
+        REQUIRE(pair.OwnerBefore(other) != other.OwnerBefore(pair));
+        REQUIRE(weak.OwnerBefore(other) == pair.OwnerBefore(other));
+    }
+
+    SECTION("Expired pointers keep their owner") {
+        size_t hash = weak.OwnerHash();
+        first.Reset(), second.Reset(), pair.Reset();
+        REQUIRE(weak.Expired());
+        REQUIRE(weak.OwnerHash() == hash);
+        REQUIRE(std::hash<WeakPtr<int>>()(weak) == hash);
+    }
+
+    SECTION("Empty pointers") {
+        SharedPtr<int> empty;
+        WeakPtr<Pair> empty_weak;
+        REQUIRE(empty.OwnerEqual(empty_weak));
+        REQUIRE(!empty.OwnerEqual(first));
+    }
+
+    SECTION("Containers") {
+        std::map<WeakPtr<int>, int, OwnerLess> map;
+        map[weak] = 1;
+        map[WeakPtr<int>(first)] = 2;
+        REQUIRE(map.size() == 1);
+        REQUIRE(map.at(weak) == 2);
+
+        std::unordered_set<WeakPtr<int>, OwnerHasher, OwnerEqualTo> set;
+        set.insert(weak);
+        set.insert(WeakPtr<int>(first));
+        REQUIRE(set.size() == 1);
+    }
+}
+
+TEST_CASE("std::hash<SharedPtr>") {
+    auto pair = MakeShared<Pair>();
+    SharedPtr<int> second(pair, &pair->second);
+    REQUIRE(std::hash<SharedPtr<Pair>>()(pair) == std::hash<Pair*>()(pair.Get()));
+    REQUIRE(std::hash<SharedPtr<int>>()(second) == std::hash<int*>()(&pair->second));
+
+    std::unordered_set<SharedPtr<Pair>> set;
+    set.insert(pair);
+    set.insert(pair);
+    REQUIRE(set.size() == 1);
+}
@@ -77,19 +77,36 @@ public:
     // Observers
 
     size_t UseCount() const {
-        return buffer == nullptr ? 0 : buffer->strong_cnt;
+        return buffer == nullptr ? 0 : buffer->strong_cnt.load(std::memory_order_acquire);
     }
     bool Expired() const {
-        return buffer == nullptr || buffer->strong_cnt == 0;
+        return buffer == nullptr || buffer->strong_cnt.load(std::memory_order_acquire) == 0;
     }
+    // Owner-based comparison and hashing, see `SharedPtr`
+    template <typename P>
+    bool OwnerBefore(const P& other) const {
+        return std::less<const ControlBlockBasic*>()(buffer, other.buffer);
+    }
+    template <typename P>
+    bool OwnerEqual(const P& other) const {
+        return buffer == other.buffer;
+    }
+    size_t OwnerHash() const {
+        return std::hash<const ControlBlockBasic*>()(buffer);
+    }
+#ifdef SHARED_PTR_CALL_SITES
+    SharedPtr<T> Lock(SHARED_PTR_CALL_SITE) const {
+#else
     SharedPtr<T> Lock() const {
-        if (Expired()) {
-            return SharedPtr<T>();
-        }
+#endif
+        SHARED_PTR_RECORD_CALL_SITE(kLock);
         SharedPtr<T> res;
-        res.buffer = buffer;
-        res.x = x;
-        res.IncreaseStrong();
+        if (buffer != nullptr && buffer->TryIncreaseStrong()) {
+            res.buffer = buffer;
+            res.x = x;
+        } else {
+            SHARED_PTR_COUNT(kEmptyLock);
+        }
         return res;
     }
 
@@ -100,6 +117,8 @@ public:
     }
     void DecreaseWeak() {
         if (buffer != nullptr) {
+            buffer->Touch();
+            SHARED_PTR_COUNT(kWeakDecrements);
             buffer->DecreaseWeak();
         }
     }
@@ -107,3 +126,34 @@ public:
     ControlBlockBasic* buffer = nullptr;
     T* x = nullptr;
 };
+
+// Hashing a `WeakPtr` by the object it points to would change once it expires,
+// so it is hashed by owner.
+template <typename T>
+struct std::hash<WeakPtr<T>> {
+    size_t operator()(const WeakPtr<T>& ptr) const {
+        return ptr.OwnerHash();
+    }
+};
+
+// Owner-based functors for ordered and hashed containers keyed by `SharedPtr`/`WeakPtr`.
+struct OwnerLess {
+    template <typename A, typename B>
+    bool operator()(const A& left, const B& right) const {
+        return left.OwnerBefore(right);
+    }
+};
+
+struct OwnerHasher {
+    template <typename P>
+    size_t operator()(const P& ptr) const {
+        return ptr.OwnerHash();
+    }
+};
+
+struct OwnerEqualTo {
+    template <typename A, typename B>
+    bool operator()(const A& left, const B& right) const {
+        return left.OwnerEqual(right);
+    }
+};
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <common/type_name.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>  // size_t
+#include <cstdint>  // uint64_t
+#include <cstdio>   // std::rename
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>  // std::move
+#include <vector>
+
+// Process-wide counters of `SharedPtr` traffic, for production gauges.
+//
+// Compiled in with `SHARED_PTR_STATS` defined; without it, the hooks are empty. Every thread
+// counts into its own shard with plain stores, and `TakeSnapshot` sums the shards. Counters only
+// grow, so rates come from the difference of two snapshots (or `rate()` in Prometheus).
+//
+// Live blocks and bytes are kept by the type of the object for the blocks of `MakeShared` and of
+// `SharedPtr(T*)`; the blocks of other factories aren't counted. A block holds its bytes until it
+// is freed, which may be after the object dies if `WeakPtr`s remain.
+class SharedStats {
+public:
+    enum Counter {
+        kMakeShared,
+        kRawConstructed,
+        kStrongIncrements,
+        kStrongDecrements,
+        kWeakIncrements,
+        kWeakDecrements,
+        kBadWeakPtr,
+        kEmptyLock,
+        kNumCounters
+    };
+
+    struct TypeStats {
+        std::string type;
+        uint64_t live_blocks = 0;
+        uint64_t live_bytes = 0;
+    };
+
+    struct Snapshot {
+        std::chrono::system_clock::time_point time;
+        uint64_t counters[kNumCounters] = {};
+        uint64_t live_blocks = 0;
+        uint64_t live_bytes = 0;
+        // The most bytes first
+        std::vector<TypeStats> types;
+
+        uint64_t operator[](Counter counter) const {
+            return counters[counter];
+        }
+    };
+
+    static SharedStats& Global() {
+        static SharedStats* stats = new SharedStats();
+        return *stats;
+    }
+
+    SharedStats(const SharedStats&) = delete;
+    SharedStats& operator=(const SharedStats&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Hooks
+
+    static void Count(Counter counter) {
+        if (Shard* shard = Local()) {
+            Add(shard->counters[counter], 1);
+        } else {
+            Global().orphans_[counter].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static void BlockCreated(const std::type_info& type, size_t bytes) {
+        CountBlock(type, bytes, +1);
+    }
+
+    static void BlockDestroyed(const std::type_info& type, size_t bytes) {
+        CountBlock(type, bytes, -1);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Export
+
+    Snapshot TakeSnapshot() const {
+        Snapshot res;
+        res.time = std::chrono::system_clock::now();
+        std::map<std::string, TypeStats> types;
+        auto add_type = [&types](const std::type_info* type, uint64_t blocks, uint64_t bytes) {
+            TypeStats& stats = types[TypeName(*type)];
+            stats.live_blocks += blocks;
+            stats.live_bytes += bytes;
+        };
+
+        std::lock_guard lock(mutex_);
+        for (int i = 0; i < kNumCounters; ++i) {
+            res.counters[i] = retired_.counters[i] + orphans_[i].load(std::memory_order_relaxed);
+        }
+        for (auto& [type, live] : retired_.types) {
+            add_type(type, live.blocks, live.bytes);
+        }
+        for (Shard* shard : shards_) {
+            for (int i = 0; i < kNumCounters; ++i) {
+                res.counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+            }
+            std::lock_guard shard_lock(shard->mutex);
+            for (auto& [type, live] : shard->types) {
+                add_type(type, live.blocks.load(std::memory_order_relaxed),
+                         live.bytes.load(std::memory_order_relaxed));
+            }
+        }
+
+        // Blocks die on other threads than they were born on, so a shard alone may go negative;
+        // the sums don't.
+        for (auto& [name, stats] : types) {
+            if (stats.live_blocks == 0) {
+                continue;
+            }
+            stats.type = name;
+            res.live_blocks += stats.live_blocks;
+            res.live_bytes += stats.live_bytes;
+            res.types.push_back(std::move(stats));
+        }
+        std::stable_sort(res.types.begin(), res.types.end(),
+                         [](const TypeStats& left, const TypeStats& right) {
+                             return left.live_bytes > right.live_bytes;
+                         });
+        return res;
+    }
+
+    // Prometheus text exposition format.
+    static void WritePrometheus(std::ostream& out, const Snapshot& snapshot) {
+        static const char* const kNames[kNumCounters][2] = {
+            {"shared_ptr_make_shared_total", "Control blocks created by MakeShared."},
+            {"shared_ptr_raw_constructed_total", "Control blocks created by SharedPtr(T*)."},
+            {"shared_ptr_strong_increments_total", "Strong counter increments."},
+            {"shared_ptr_strong_decrements_total", "Strong counter decrements."},
+            {"shared_ptr_weak_increments_total", "Weak counter increments."},
+            {"shared_ptr_weak_decrements_total", "Weak counter decrements by WeakPtr."},
+            {"shared_ptr_bad_weak_ptr_total", "Promotions of expired WeakPtr that threw."},
+            {"shared_ptr_empty_lock_total", "WeakPtr::Lock calls that returned null."},
+        };
+        for (int i = 0; i < kNumCounters; ++i) {
+            out << "# HELP " << kNames[i][0] << " " << kNames[i][1] << "\n";
+            out << "# TYPE " << kNames[i][0] << " counter\n";
+            out << kNames[i][0] << " " << snapshot.counters[i] << "\n";
+        }
+        out << "# HELP shared_ptr_live_blocks Live control blocks by object type.\n";
+        out << "# TYPE shared_ptr_live_blocks gauge\n";
+        for (auto& stats : snapshot.types) {
+            out << "shared_ptr_live_blocks{type=\"" << Escape(stats.type) << "\"} "
+                << stats.live_blocks << "\n";
+        }
+        out << "# HELP shared_ptr_live_bytes Bytes held by live control blocks by object type.\n";
+        out << "# TYPE shared_ptr_live_bytes gauge\n";
+        for (auto& stats : snapshot.types) {
+            out << "shared_ptr_live_bytes{type=\"" << Escape(stats.type) << "\"} "
+                << stats.live_bytes << "\n";
+        }
+    }
+
+    // Writes a snapshot to a temporary file and renames it over `path`, so a reader never sees
+    // a partial one. Whether it succeeded.
+    bool WritePrometheus(const std::string& path) const {
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary);
+            WritePrometheus(out, TakeSnapshot());
+            if (!out) {
+                return false;
+            }
+        }
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    struct LiveCounters {
+        std::atomic<uint64_t> blocks = 0;
+        std::atomic<uint64_t> bytes = 0;
+    };
+
+    // Only its thread writes the counters and inserts types, so neither needs a lock; the mutex
+    // keeps `TakeSnapshot` off the map while it's being changed.
+    struct Shard {
+        std::atomic<uint64_t> counters[kNumCounters] = {};
+        std::mutex mutex;
+        std::unordered_map<const std::type_info*, LiveCounters> types;
+    };
+
+    struct Retired {
+        uint64_t counters[kNumCounters] = {};
+        struct Live {
+            uint64_t blocks = 0;
+            uint64_t bytes = 0;
+        };
+        std::unordered_map<const std::type_info*, Live> types;
+    };
+
+    // Trivially destructible, so it stays usable while the thread runs its other `thread_local`
+    // destructors, which may still drop pointers.
+    struct ThreadSlot {
+        Shard* shard = nullptr;
+        bool detached = false;
+    };
+
+    SharedStats() = default;
+
+    static void Add(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    // Null once the thread has detached its shard; then the counts go to shared atomics.
+    static Shard* Local() {
+        thread_local ThreadSlot slot;
+        if (slot.shard == nullptr && !slot.detached) [[unlikely]] {
+            Global().Attach(slot);
+        }
+        return slot.shard;
+    }
+
+    void Attach(ThreadSlot& slot) {
+        struct Detacher {
+            ~Detacher() {
+                Global().Detach(*slot);
+            }
+            ThreadSlot* slot;
+        };
+        {
+            std::lock_guard lock(mutex_);
+            slot.shard = new Shard();
+            shards_.push_back(slot.shard);
+        }
+        thread_local Detacher detacher{&slot};
+    }
+
+    void Detach(ThreadSlot& slot) {
+        std::lock_guard lock(mutex_);
+        Shard* shard = slot.shard;
+        for (int i = 0; i < kNumCounters; ++i) {
+            retired_.counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+        }
+        for (auto& [type, live] : shard->types) {
+            retired_.types[type].blocks += live.blocks.load(std::memory_order_relaxed);
+            retired_.types[type].bytes += live.bytes.load(std::memory_order_relaxed);
+        }
+        shards_.erase(std::find(shards_.begin(), shards_.end(), shard));
+        delete shard;
+        slot.shard = nullptr;
+        slot.detached = true;
+    }
+
+    // `sign` wraps around for destruction, so the sums come out right.
+    static void CountBlock(const std::type_info& type, size_t bytes, int sign) {
+        uint64_t blocks = static_cast<uint64_t>(sign);
+        uint64_t signed_bytes = static_cast<uint64_t>(sign) * bytes;
+        Shard* shard = Local();
+        if (shard == nullptr) {
+            SharedStats& stats = Global();
+            std::lock_guard lock(stats.mutex_);
+            stats.retired_.types[&type].blocks += blocks;
+            stats.retired_.types[&type].bytes += signed_bytes;
+            return;
+        }
+        auto it = shard->types.find(&type);
+        if (it == shard->types.end()) [[unlikely]] {
+            std::lock_guard lock(shard->mutex);
+            it = shard->types.try_emplace(&type).first;
+        }
+        Add(it->second.blocks, blocks);
+        Add(it->second.bytes, signed_bytes);
+    }
+
+    // Label values escape backslashes, quotes and newlines.
+    static std::string Escape(const std::string& text) {
+        std::string res;
+        for (char c : text) {
+            if (c == '\\' || c == '"') {
+                res += '\\';
+                res += c;
+            } else if (c == '\n') {
+                res += "\\n";
+            } else {
+                res += c;
+            }
+        }
+        return res;
+    }
+
+    mutable std::mutex mutex_;
+    std::vector<Shard*> shards_;
+    Retired retired_;
+    std::atomic<uint64_t> orphans_[kNumCounters] = {};
+};
+
+// Writes `SharedStats` snapshots in the Prometheus text format to `path` every `interval`, for
+// the node exporter's textfile collector or a sidecar, and once more when destroyed.
+class SharedStatsExporter {
+public:
+    SharedStatsExporter(std::string path, std::chrono::milliseconds interval)
+        : path_(std::move(path)), interval_(interval), thread_([this] { Run(); }) {
+    }
+
+    SharedStatsExporter(const SharedStatsExporter&) = delete;
+    SharedStatsExporter& operator=(const SharedStatsExporter&) = delete;
+
+    ~SharedStatsExporter() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        SharedStats::Global().WritePrometheus(path_);
+    }
+
+    // Snapshots written so far
+    size_t Written() const {
+        return written_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void Run() {
+        std::unique_lock lock(mutex_);
+        while (!wake_.wait_for(lock, interval_, [this] { return stop_; })) {
+            lock.unlock();
+            if (SharedStats::Global().WritePrometheus(path_)) {
+                written_.fetch_add(1, std::memory_order_relaxed);
+            }
+            lock.lock();
+        }
+    }
+
+    const std::string path_;
+    const std::chrono::milliseconds interval_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::atomic<size_t> written_ = 0;
+    std::thread thread_;
+};
@@ -0,0 +1,150 @@
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+
+#include <catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef SHARED_PTR_STATS
+#error "The test is built with the stats compiled in"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Payload {
+    char data[100];
+};
+
+struct Other {
+    int value = 0;
+};
+
+// Counter increases since construction
+struct Delta {
+    SharedStats::Snapshot before = SharedStats::Global().TakeSnapshot();
+
+    uint64_t operator()(SharedStats::Counter counter) {
+        return SharedStats::Global().TakeSnapshot()[counter] - before[counter];
+    }
+};
+
+uint64_t LiveBlocks(const std::string& type) {
+    for (auto& stats : SharedStats::Global().TakeSnapshot().types) {
+        if (stats.type == type) {
+            return stats.live_blocks;
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+TEST_CASE("Counters") {
+    Delta delta;
+    auto made = MakeShared<Payload>();
+    SharedPtr<Payload> raw(new Payload());
+    raw.Reset(new Payload());
+    {
+        auto copy = made;
+        WeakPtr<Payload> weak = made;
+        auto locked = weak.Lock();
+    }
+    REQUIRE(delta(SharedStats::kMakeShared) == 1);
+    REQUIRE(delta(SharedStats::kRawConstructed) == 2);
+    // The copy and the lock; the first `raw` died
+    REQUIRE(delta(SharedStats::kStrongIncrements) == 2);
+    REQUIRE(delta(SharedStats::kStrongDecrements) == 3);
+    REQUIRE(delta(SharedStats::kWeakIncrements) == 1);
+    REQUIRE(delta(SharedStats::kWeakDecrements) == 1);
+    REQUIRE(delta(SharedStats::kBadWeakPtr) == 0);
+}
+
+TEST_CASE("Failed promotions") {
+    Delta delta;
+    WeakPtr<Other> weak = MakeShared<Other>();
+    REQUIRE(!weak.Lock());
+    REQUIRE(!WeakPtr<Other>().Lock());
+    REQUIRE_THROWS_AS(SharedPtr<Other>(weak), BadWeakPtr);
+    REQUIRE(delta(SharedStats::kEmptyLock) == 2);
+    REQUIRE(delta(SharedStats::kBadWeakPtr) == 1);
+}
+
+TEST_CASE("Live blocks and bytes") {
+    const std::string type = "(anonymous namespace)::Payload";
+    REQUIRE(LiveBlocks(type) == 0);
+    std::vector<SharedPtr<Payload>> live;
+    for (int i = 0; i < 10; ++i) {
+        live.push_back(MakeShared<Payload>());
+    }
+    live.emplace_back(new Payload());
+    REQUIRE(LiveBlocks(type) == 11);
+
+    auto snapshot = SharedStats::Global().TakeSnapshot();
+    REQUIRE(snapshot.types[0].type == type);
+    REQUIRE(snapshot.types[0].live_bytes == 10 * sizeof(ControlBlockRawMemory<Payload>) +
+                                                sizeof(ControlBlockPointer<Payload>) +
+                                                sizeof(Payload));
+
+    // A weak reference keeps the block, not the object
+    WeakPtr<Payload> weak = live[0];
+    live.clear();
+    REQUIRE(LiveBlocks(type) == 1);
+    weak.Reset();
+    REQUIRE(LiveBlocks(type) == 0);
+}
+
+TEST_CASE("Threads") {
+    Delta delta;
+    auto shared = MakeShared<Other>();
+    std::vector<SharedPtr<Other>> made(4);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&shared, &made, i] {
+            for (int j = 0; j < 1000; ++j) {
+                SharedPtr<Other> copy = shared;
+            }
+            made[i] = MakeShared<Other>();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(delta(SharedStats::kStrongIncrements) == 4000);
+    REQUIRE(delta(SharedStats::kMakeShared) == 5);
+    REQUIRE(LiveBlocks("(anonymous namespace)::Other") == 5);
+
+    // Born on the threads, dying on this one
+    made.clear();
+    REQUIRE(LiveBlocks("(anonymous namespace)::Other") == 1);
+}
+
+TEST_CASE("Prometheus") {
+    auto ptr = MakeShared<Payload>();
+    std::ostringstream text;
+    SharedStats::WritePrometheus(text, SharedStats::Global().TakeSnapshot());
+    REQUIRE(text.str().find("# TYPE shared_ptr_make_shared_total counter\n"
+                            "shared_ptr_make_shared_total ") != std::string::npos);
+    const std::string gauge = "shared_ptr_live_blocks{type=\"(anonymous namespace)::Payload\"} 1\n";
+    REQUIRE(text.str().find(gauge) != std::string::npos);
+
+    const std::string path = "shared_stats_test.prom";
+    {
+        SharedStatsExporter exporter(path, std::chrono::milliseconds(1));
+        while (exporter.Written() < 3) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    REQUIRE(line == "# HELP shared_ptr_make_shared_total Control blocks created by MakeShared.");
+    std::remove(path.c_str());
+}
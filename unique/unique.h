@@ -4,6 +4,12 @@
 
 #include <cstddef>  // std::nullptr_t
 
+#include <common/sized_delete.h>
+
+#ifdef SMART_PTR_EVENT_TRACER
+#include <event-tracer/event_tracer.h>
+#endif
+
 struct Slug {};
 
 // Primary template
@@ -112,8 +118,12 @@ public:
     CompressedPair<T*, Deleter> buffer;
 
     void Delete() {
+#ifdef SMART_PTR_EVENT_TRACER
+        EventTracer::Span span(buffer.GetFirst() != nullptr ? "UniquePtr::Delete" : nullptr,
+                               typeid(T));
+#endif
         if constexpr (std::is_same_v<Deleter, Slug>) {
-            delete buffer.GetFirst();
+            SizedDelete(buffer.GetFirst());
         } else {
             buffer.GetSecond()(buffer.GetFirst());
         }
@@ -228,6 +238,10 @@ public:
     CompressedPair<T*, Deleter> buffer;
 
     void Delete() {
+#ifdef SMART_PTR_EVENT_TRACER
+        EventTracer::Span span(buffer.GetFirst() != nullptr ? "UniquePtr::Delete" : nullptr,
+                               typeid(T));
+#endif
         if constexpr (std::is_same_v<Deleter, Slug>) {
             delete[] buffer.GetFirst();
         } else {
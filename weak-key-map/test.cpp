@@ -0,0 +1,110 @@
+#include "weak_key_map.h"
+
+#include <common/my_int.h>
+
+#include <catch.hpp>
+
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Object {
+    int id = 0;
+};
+
+TEST_CASE("WeakKeyHashMap") {
+    WeakKeyHashMap<Object, std::string> map;
+    auto a = MakeShared<Object>();
+    auto b = MakeShared<Object>();
+
+    SECTION("Insert and find") {
+        REQUIRE(map.Find(a) == nullptr);
+        auto [value, inserted] = map.Emplace(a, "a");
+        REQUIRE(inserted);
+        REQUIRE(*value == "a");
+        REQUIRE(!map.Emplace(a, "other").second);
+        map[b] = "b";
+
+        REQUIRE(map.Size() == 2);
+        REQUIRE(*map.Find(a) == "a");
+        REQUIRE(*map.Find(WeakPtr<Object>(b)) == "b");
+        REQUIRE(!map.Contains(MakeShared<Object>()));
+    }
+
+    SECTION("Keys are compared by owner") {
+        map[a] = "a";
+        SharedPtr<int> alias(a, &a->id);
+        REQUIRE(*map.Find(alias) == "a");
+    }
+
+    SECTION("Map doesn't own keys") {
+        map[a] = "a";
+        REQUIRE(a.UseCount() == 1);
+        WeakPtr<Object> weak(a);
+        a.Reset();
+        REQUIRE(weak.Expired());
+        REQUIRE(map.Find(weak) == nullptr);
+        REQUIRE(map.Size() == 0);
+    }
+
+    SECTION("Erase") {
+        map[a] = "a";
+        map[b] = "b";
+        REQUIRE(map.Erase(a));
+        REQUIRE(!map.Erase(a));
+        REQUIRE(map.Find(a) == nullptr);
+        REQUIRE(*map.Find(b) == "b");
+        map[a] = "again";
+        REQUIRE(*map.Find(a) == "again");
+        REQUIRE(map.Size() == 2);
+    }
+
+    SECTION("Growth") {
+        std::vector<SharedPtr<Object>> keys;
+        for (int i = 0; i < 1000; ++i) {
+            keys.push_back(MakeShared<Object>());
+            map[keys.back()] = std::to_string(i);
+        }
+        REQUIRE(map.Size() == 1000);
+        REQUIRE(map.Capacity() >= 1000);
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(*map.Find(keys[i]) == std::to_string(i));
+        }
+
+        size_t visited = 0;
+        map.ForEach([&visited](const SharedPtr<Object>&, std::string&) { ++visited; });
+        REQUIRE(visited == 1000);
+    }
+}
+
+TEST_CASE("Expired entries are purged lazily") {
+    int alive = MyInt::AliveCount();
+    WeakKeyHashMap<Object, MyInt> map;
+    std::vector<SharedPtr<Object>> keys;
+    for (int i = 0; i < 100; ++i) {
+        keys.push_back(MakeShared<Object>());
+        map.Emplace(keys.back(), i);
+    }
+    REQUIRE(MyInt::AliveCount() == alive + 100);
+
+    keys.clear();
+    // Nothing has probed the table yet
+    REQUIRE(map.Size() == 100);
+
+    size_t visited = 0;
+    map.ForEach([&visited](const SharedPtr<Object>&, MyInt&) { ++visited; });
+    REQUIRE(visited == 0);
+
+    // Churn through new keys: probes and rehashes drop the dead entries,
+    // so the table doesn't grow without bound
+    for (int i = 0; i < 10000; ++i) {
+        auto key = MakeShared<Object>();
+        map.Emplace(key, i);
+    }
+    REQUIRE(map.Capacity() <= 64);
+    REQUIRE(MyInt::AliveCount() - alive == static_cast<int>(map.Size()));
+
+    map.Clear();
+    REQUIRE(MyInt::AliveCount() == alive);
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+
+#include <cstddef>  // size_t
+#include <cstdint>  // uint8_t
+#include <new>      // placement new
+#include <utility>  // std::forward, std::pair
+#include <vector>
+
+// Flat open-addressing hash map keyed by object identity.
+// Keys are held as `WeakPtr`s, so the map never keeps its keys alive. Entries with expired keys
+// are purged lazily when an insertion probes past them or the table is rehashed; nothing ever
+// scans the whole table just to find them. Lookups don't purge other entries, so they only touch
+// the control block of the key they look for; an expired entry of that key itself is dropped.
+// Once purges have freed half of the table, the next insertion rehashes it, so a table that
+// churns through short-lived keys shrinks back.
+// The map compares and hashes keys by owner: any `SharedPtr`/`WeakPtr` sharing the control
+// block of a key finds its entry.
+template <typename K, typename V>
+class WeakKeyHashMap {
+    enum class State : uint8_t { kEmpty, kFull, kTombstone };
+
+    struct Slot {
+        Slot() {
+        }
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+        ~Slot() {
+            Clear(State::kEmpty);
+        }
+
+        // Moves the entry of `other` into this (empty) slot.
+        void Take(Slot& other) {
+            new (&value) V(std::move_if_noexcept(*other.Value()));
+            key = std::move(other.key);
+            state = State::kFull;
+            other.Clear(State::kEmpty);
+        }
+        V* Value() {
+            return reinterpret_cast<V*>(&value);
+        }
+        void Clear(State new_state) {
+            if (state == State::kFull) {
+                Value()->~V();
+                key.Reset();
+            }
+            state = new_state;
+        }
+
+        State state = State::kEmpty;
+        WeakPtr<K> key;
+        alignas(V) char value[sizeof(V)];
+    };
+
+public:
+    WeakKeyHashMap() {
+    }
+
+    // Returns nullptr if there is no live entry for `key`.
+    template <typename P>
+    V* Find(const P& key) {
+        if (slots_.empty()) {
+            return nullptr;
+        }
+        size_t ind = Probe(key).first;
+        return ind == kNone ? nullptr : slots_[ind].Value();
+    }
+    template <typename P>
+    bool Contains(const P& key) {
+        return Find(key) != nullptr;
+    }
+
+    // Inserts `V(args...)` unless there is already an entry for `key`.
+    // Returns the entry and whether it was inserted.
+    template <typename... Args>
+    std::pair<V*, bool> Emplace(const SharedPtr<K>& key, Args&&... args) {
+        if ((size_ + tombstones_ + 1) * 4 > slots_.size() * 3 || purged_ * 2 > slots_.size()) {
+            Rehash();
+        }
+        auto [found, free] = Probe(key, true);
+        if (found != kNone) {
+            return {slots_[found].Value(), false};
+        }
+        Slot& slot = slots_[free];
+        new (&slot.value) V(std::forward<Args>(args)...);
+        if (slot.state == State::kTombstone) {
+            --tombstones_;
+        }
+        slot.key = WeakPtr<K>(key);
+        slot.state = State::kFull;
+        ++size_;
+        return {slot.Value(), true};
+    }
+
+    V& operator[](const SharedPtr<K>& key) {
+        return *Emplace(key).first;
+    }
+
+    template <typename P>
+    bool Erase(const P& key) {
+        if (slots_.empty()) {
+            return false;
+        }
+        size_t ind = Probe(key).first;
+        if (ind == kNone) {
+            return false;
+        }
+        Remove(ind);
+        return true;
+    }
+
+    // Calls `callback(const SharedPtr<K>&, V&)` for every live entry.
+    template <typename F>
+    void ForEach(F&& callback) {
+        for (auto& slot : slots_) {
+            if (slot.state == State::kFull) {
+                if (auto key = slot.key.Lock()) {
+                    callback(key, *slot.Value());
+                }
+            }
+        }
+    }
+
+    // Number of entries, including the expired ones that weren't purged yet.
+    size_t Size() const {
+        return size_;
+    }
+    size_t Capacity() const {
+        return slots_.size();
+    }
+
+    void Clear() {
+        slots_.clear();
+        size_ = tombstones_ = purged_ = 0;
+    }
+
+private:
+    static constexpr size_t kNone = static_cast<size_t>(-1);
+    static constexpr size_t kMinCapacity = 16;
+
+    // A non-empty `SharedPtr` is alive, no need to look at its control block.
+    template <typename U>
+    static bool IsExpired(const SharedPtr<U>& key) {
+        return !key;
+    }
+    template <typename U>
+    static bool IsExpired(const WeakPtr<U>& key) {
+        return key.Expired();
+    }
+
+    size_t Home(size_t hash) const {
+        // Fibonacci hashing: control block addresses have zero low bits
+        return (hash * 0x9E3779B97F4A7C15ull) >> shift_;
+    }
+
+    void Remove(size_t ind) {
+        slots_[ind].Clear(State::kTombstone);
+        --size_;
+        ++tombstones_;
+    }
+    void Purge(size_t ind) {
+        Remove(ind);
+        ++purged_;
+    }
+
+    // Walks the probe sequence of `key`, purging expired entries on the way if `purge` is set.
+    // Returns the slot holding `key` (or kNone) and the first slot where it could be inserted.
+    template <typename P>
+    std::pair<size_t, size_t> Probe(const P& key, bool purge = false) {
+        size_t mask = slots_.size() - 1;
+        size_t free = kNone;
+        for (size_t ind = Home(key.OwnerHash());; ind = (ind + 1) & mask) {
+            Slot& slot = slots_[ind];
+            if (purge && slot.state == State::kFull && slot.key.Expired()) {
+                Purge(ind);
+            }
+            if (slot.state == State::kEmpty) {
+                return {kNone, free == kNone ? ind : free};
+            }
+            if (slot.state == State::kTombstone) {
+                if (free == kNone) {
+                    free = ind;
+                }
+            } else if (slot.key.OwnerEqual(key)) {
+                if (IsExpired(key)) {
+                    Purge(ind);
+                    return {kNone, ind};
+                }
+                return {ind, free};
+            }
+        }
+    }
+
+    // Drops tombstones and expired entries, growing the table if it is still half full.
+    void Rehash() {
+        size_t live = 0;
+        for (auto& slot : slots_) {
+            if (slot.state == State::kFull && !slot.key.Expired()) {
+                ++live;
+            }
+        }
+        size_t capacity = kMinCapacity;
+        while (capacity < live * 2 + 2) {
+            capacity *= 2;
+        }
+
+        std::vector<Slot> old(capacity);
+        old.swap(slots_);
+        shift_ = 64;
+        for (size_t i = capacity; i > 1; i /= 2) {
+            --shift_;
+        }
+        size_ = tombstones_ = purged_ = 0;
+
+        for (auto& slot : old) {
+            if (slot.state != State::kFull || slot.key.Expired()) {
+                continue;
+            }
+            size_t ind = Home(slot.key.OwnerHash());
+            while (slots_[ind].state != State::kEmpty) {
+                ind = (ind + 1) & (capacity - 1);
+            }
+            slots_[ind].Take(slot);
+            ++size_;
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+    size_t tombstones_ = 0;
+    // Expired entries dropped by probes since the last rehash
+    size_t purged_ = 0;
+    int shift_ = 64;
+};
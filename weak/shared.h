@@ -2,6 +2,9 @@
 
 #include "sw_fwd.h"  // Forward declaration
 #include <cstddef>   // std::nullptr_t
+#include <new>       // std::align_val_t
+
+#include <common/sized_delete.h>
 
 class ControlBlockBasic {
 public:
@@ -20,6 +23,20 @@ public:
     virtual ~ControlBlockBasic() {
     }
 
+    // `delete this` in the control blocks goes through the sized deallocation functions
+    static void* operator new(size_t size) {
+        return ::operator new(size);
+    }
+    static void* operator new(size_t size, std::align_val_t align) {
+        return ::operator new(size, align);
+    }
+    static void operator delete(void* ptr, size_t size) {
+        ::operator delete(ptr, size);
+    }
+    static void operator delete(void* ptr, size_t size, std::align_val_t align) {
+        ::operator delete(ptr, size, align);
+    }
+
     size_t strong_cnt = 0;
     size_t weak_cnt = 0;
 };
@@ -34,7 +51,7 @@ public:
     void DecreaseStrong() override {
         --strong_cnt;
         if (strong_cnt == 0) {
-            delete x;
+            SizedDelete(x);
         }
         if (strong_cnt == 0 && weak_cnt == 0) {
             delete this;